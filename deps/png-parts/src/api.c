@@ -57,7 +57,7 @@ char const* pngparts_api_strerror(int result){
 }
 
 struct pngparts_api_flate pngparts_api_flate_empty(void){
-  struct pngparts_api_flate out = {NULL,NULL,NULL,NULL,NULL};
+  struct pngparts_api_flate out = {NULL,NULL,NULL,NULL,NULL,NULL};
   return out;
 }
 
@@ -160,6 +160,21 @@ typedef int (*pngparts_api_flate_put_cb)(void* zout, int ch);
  */
 typedef int (*pngparts_api_flate_one_cb)
   ( void* cb_data, int ch, void* put_data, pngparts_api_flate_put_cb put_cb);
+/*
+ * Block callback.
+ * - cb_data flate callback data
+ * - in input bytes
+ * - in_len number of input bytes; receives the number of bytes used
+ * - out output buffer
+ * - out_len space in the output buffer; receives the number
+ *   of bytes written
+ * @return OK if more input is needed, OVERFLOW if the output buffer
+ *   is too full, or DONE at the end of the bit stream;
+ *   return other negative on error
+ */
+typedef int (*pngparts_api_flate_block_cb)
+  ( void* cb_data, unsigned char const* in, int* in_len,
+    unsigned char* out, int* out_len);
 /*
  * Finish callback.
  * - cb_data flate callback data
@@ -183,6 +198,8 @@ struct pngparts_api_flate {
   pngparts_api_flate_one_cb one_cb;
   /* finish callback */
   pngparts_api_flate_finish_cb finish_cb;
+  /* block callback (optional) */
+  pngparts_api_flate_block_cb block_cb;
 };
 /*
  * Create an empty DEFLATE callback interface.
@@ -336,6 +353,89 @@ typedef void (*pngparts_api_image_get_cb)
     unsigned int *red, unsigned int *green, unsigned int *blue,
     unsigned int *alpha);
 
+/*
+ * Put a decoded scan line to the image.
+ * - img image
+ * - pass Adam7 pass (1 through 7), or zero for images without
+ *     interlacing
+ * - y row index of the line in the full image
+ * - x column of the first pixel in the full image
+ * - x_stride column distance in the full image between
+ *     adjacent pixels of the line
+ * - width number of pixels in the line
+ * - row packed samples in the native bit depth and color type
+ *     of the image: sub-byte samples start from the high bit,
+ *     16-bit samples are big-endian, and palette images give
+ *     indices
+ */
+typedef void (*pngparts_api_image_put_row_cb)
+  ( void* img, int pass, long int y, long int x, long int x_stride,
+    unsigned long int width, unsigned char const* row);
+
+/*
+ * Put a palette entry to the image. Palette images get each entry
+ *   in order before their first scan line.
+ * - img image
+ * - index palette index
+ * - red red sample
+ * - green green sample
+ * - blue blue sample
+ * - alpha alpha sample
+ */
+typedef void (*pngparts_api_image_put_plte_cb)
+  ( void* img, int index, unsigned int red, unsigned int green,
+    unsigned int blue, unsigned int alpha);
+
+/*
+ * Choose whether to receive a decoded scan line.
+ * - img image
+ * - pass Adam7 pass (1 through 7), or zero for images without
+ *     interlacing
+ * - y row index of the line in the full image
+ * - x column of the first pixel in the full image
+ * - x_stride column distance in the full image between
+ *     adjacent pixels of the line
+ * - width number of pixels in the line
+ * - mask output for `width` flags, nonzero for each pixel of the
+ *     line to put; only read for PNGPARTS_API_IMAGE_WANT_SOME,
+ *     and only by `put_cb`
+ * @return a value from `enum pngparts_api_image_want`
+ */
+typedef int (*pngparts_api_image_want_cb)
+  ( void* img, int pass, long int y, long int x, long int x_stride,
+    unsigned long int width, unsigned char const** mask);
+
+/*
+ * Answers from `pngparts_api_image_want_cb`.
+ */
+enum pngparts_api_image_want {
+  /* skip the line */
+  PNGPARTS_API_IMAGE_WANT_NONE = 0,
+  /* put the whole line */
+  PNGPARTS_API_IMAGE_WANT_ALL = 1,
+  /* put the pixels flagged in the mask */
+  PNGPARTS_API_IMAGE_WANT_SOME = 2,
+  /* skip this line and stop decoding the image; the rest of the
+   *   image data gets checked but not inflated */
+  PNGPARTS_API_IMAGE_WANT_DONE = 3
+};
+
+/*
+ * Image callback flags.
+ */
+enum pngparts_api_image_flags {
+  /* `put_cb` receives 8-bit samples (0 to 255) instead of 16-bit
+   *   samples; 16-bit images get rounded to the nearest value */
+  PNGPARTS_API_IMAGE_PUT_8BIT = 1,
+  /* `put_row_cb` takes palette images, as indices; images of other
+   *   color types go to `put_cb` unless another ROW_ flag claims them */
+  PNGPARTS_API_IMAGE_ROW_PALETTE = 2,
+  /* `put_row_cb` takes greyscale images, with or without alpha;
+   *   images of other color types go to `put_cb` unless another
+   *   ROW_ flag claims them */
+  PNGPARTS_API_IMAGE_ROW_GREY = 4
+};
+
 struct pngparts_api_image {
   /* callback data */
   void* cb_data;
@@ -347,6 +447,17 @@ struct pngparts_api_image {
   pngparts_api_image_describe_cb describe_cb;
   /* image color fetch callback (write only)*/
   pngparts_api_image_get_cb get_cb;
+  /* image scan line posting callback (read only, optional);
+   *   when set, the reader uses it instead of `put_cb`, subject
+   *   to the ROW_ flags */
+  pngparts_api_image_put_row_cb put_row_cb;
+  /* scan line selection callback (read only, optional);
+   *   when null, the reader puts every line */
+  pngparts_api_image_want_cb want_cb;
+  /* palette entry posting callback (read only, optional) */
+  pngparts_api_image_put_plte_cb put_plte_cb;
+  /* image callback flags (enum pngparts_api_image_flags) */
+  int flags;
 };
 
 /*
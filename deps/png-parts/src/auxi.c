@@ -11,9 +11,50 @@
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
+#if (defined __unix__) || (defined __APPLE__)
+#  define PNGPARTS_AUX_MMAP 1
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
 
 static unsigned int pngparts_aux_block_form(unsigned int f);
 
+struct pngparts_aux_reader {
+  struct pngparts_png parser;
+  struct pngparts_z zreader;
+  struct pngparts_flate inflater;
+  struct pngparts_api_flate flate_api;
+  /* parts set up so far */
+  unsigned int start_bits;
+};
+
+/*
+ * Set up a reader with its IDAT and PLTE callbacks.
+ * - r the reader to set up; tear it down even on failure
+ * @return OK on success, negative value otherwise
+ */
+static int pngparts_aux_reader_setup(struct pngparts_aux_reader* r);
+/*
+ * Free the parts of a reader that got set up.
+ * - r the reader to tear down
+ */
+static void pngparts_aux_reader_teardown(struct pngparts_aux_reader* r);
+/*
+ * Read a PNG stream with 16-bit color values.
+ * - r reader, reset before use
+ * - img image interface
+ * - f file to read, or NULL to read from `data`
+ * - data PNG stream in memory
+ * - len length of `data` in bytes
+ * @return OK on success, negative value otherwise
+ */
+static int pngparts_aux_reader_parse
+  ( struct pngparts_aux_reader* r, struct pngparts_api_image* img,
+    FILE* f, unsigned char const* data, size_t len);
+
 
 
 static int pngparts_aux_image_start8
@@ -82,106 +123,239 @@ int pngparts_aux_destroy_png_chunk(struct pngparts_png_chunk_cb const* cb){
   } else return PNGPARTS_API_OK;
 }
 
-int pngparts_aux_read_png_16
-  (struct pngparts_api_image* img, char const* fname)
-{
-  FILE *f = fopen(fname, "rb");
-  if (f != NULL){
-    int result = PNGPARTS_API_OK;
-    struct pngparts_png parser;
-    struct pngparts_z zreader;
-    struct pngparts_flate inflater;
-    unsigned int start_bits = 0;
-    do {
-      pngparts_pngread_init(&parser);
-      start_bits |= 1;
-      /* set image callback */{
-        pngparts_png_set_image_cb(&parser, img);
-      }
-      /* set IDAT callback */ {
-        struct pngparts_api_z z_api;
-        struct pngparts_api_flate flate_api;
-        struct pngparts_png_chunk_cb idat_api;
-        pngparts_zread_init(&zreader);
-        start_bits |= 2;
-        pngparts_inflate_init(&inflater);
-        start_bits |= 4;
-        pngparts_inflate_assign_api(&flate_api, &inflater);
-        pngparts_zread_assign_api(&z_api, &zreader);
-        pngparts_z_set_cb(&zreader, &flate_api);
-        /* assign IDAT callback */{
-          int const idat_result =
-            pngparts_pngread_assign_idat_api(&idat_api, &z_api);
-          if (idat_result != PNGPARTS_API_OK){
-            break;
-          }
-        }
-        /* add IDAT callback */{
-          int const add_idat_result =
-            pngparts_png_add_chunk_cb(&parser, &idat_api);
-          if (add_idat_result != PNGPARTS_API_OK){
-            /* destroy the IDAT callback */
-            pngparts_aux_destroy_png_chunk(&idat_api);
-            break;
-          }
+int pngparts_aux_reader_setup(struct pngparts_aux_reader* r){
+  int result = PNGPARTS_API_OK;
+  r->start_bits = 0;
+  do {
+    pngparts_pngread_init(&r->parser);
+    r->start_bits |= 1;
+    /* set IDAT callback */ {
+      struct pngparts_api_z z_api;
+      struct pngparts_png_chunk_cb idat_api;
+      pngparts_zread_init(&r->zreader);
+      r->start_bits |= 2;
+      pngparts_inflate_init(&r->inflater);
+      r->start_bits |= 4;
+      pngparts_inflate_assign_api(&r->flate_api, &r->inflater);
+      pngparts_zread_assign_api(&z_api, &r->zreader);
+      pngparts_z_set_cb(&r->zreader, &r->flate_api);
+      /* assign IDAT callback */{
+        int const idat_result =
+          pngparts_pngread_assign_idat_api(&idat_api, &z_api);
+        if (idat_result != PNGPARTS_API_OK){
+          result = idat_result;
+          break;
         }
       }
-      /* set PLTE callback */ {
-        struct pngparts_png_chunk_cb plte_api;
-        /* assign PLTE callback */{
-          int const plte_result =
-            pngparts_pngread_assign_plte_api(&plte_api);
-          if (plte_result != PNGPARTS_API_OK){
-            break;
-          }
+      /* add IDAT callback */{
+        int const add_idat_result =
+          pngparts_png_add_chunk_cb(&r->parser, &idat_api);
+        if (add_idat_result != PNGPARTS_API_OK){
+          /* destroy the IDAT callback */
+          pngparts_aux_destroy_png_chunk(&idat_api);
+          result = add_idat_result;
+          break;
         }
-        /* add PLTE callback */{
-          int const add_plte_result =
-            pngparts_png_add_chunk_cb(&parser, &plte_api);
-          if (add_plte_result != PNGPARTS_API_OK){
-            /* destroy the PLTE callback */
-            pngparts_aux_destroy_png_chunk(&plte_api);
-            break;
-          }
+      }
+    }
+    /* set PLTE callback */ {
+      struct pngparts_png_chunk_cb plte_api;
+      /* assign PLTE callback */{
+        int const plte_result =
+          pngparts_pngread_assign_plte_api(&plte_api);
+        if (plte_result != PNGPARTS_API_OK){
+          result = plte_result;
+          break;
         }
       }
-      start_bits |= 8;
-    } while (0);
-    if (start_bits != 15){
-      /* destroy the PNG structure first */
-      if (start_bits & 1)
-        pngparts_pngread_free(&parser);
-      /* next destroy the zlib stream writer */
-      if (start_bits & 2)
-        pngparts_zread_free(&zreader);
-      /* then, last destroy the inflater */
-      if (start_bits & 4)
-        pngparts_inflate_free(&inflater);
-    } else {
-      /* parse the image */
-      do {
-        unsigned char inbuf[256];
-        size_t readlen;
-        while ((readlen = fread(inbuf, sizeof(unsigned char), 256, f)) > 0) {
-          pngparts_png_buffer_setup(&parser, inbuf, (int)readlen);
-          while (!pngparts_png_buffer_done(&parser)) {
-            result = pngparts_pngread_parse(&parser);
-            if (result < 0) break;
-          }
-          if (result < 0) break;
+      /* add PLTE callback */{
+        int const add_plte_result =
+          pngparts_png_add_chunk_cb(&r->parser, &plte_api);
+        if (add_plte_result != PNGPARTS_API_OK){
+          /* destroy the PLTE callback */
+          pngparts_aux_destroy_png_chunk(&plte_api);
+          result = add_plte_result;
+          break;
         }
+      }
+    }
+    r->start_bits |= 8;
+  } while (0);
+  return result;
+}
+
+void pngparts_aux_reader_teardown(struct pngparts_aux_reader* r){
+  /* destroy the PNG structure first */
+  if (r->start_bits & 1)
+    pngparts_pngread_free(&r->parser);
+  /* next destroy the zlib stream reader */
+  if (r->start_bits & 2)
+    pngparts_zread_free(&r->zreader);
+  /* then, last destroy the inflater */
+  if (r->start_bits & 4)
+    pngparts_inflate_free(&r->inflater);
+  r->start_bits = 0;
+  return;
+}
+
+int pngparts_aux_reader_parse
+  ( struct pngparts_aux_reader* r, struct pngparts_api_image* img,
+    FILE* f, unsigned char const* data, size_t len)
+{
+  int result;
+  if (r->start_bits != 15){
+    return PNGPARTS_API_BAD_STATE;
+  }
+  /* reset the reader, keeping the callbacks and their buffers */{
+    result = pngparts_pngread_reset(&r->parser);
+    if (result != PNGPARTS_API_OK)
+      return result;
+    pngparts_zread_init(&r->zreader);
+    pngparts_z_set_cb(&r->zreader, &r->flate_api);
+  }
+  /* set image callback */{
+    pngparts_png_set_image_cb(&r->parser, img);
+  }
+  if (f != NULL){
+    /* parse the image */
+    unsigned char inbuf[4096];
+    size_t readlen;
+    while ((readlen = fread(inbuf, sizeof(unsigned char), sizeof(inbuf), f))
+        > 0)
+    {
+      pngparts_png_buffer_setup(&r->parser, inbuf, (int)readlen);
+      while (!pngparts_png_buffer_done(&r->parser)) {
+        result = pngparts_pngread_parse(&r->parser);
         if (result < 0) break;
-      } while (0);
+      }
+      if (result < 0) break;
     }
-    /* cleanup */
+  } else {
+    /* parse the image in place, the reader only reads the buffer */
+    while (len > 0) {
+      size_t const readlen = (len > INT_MAX) ? INT_MAX : len;
+      pngparts_png_buffer_setup(&r->parser, (void*)data, (int)readlen);
+      while (!pngparts_png_buffer_done(&r->parser)) {
+        result = pngparts_pngread_parse(&r->parser);
+        if (result < 0) break;
+      }
+      if (result < 0) break;
+      data += readlen;
+      len -= readlen;
+    }
+  }
+  return result<0?result:PNGPARTS_API_OK;
+}
+
+struct pngparts_aux_reader* pngparts_aux_reader_new(void){
+  struct pngparts_aux_reader* r = (struct pngparts_aux_reader*)malloc
+    (sizeof(struct pngparts_aux_reader));
+  if (r != NULL){
+    if (pngparts_aux_reader_setup(r) != PNGPARTS_API_OK){
+      pngparts_aux_reader_teardown(r);
+      free(r);
+      r = NULL;
+    }
+  }
+  return r;
+}
+
+void pngparts_aux_reader_free(struct pngparts_aux_reader* r){
+  if (r != NULL){
+    pngparts_aux_reader_teardown(r);
+    free(r);
+  }
+  return;
+}
+
+int pngparts_aux_reader_read_png_16
+  ( struct pngparts_aux_reader* r, struct pngparts_api_image* img,
+    char const* fname)
+{
+  FILE *f = fopen(fname, "rb");
+  if (f != NULL){
+    int const result = pngparts_aux_reader_parse(r, img, f, NULL, 0);
     fclose(f);
-    pngparts_pngread_free(&parser);
-    pngparts_zread_free(&zreader);
-    pngparts_inflate_free(&inflater);
-    return result<0?result:PNGPARTS_API_OK;
+    return result;
+  } else return PNGPARTS_API_IO_ERROR;
+}
+
+int pngparts_aux_reader_read_png_map_16
+  ( struct pngparts_aux_reader* r, struct pngparts_api_image* img,
+    char const* fname)
+{
+#if (defined PNGPARTS_AUX_MMAP)
+  int const fd = open(fname, O_RDONLY);
+  if (fd >= 0){
+    struct stat st;
+    void* map = MAP_FAILED;
+    size_t len = 0;
+    int result;
+    if (fstat(fd, &st) == 0 && st.st_size > 0
+    &&  (off_t)(size_t)st.st_size == st.st_size)
+    {
+      len = (size_t)st.st_size;
+      map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (map != MAP_FAILED){
+      result = pngparts_aux_reader_parse
+        (r, img, NULL, (unsigned char const*)map, len);
+      munmap(map, len);
+      close(fd);
+      return result;
+    }
+    /* not mappable, so read it the usual way */
+    close(fd);
+  } else return PNGPARTS_API_IO_ERROR;
+#endif /*PNGPARTS_AUX_MMAP*/
+  return pngparts_aux_reader_read_png_16(r, img, fname);
+}
+
+int pngparts_aux_reader_read_png_mem_16
+  ( struct pngparts_aux_reader* r, struct pngparts_api_image* img,
+    void const* data, size_t len)
+{
+  return pngparts_aux_reader_parse
+    (r, img, NULL, (unsigned char const*)data, len);
+}
+
+int pngparts_aux_read_png_16
+  (struct pngparts_api_image* img, char const* fname)
+{
+  FILE *f = fopen(fname, "rb");
+  if (f != NULL){
+    struct pngparts_aux_reader reader;
+    int result = pngparts_aux_reader_setup(&reader);
+    if (result == PNGPARTS_API_OK)
+      result = pngparts_aux_reader_parse(&reader, img, f, NULL, 0);
+    pngparts_aux_reader_teardown(&reader);
+    fclose(f);
+    return result;
   } else return PNGPARTS_API_IO_ERROR;
 }
 
+int pngparts_aux_read_png_mem_16
+  (struct pngparts_api_image* img, void const* data, size_t len)
+{
+  struct pngparts_aux_reader reader;
+  int result = pngparts_aux_reader_setup(&reader);
+  if (result == PNGPARTS_API_OK)
+    result = pngparts_aux_reader_read_png_mem_16(&reader, img, data, len);
+  pngparts_aux_reader_teardown(&reader);
+  return result;
+}
+
+int pngparts_aux_read_png_map_16
+  (struct pngparts_api_image* img, char const* fname)
+{
+  struct pngparts_aux_reader reader;
+  int result = pngparts_aux_reader_setup(&reader);
+  if (result == PNGPARTS_API_OK)
+    result = pngparts_aux_reader_read_png_map_16(&reader, img, fname);
+  pngparts_aux_reader_teardown(&reader);
+  return result;
+}
+
 int pngparts_aux_write_png_16
   (struct pngparts_api_image* img, char const* fname)
 {
@@ -481,21 +655,60 @@ int pngparts_aux_read_png_8
   (struct pngparts_api_image* img, char const* fname)
 {
   struct pngparts_api_image aux_img;
-  /* aux_img */{
-    /* callback data */
-    aux_img.cb_data = img;
-    /* image start callback (read only)*/
-    aux_img.start_cb = pngparts_aux_image_start8;
-    /* image color posting callback (read only)*/
-    aux_img.put_cb = pngparts_aux_image_put_to8;
-    /* image describe callback (write only)*/
-    aux_img.describe_cb = pngparts_aux_image_describe8;
-    /* image color fetch callback (write only)*/
-    aux_img.get_cb = pngparts_aux_image_get_from8;
-  }
+  memcpy(&aux_img, img, sizeof(aux_img));
+  /* let the reader produce 8-bit samples directly */
+  aux_img.flags |= PNGPARTS_API_IMAGE_PUT_8BIT;
   return pngparts_aux_read_png_16(&aux_img, fname);
 }
 
+int pngparts_aux_read_png_mem_8
+  (struct pngparts_api_image* img, void const* data, size_t len)
+{
+  struct pngparts_api_image aux_img;
+  memcpy(&aux_img, img, sizeof(aux_img));
+  aux_img.flags |= PNGPARTS_API_IMAGE_PUT_8BIT;
+  return pngparts_aux_read_png_mem_16(&aux_img, data, len);
+}
+
+int pngparts_aux_read_png_map_8
+  (struct pngparts_api_image* img, char const* fname)
+{
+  struct pngparts_api_image aux_img;
+  memcpy(&aux_img, img, sizeof(aux_img));
+  aux_img.flags |= PNGPARTS_API_IMAGE_PUT_8BIT;
+  return pngparts_aux_read_png_map_16(&aux_img, fname);
+}
+
+int pngparts_aux_reader_read_png_8
+  ( struct pngparts_aux_reader* r, struct pngparts_api_image* img,
+    char const* fname)
+{
+  struct pngparts_api_image aux_img;
+  memcpy(&aux_img, img, sizeof(aux_img));
+  aux_img.flags |= PNGPARTS_API_IMAGE_PUT_8BIT;
+  return pngparts_aux_reader_read_png_16(r, &aux_img, fname);
+}
+
+int pngparts_aux_reader_read_png_map_8
+  ( struct pngparts_aux_reader* r, struct pngparts_api_image* img,
+    char const* fname)
+{
+  struct pngparts_api_image aux_img;
+  memcpy(&aux_img, img, sizeof(aux_img));
+  aux_img.flags |= PNGPARTS_API_IMAGE_PUT_8BIT;
+  return pngparts_aux_reader_read_png_map_16(r, &aux_img, fname);
+}
+
+int pngparts_aux_reader_read_png_mem_8
+  ( struct pngparts_aux_reader* r, struct pngparts_api_image* img,
+    void const* data, size_t len)
+{
+  struct pngparts_api_image aux_img;
+  memcpy(&aux_img, img, sizeof(aux_img));
+  aux_img.flags |= PNGPARTS_API_IMAGE_PUT_8BIT;
+  return pngparts_aux_reader_read_png_mem_16(r, &aux_img, data, len);
+}
+
 int pngparts_aux_write_png_8
   (struct pngparts_api_image* img, char const* fname)
 {
@@ -511,6 +724,14 @@ int pngparts_aux_write_png_8
     aux_img.describe_cb = pngparts_aux_image_describe8;
     /* image color fetch callback (write only)*/
     aux_img.get_cb = pngparts_aux_image_get_from8;
+    /* image scan line posting callback (read only)*/
+    aux_img.put_row_cb = NULL;
+    /* scan line selection callback (read only)*/
+    aux_img.want_cb = NULL;
+    /* palette entry posting callback (read only)*/
+    aux_img.put_plte_cb = NULL;
+    /* image callback flags */
+    aux_img.flags = 0;
   }
   return pngparts_aux_write_png_16(&aux_img, fname);
 }
@@ -573,10 +794,10 @@ void pngparts_aux_block_put
         pixel_short[2] = blue;
         pixel_short[3] = alpha;
       } else {
-        pixel_start[0] = red/257;
-        pixel_start[1] = green/257;
-        pixel_start[2] = blue/257;
-        pixel_start[3] = alpha/257;
+        pixel_start[0] = (unsigned char)red;
+        pixel_start[1] = (unsigned char)green;
+        pixel_start[2] = (unsigned char)blue;
+        pixel_start[3] = (unsigned char)alpha;
       }break;
     case 4: /* LA */
       if (bytes == 2){
@@ -584,8 +805,8 @@ void pngparts_aux_block_put
         pixel_short[0] = red;
         pixel_short[1] = alpha;
       } else {
-        pixel_start[0] = red/257;
-        pixel_start[1] = alpha/257;
+        pixel_start[0] = (unsigned char)red;
+        pixel_start[1] = (unsigned char)alpha;
       }break;
     case 2: /* RGB */
       if (bytes == 2){
@@ -594,16 +815,16 @@ void pngparts_aux_block_put
         pixel_short[1] = green;
         pixel_short[2] = blue;
       } else {
-        pixel_start[0] = red/257;
-        pixel_start[1] = green/257;
-        pixel_start[2] = blue/257;
+        pixel_start[0] = (unsigned char)red;
+        pixel_start[1] = (unsigned char)green;
+        pixel_start[2] = (unsigned char)blue;
       }break;
     case 0: /* L */
       if (bytes == 2){
         unsigned short* pixel_short = (unsigned short*)pixel_start;
         pixel_short[0] = red;
       } else {
-        pixel_start[0] = red/257;
+        pixel_start[0] = (unsigned char)red;
       }break;
     }
   }
@@ -718,6 +939,14 @@ int pngparts_aux_write_block
     aux_img.describe_cb = pngparts_aux_block_describe;
     /* image color fetch callback (write only)*/
     aux_img.get_cb = pngparts_aux_block_get;
+    /* image scan line posting callback (read only)*/
+    aux_img.put_row_cb = NULL;
+    /* scan line selection callback (read only)*/
+    aux_img.want_cb = NULL;
+    /* palette entry posting callback (read only)*/
+    aux_img.put_plte_cb = NULL;
+    /* image callback flags */
+    aux_img.flags = 0;
   };
   return pngparts_aux_write_png_16(&aux_img, fname);
 }
@@ -757,6 +986,14 @@ int pngparts_aux_read_block
     aux_img.describe_cb = NULL;
     /* image color fetch callback (write only)*/
     aux_img.get_cb = NULL;
+    /* image scan line posting callback (read only)*/
+    aux_img.put_row_cb = NULL;
+    /* scan line selection callback (read only)*/
+    aux_img.want_cb = NULL;
+    /* palette entry posting callback (read only)*/
+    aux_img.put_plte_cb = NULL;
+    /* image callback flags */
+    aux_img.flags = (bits == 8) ? PNGPARTS_API_IMAGE_PUT_8BIT : 0;
   }
   return pngparts_aux_read_png_16(&aux_img, fname);
 }
@@ -804,6 +1041,14 @@ int pngparts_aux_read_header
       aux_img.describe_cb = NULL;
       /* image color fetch callback (write only)*/
       aux_img.get_cb = NULL;
+      /* image scan line posting callback (read only)*/
+      aux_img.put_row_cb = NULL;
+      /* scan line selection callback (read only)*/
+      aux_img.want_cb = NULL;
+      /* palette entry posting callback (read only)*/
+      aux_img.put_plte_cb = NULL;
+      /* image callback flags */
+      aux_img.flags = 0;
     }
     aux_indirect.set = 0;
     do {
@@ -12,6 +12,7 @@
 #define __PNG_PARTS_AUX_H__
 
 #include "api.h"
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,6 +21,7 @@ extern "C" {
 struct pngparts_png_chunk_cb;
 struct pngparts_png_header;
 struct pngparts_pngwrite_sieve;
+struct pngparts_aux_reader;
 
 enum pngparts_aux_format {
   /* one sample of luminance */
@@ -50,6 +52,32 @@ PNGPARTS_API
 int pngparts_aux_read_png_16
   (struct pngparts_api_image* img, char const* fname);
 
+/*
+ * Read a PNG image in memory with 16-bit color values.
+ * - img image interface
+ * - data the PNG stream
+ * - len length of the stream in bytes
+ * @return OK on success, negative value otherwise
+ */
+PNGPARTS_API
+int pngparts_aux_read_png_mem_16
+  (struct pngparts_api_image* img, void const* data, size_t len);
+
+/*
+ * Read a PNG file with 16-bit color values, mapping the file
+ *   into memory where the platform allows.
+ *   The file must not shrink or change until the call returns:
+ *   where it is mapped, a shrinking file raises SIGBUS instead of
+ *   an I/O error. Use the unmapped reader for files that others
+ *   may be writing.
+ * - img image interface
+ * - fname file name to read
+ * @return OK on success, negative value otherwise
+ */
+PNGPARTS_API
+int pngparts_aux_read_png_map_16
+  (struct pngparts_api_image* img, char const* fname);
+
 /*
  * Write a PNG file with 16-bit color values.
  * - img image interface
@@ -70,6 +98,29 @@ PNGPARTS_API
 int pngparts_aux_read_png_8
   (struct pngparts_api_image* img, char const* fname);
 
+/*
+ * Read a PNG image in memory with 8-bit color values.
+ * - img image interface
+ * - data the PNG stream
+ * - len length of the stream in bytes
+ * @return OK on success, negative value otherwise
+ */
+PNGPARTS_API
+int pngparts_aux_read_png_mem_8
+  (struct pngparts_api_image* img, void const* data, size_t len);
+
+/*
+ * Read a PNG file with 8-bit color values, mapping the file
+ *   into memory where the platform allows; the file must not
+ *   change during the call, as with pngparts_aux_read_png_map_16.
+ * - img image interface
+ * - fname file name to read
+ * @return OK on success, negative value otherwise
+ */
+PNGPARTS_API
+int pngparts_aux_read_png_map_8
+  (struct pngparts_api_image* img, char const* fname);
+
 /*
  * Write a PNG file with 8-bit color values.
  * - img image interface
@@ -80,6 +131,100 @@ PNGPARTS_API
 int pngparts_aux_write_png_8
   (struct pngparts_api_image* img, char const* fname);
 
+/*
+ * Create a reader that keeps its parser, inflater and buffers
+ *   from one image to the next. Calls on one reader must not
+ *   overlap.
+ * @return the reader, or NULL on allocation failure
+ */
+PNGPARTS_API
+struct pngparts_aux_reader* pngparts_aux_reader_new(void);
+
+/*
+ * Destroy a reader.
+ * - r the reader to destroy, or NULL
+ */
+PNGPARTS_API
+void pngparts_aux_reader_free(struct pngparts_aux_reader* r);
+
+/*
+ * Read a PNG file with 16-bit color values using a reader.
+ * - r the reader
+ * - img image interface
+ * - fname file name to read
+ * @return OK on success, negative value otherwise
+ */
+PNGPARTS_API
+int pngparts_aux_reader_read_png_16
+  ( struct pngparts_aux_reader* r, struct pngparts_api_image* img,
+    char const* fname);
+
+/*
+ * Read a PNG file with 8-bit color values using a reader.
+ * - r the reader
+ * - img image interface
+ * - fname file name to read
+ * @return OK on success, negative value otherwise
+ */
+PNGPARTS_API
+int pngparts_aux_reader_read_png_8
+  ( struct pngparts_aux_reader* r, struct pngparts_api_image* img,
+    char const* fname);
+
+/*
+ * Read a PNG file with 16-bit color values using a reader, mapping
+ *   the file into memory where the platform allows; the file must
+ *   not change during the call, as with pngparts_aux_read_png_map_16.
+ * - r the reader
+ * - img image interface
+ * - fname file name to read
+ * @return OK on success, negative value otherwise
+ */
+PNGPARTS_API
+int pngparts_aux_reader_read_png_map_16
+  ( struct pngparts_aux_reader* r, struct pngparts_api_image* img,
+    char const* fname);
+
+/*
+ * Read a PNG file with 8-bit color values using a reader, mapping
+ *   the file into memory where the platform allows; the file must
+ *   not change during the call, as with pngparts_aux_read_png_map_16.
+ * - r the reader
+ * - img image interface
+ * - fname file name to read
+ * @return OK on success, negative value otherwise
+ */
+PNGPARTS_API
+int pngparts_aux_reader_read_png_map_8
+  ( struct pngparts_aux_reader* r, struct pngparts_api_image* img,
+    char const* fname);
+
+/*
+ * Read a PNG image in memory with 16-bit color values using a reader.
+ * - r the reader
+ * - img image interface
+ * - data the PNG stream
+ * - len length of the stream in bytes
+ * @return OK on success, negative value otherwise
+ */
+PNGPARTS_API
+int pngparts_aux_reader_read_png_mem_16
+  ( struct pngparts_aux_reader* r, struct pngparts_api_image* img,
+    void const* data, size_t len);
+
+/*
+ * Read a PNG image in memory with 8-bit color values using a reader.
+ * - r the reader
+ * - img image interface
+ * - data the PNG stream
+ * - len length of the stream in bytes
+ * @return OK on success, negative value otherwise
+ */
+PNGPARTS_API
+int pngparts_aux_reader_read_png_mem_8
+  ( struct pngparts_aux_reader* r, struct pngparts_api_image* img,
+    void const* data, size_t len);
+
 /*
  * Free some memory.
  * - p a pointer to some memory to free
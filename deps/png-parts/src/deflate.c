@@ -1332,6 +1332,7 @@ void pngparts_deflate_assign_api
   fcb->dict_cb = pngparts_deflate_dict;
   fcb->one_cb = pngparts_deflate_one;
   fcb->finish_cb = pngparts_deflate_finish;
+  fcb->block_cb = NULL;
   return;
 }
 
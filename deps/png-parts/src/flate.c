@@ -249,6 +249,13 @@ static int pngparts_flate_presort_cmp(void const *a, void const* b);
  * @return a new bit set with only the lowest bit set in `x`
  */
 static unsigned long int pngparts_flate_minwidth(unsigned long int x);
+/*
+ * Reverse the order of bits in a bit string.
+ * - bits bit string
+ * - length length of bit string
+ * @return the reversed bit string
+ */
+static unsigned int pngparts_flate_bit_reverse(unsigned int bits, int length);
 
 
 
@@ -900,6 +907,125 @@ int pngparts_flate_huff_bit_lsearch
   /* not found */
   return PNGPARTS_API_NOT_FOUND;
 }
+unsigned int pngparts_flate_bit_reverse(unsigned int bits, int length){
+  unsigned int out = 0;
+  int i;
+  for (i = 0; i < length; ++i){
+    out = (out<<1)|(bits&1);
+    bits >>= 1;
+  }
+  return out;
+}
+void pngparts_flate_lut_init(struct pngparts_flate_lut* lut){
+  lut->its = NULL;
+  lut->cap = 0;
+  lut->primary_bits = 0;
+}
+void pngparts_flate_lut_free(struct pngparts_flate_lut* lut){
+  free(lut->its);
+  lut->its = NULL;
+  lut->cap = 0;
+  lut->primary_bits = 0;
+}
+int pngparts_flate_lut_build
+  ( struct pngparts_flate_lut* lut, struct pngparts_flate_huff const* hf,
+    int primary_bits)
+{
+  unsigned char sub_bits[1024];
+  int const primary_size = 1<<primary_bits;
+  int const primary_mask = primary_size-1;
+  int total = primary_size;
+  int i;
+  if (primary_bits < 1 || primary_bits > 10)
+    return PNGPARTS_API_BAD_PARAM;
+  memset(sub_bits, 0, primary_size);
+  /* size the secondary tables */for (i = 0; i < hf->count; ++i){
+    int const length = hf->its[i].length;
+    if (length < 0 || length > 15)
+      return PNGPARTS_API_BAD_BITS;
+    else if (length > primary_bits){
+      unsigned int const rev =
+        pngparts_flate_bit_reverse(hf->its[i].bits, length);
+      int const j = (int)(rev&primary_mask);
+      if (length-primary_bits > sub_bits[j])
+        sub_bits[j] = (unsigned char)(length-primary_bits);
+    }
+  }
+  for (i = 0; i < primary_size; ++i){
+    if (sub_bits[i] > 0)
+      total += (1<<sub_bits[i]);
+  }
+  /* allocate */if (total > lut->cap){
+    void* it = realloc(lut->its,sizeof(struct pngparts_flate_lut_entry)*total);
+    if (it == NULL)
+      return PNGPARTS_API_MEMORY;
+    lut->its = it;
+    lut->cap = total;
+  }
+  lut->primary_bits = primary_bits;
+  memset(lut->its, 0, sizeof(struct pngparts_flate_lut_entry)*total);
+  /* link the secondary tables */{
+    int offset = primary_size;
+    for (i = 0; i < primary_size; ++i){
+      if (sub_bits[i] > 0){
+        lut->its[i].value = (unsigned short)offset;
+        lut->its[i].sub_bits = sub_bits[i];
+        offset += (1<<sub_bits[i]);
+      }
+    }
+  }
+  /* fill in the codes */for (i = 0; i < hf->count; ++i){
+    struct pngparts_flate_lut_entry entry;
+    int const length = hf->its[i].length;
+    unsigned int const rev =
+      pngparts_flate_bit_reverse(hf->its[i].bits, length);
+    int j;
+    if (length == 0)
+      continue;
+    entry.value = (unsigned short)hf->its[i].value;
+    entry.length = (unsigned char)length;
+    entry.sub_bits = 0;
+    if (length <= primary_bits){
+      for (j = (int)rev; j < primary_size; j += (1<<length)){
+        if (lut->its[j].sub_bits > 0)
+          return PNGPARTS_API_BAD_BITS;
+        lut->its[j] = entry;
+      }
+    } else {
+      struct pngparts_flate_lut_entry const link =
+        lut->its[rev&primary_mask];
+      int const sub_size = 1<<link.sub_bits;
+      if (link.sub_bits == 0)
+        return PNGPARTS_API_BAD_BITS;
+      for (j = (int)(rev>>primary_bits); j < sub_size;
+          j += (1<<(length-primary_bits)))
+      {
+        lut->its[link.value+j] = entry;
+      }
+    }
+  }
+  return PNGPARTS_API_OK;
+}
+int pngparts_flate_lut_get
+  (struct pngparts_flate_lut const* lut, unsigned int bits, int* length)
+{
+  struct pngparts_flate_lut_entry entry =
+    lut->its[bits&((1u<<lut->primary_bits)-1u)];
+  if (entry.sub_bits > 0){
+    int const examined = lut->primary_bits+entry.sub_bits;
+    entry = lut->its[entry.value
+      + ((bits>>lut->primary_bits)&((1u<<entry.sub_bits)-1u))];
+    if (entry.length == 0){
+      *length = examined;
+      return PNGPARTS_API_BAD_BITS;
+    }
+  } else if (entry.length == 0){
+    *length = lut->primary_bits;
+    return PNGPARTS_API_BAD_BITS;
+  }
+  *length = entry.length;
+  return entry.value;
+}
 void pngparts_flate_fixed_lengths(struct pngparts_flate_huff* hf){
   assert(hf->count>=288);
   memcpy(hf->its,pngparts_flate_fixed_l_table,
@@ -17,6 +17,18 @@
 extern "C" {
 #endif /*__cplusplus*/
 
+/*
+ * Bit buffer, at least 64 bits wide.
+ */
+#if (defined __cplusplus) \
+||  ((defined __STDC_VERSION__) && (__STDC_VERSION__ >= 199901L))
+typedef unsigned long long int pngparts_flate_bits;
+#elif (defined _MSC_VER)
+typedef unsigned __int64 pngparts_flate_bits;
+#else
+typedef unsigned long int pngparts_flate_bits;
+#endif
+
 /*
  * Compression block types.
  */
@@ -77,6 +89,29 @@ struct pngparts_flate_huff {
   int count;
 };
 
+/*
+ * Huffman decoding lookup table entry
+ */
+struct pngparts_flate_lut_entry {
+  /* corresponding length-literal value, or offset of secondary table */
+  unsigned short value;
+  /* bit length of the item, or zero if not a complete code */
+  unsigned char length;
+  /* index bits of the secondary table, or zero if a direct entry */
+  unsigned char sub_bits;
+};
+/*
+ * Huffman decoding lookup table
+ */
+struct pngparts_flate_lut {
+  /* primary table entries, followed by secondary tables */
+  struct pngparts_flate_lut_entry *its;
+  /* capacity of entries */
+  int cap;
+  /* index bits of the primary table */
+  int primary_bits;
+};
+
 /*
  * Past hash table
  */
@@ -110,7 +145,7 @@ struct pngparts_flate {
   /* size of history of bits */
   unsigned char bitlength;
   /* history of previous bits */
-  unsigned int bitline;
+  pngparts_flate_bits bitline;
   /* amount of inscription committed so far */
   unsigned short inscription_commit;
   /* position in current inscription */
@@ -158,6 +193,14 @@ struct pngparts_flate {
   unsigned short alt_inscription[5];
   /* hash table for compression pairs */
   struct pngparts_flate_hash pointer_hash;
+  /* code lookup table for code table */
+  struct pngparts_flate_lut code_lut;
+  /* length lookup table */
+  struct pngparts_flate_lut length_lut;
+  /* distance lookup table */
+  struct pngparts_flate_lut distance_lut;
+  /* whether the length and distance lookup tables hold the fixed codes */
+  unsigned char fixed_lut_tf;
 };
 
 
@@ -282,6 +325,46 @@ PNGPARTS_API
 int pngparts_flate_huff_bit_lsearch
   (struct pngparts_flate_huff const* hf, int length, int bits);
 
+/*
+ * Initialize a Huffman lookup table.
+ * - lut lookup table
+ */
+PNGPARTS_API
+void pngparts_flate_lut_init(struct pngparts_flate_lut* lut);
+/*
+ * Free out a Huffman lookup table.
+ * - lut lookup table
+ */
+PNGPARTS_API
+void pngparts_flate_lut_free(struct pngparts_flate_lut* lut);
+/*
+ * Build a lookup table from a code table. Codes no longer than the
+ * primary index resolve in one probe; longer codes resolve through
+ * a secondary table in two probes.
+ * - lut lookup table to fill
+ * - hf code table with generated bit strings
+ * - primary_bits index bits of the primary table (1 - 10)
+ * @return OK on success, MEMORY on allocation failure, BAD_PARAM
+ *   if the primary index size is out of range, or BAD_BITS if a code
+ *   is too long
+ */
+PNGPARTS_API
+int pngparts_flate_lut_build
+  ( struct pngparts_flate_lut* lut, struct pngparts_flate_huff const* hf,
+    int primary_bits);
+/*
+ * Search by code bits, table lookup.
+ * - lut lookup table
+ * - bits upcoming bits from the stream; first bit is lsb
+ * - length receives the bit length of the code found, or the number
+ *   of bits examined if no code was found
+ * @return the value corresponding to the bit string, or BAD_BITS if
+ *   the bit string is not a complete code
+ */
+PNGPARTS_API
+int pngparts_flate_lut_get
+  (struct pngparts_flate_lut const* lut, unsigned int bits, int* length);
+
 /*
  * Load the fixed Huffman literal table into a structure.
  * - hf table to modify, should have been already resized to
@@ -1,38 +1,84 @@
-
 #include "inflate.h"
 #include <stdlib.h>
+#include <string.h>
+
+/*
+ * Input and output for a run of the inflater.
+ */
+struct pngparts_inflate_io {
+  /* input bytes */
+  unsigned char const* in;
+  /* number of input bytes */
+  int in_len;
+  /* number of input bytes used so far */
+  int in_pos;
+  /* output buffer, or NULL to use the put callback */
+  unsigned char* out;
+  /* space in the output buffer */
+  int out_len;
+  /* number of output bytes written so far */
+  int out_pos;
+  /* data to pass to put callback */
+  void* put_data;
+  /* callback for putting output bytes */
+  int(*put_cb)(void*,int);
+};
 
-static int pngparts_inflate_bit
-  (int b, struct pngparts_flate *fl, void* put_data, int(*put_cb)(void*,int));
+static int pngparts_inflate_run
+  (struct pngparts_flate *fl, struct pngparts_inflate_io* io);
+static int pngparts_inflate_refill
+  ( pngparts_flate_bits* bitline, int* bitlength,
+    struct pngparts_inflate_io* io);
+static int pngparts_inflate_put(struct pngparts_inflate_io* io, int ch);
+static int pngparts_inflate_decode
+  ( struct pngparts_flate_lut const* lut, unsigned int bitline,
+    int bitlength, int* length);
+static int pngparts_inflate_fixed_setup(struct pngparts_flate *fl);
 static int pngparts_inflate_history_fetch
-  (struct pngparts_flate *fl, void* put_data, int(*put_cb)(void*,int));
-static int pngparts_inflate_advance_dynamic(struct pngparts_flate *fl);
+  (struct pngparts_flate *fl, struct pngparts_inflate_io* io);
+static int pngparts_inflate_window_fetch
+  (struct pngparts_flate *fl, struct pngparts_inflate_io* io);
+static void pngparts_inflate_history_sync
+  (struct pngparts_flate *fl, unsigned char const* out, int len);
+static int pngparts_inflate_advance_dynamic
+  (struct pngparts_flate *fl, int* state);
 static void pngparts_inflate_dynamic_set
-  (struct pngparts_flate *fl, struct pngparts_flate_code code);
+  (struct pngparts_flate *fl, int state, struct pngparts_flate_code code);
 
 enum pngparts_inflate_last_block {
   PNGPARTS_INFLATE_STATE = 31,
   PNGPARTS_INFLATE_LAST = PNGPARTS_INFLATE_STATE+1
 };
 
+enum pngparts_inflate_lut_bits {
+  /* primary index bits for the code table */
+  PNGPARTS_INFLATE_CODE_BITS = 7,
+  /* primary index bits for the length table */
+  PNGPARTS_INFLATE_LENGTH_BITS = 9,
+  /* primary index bits for the distance table */
+  PNGPARTS_INFLATE_DISTANCE_BITS = 7
+};
+
 void pngparts_inflate_dynamic_set
-  (struct pngparts_flate *fl, struct pngparts_flate_code code)
+  (struct pngparts_flate *fl, int state, struct pngparts_flate_code code)
 {
-  if (fl->state & 1){
+  if (state & 1){
     pngparts_flate_huff_index_set(&fl->distance_table,fl->short_pos,code);
   } else {
     pngparts_flate_huff_index_set(&fl->length_table,fl->short_pos,code);
   }
 }
-int pngparts_inflate_advance_dynamic(struct pngparts_flate *fl){
+int pngparts_inflate_advance_dynamic(struct pngparts_flate *fl, int* state){
   fl->short_pos += 1;
-  if (fl->state & 1){
+  if ((*state) & 1){
     /* distance */
     if (fl->short_pos == pngparts_flate_huff_get_size(&fl->distance_table)){
       int result = pngparts_flate_huff_generate(&fl->distance_table);
       if (result != PNGPARTS_API_OK) return result;
-      pngparts_flate_huff_bit_sort(&fl->distance_table);
-      fl->state = 6;
+      result = pngparts_flate_lut_build(&fl->distance_lut,
+        &fl->distance_table, PNGPARTS_INFLATE_DISTANCE_BITS);
+      if (result != PNGPARTS_API_OK) return result;
+      *state = 6;
       fl->short_pos = 0;
     }
   } else {
@@ -40,19 +86,160 @@ int pngparts_inflate_advance_dynamic(struct pngparts_flate *fl){
     if (fl->short_pos == pngparts_flate_huff_get_size(&fl->length_table)){
       int result = pngparts_flate_huff_generate(&fl->length_table);
       if (result != PNGPARTS_API_OK) return result;
-      pngparts_flate_huff_bit_sort(&fl->length_table);
-      fl->state += 1;
+      result = pngparts_flate_lut_build(&fl->length_lut,
+        &fl->length_table, PNGPARTS_INFLATE_LENGTH_BITS);
+      if (result != PNGPARTS_API_OK) return result;
+      fl->fixed_lut_tf = 0;
+      *state += 1;
       fl->short_pos = 0;
     }
   }
   return PNGPARTS_API_OK;
 }
+int pngparts_inflate_fixed_setup(struct pngparts_flate *fl){
+  int result;
+  if (fl->fixed_lut_tf)
+    return PNGPARTS_API_OK;
+  result = pngparts_flate_huff_resize(&fl->length_table,288);
+  if (result != PNGPARTS_API_OK) return result;
+  result = pngparts_flate_huff_resize(&fl->distance_table,32);
+  if (result != PNGPARTS_API_OK) return result;
+  pngparts_flate_fixed_lengths(&fl->length_table);
+  pngparts_flate_fixed_distances(&fl->distance_table);
+  result = pngparts_flate_lut_build(&fl->length_lut,
+    &fl->length_table, PNGPARTS_INFLATE_LENGTH_BITS);
+  if (result != PNGPARTS_API_OK) return result;
+  result = pngparts_flate_lut_build(&fl->distance_lut,
+    &fl->distance_table, PNGPARTS_INFLATE_DISTANCE_BITS);
+  if (result != PNGPARTS_API_OK) return result;
+  fl->fixed_lut_tf = 1;
+  return PNGPARTS_API_OK;
+}
+int pngparts_inflate_decode
+  ( struct pngparts_flate_lut const* lut, unsigned int bitline,
+    int bitlength, int* length)
+{
+  struct pngparts_flate_lut_entry entry =
+    lut->its[bitline&((1u<<lut->primary_bits)-1u)];
+  int examined = lut->primary_bits;
+  if (entry.sub_bits > 0){
+    examined += entry.sub_bits;
+    entry = lut->its[entry.value
+      + ((bitline>>lut->primary_bits)&((1u<<entry.sub_bits)-1u))];
+  }
+  if (entry.length > 0){
+    if (entry.length > bitlength)
+      return PNGPARTS_API_NOT_FOUND;
+    *length = entry.length;
+    return entry.value;
+  } else if (examined > bitlength){
+    return PNGPARTS_API_NOT_FOUND;
+  } else return PNGPARTS_API_BAD_BITS;
+}
+int pngparts_inflate_refill
+  ( pngparts_flate_bits* bitline, int* bitlength,
+    struct pngparts_inflate_io* io)
+{
+  int const old_length = *bitlength;
+  if (*bitlength <= 56 && io->in_len-io->in_pos >= 8){
+    /* whole word at a time */
+    unsigned char const* const p = io->in+io->in_pos;
+    pngparts_flate_bits const word =
+          ((pngparts_flate_bits)p[0])
+      |  (((pngparts_flate_bits)p[1])<< 8)
+      |  (((pngparts_flate_bits)p[2])<<16)
+      |  (((pngparts_flate_bits)p[3])<<24)
+      |  (((pngparts_flate_bits)p[4])<<32)
+      |  (((pngparts_flate_bits)p[5])<<40)
+      |  (((pngparts_flate_bits)p[6])<<48)
+      |  (((pngparts_flate_bits)p[7])<<56);
+    int const count = (63-*bitlength)>>3;
+    *bitline |= (word<<*bitlength);
+    /* bits past the new length come back with the next refill */
+    io->in_pos += count;
+    *bitlength += (count<<3);
+  } else while (*bitlength <= 56 && io->in_pos < io->in_len){
+    *bitline |= ((pngparts_flate_bits)io->in[io->in_pos])<<*bitlength;
+    io->in_pos += 1;
+    *bitlength += 8;
+  }
+  return *bitlength != old_length;
+}
+int pngparts_inflate_put(struct pngparts_inflate_io* io, int ch){
+  if (io->out == NULL)
+    return (*io->put_cb)(io->put_data,ch);
+  else if (io->out_pos < io->out_len){
+    io->out[io->out_pos++] = (unsigned char)ch;
+    return PNGPARTS_API_OK;
+  } else return PNGPARTS_API_OVERFLOW;
+}
+int pngparts_inflate_window_fetch
+  (struct pngparts_flate *fl, struct pngparts_inflate_io* io)
+{
+  unsigned int const dist = fl->repeat_distance;
+  while (fl->repeat_length > 0){
+    unsigned char* const dst = io->out+io->out_pos;
+    unsigned int count = (unsigned int)(io->out_len-io->out_pos);
+    if (count == 0)
+      return PNGPARTS_API_OVERFLOW;
+    else if (count > fl->repeat_length)
+      count = fl->repeat_length;
+    if (dist > (unsigned int)io->out_pos){
+      /* older than this output: read from the history ring */
+      unsigned int i;
+      unsigned int const back = dist-(unsigned int)io->out_pos;
+      if (count > back)
+        count = back;
+      for (i = 0; i < count; ++i){
+        dst[i] = (unsigned char)pngparts_flate_history_get(fl,(int)(back-i));
+      }
+    } else if (dist >= count){
+      /* no overlap */
+      memcpy(dst, dst-dist, count);
+    } else if (dist == 1){
+      memset(dst, dst[-1], count);
+    } else {
+      /* pattern fill: copy one period, then keep doubling */
+      unsigned int done = dist;
+      memcpy(dst, dst-dist, dist);
+      while (done < count){
+        unsigned int const step = (count-done < done) ? count-done : done;
+        memcpy(dst+done, dst, step);
+        done += step;
+      }
+    }
+    io->out_pos += (int)count;
+    fl->repeat_length -= count;
+  }
+  return PNGPARTS_API_OK;
+}
+void pngparts_inflate_history_sync
+  (struct pngparts_flate *fl, unsigned char const* out, int len)
+{
+  unsigned int count = (unsigned int)len;
+  unsigned int first;
+  if (count > fl->history_size){
+    out += (count-fl->history_size);
+    count = fl->history_size;
+  }
+  first = fl->history_size-fl->history_pos;
+  if (first > count)
+    first = count;
+  memcpy(fl->history_bytes+fl->history_pos, out, first);
+  memcpy(fl->history_bytes, out+first, count-first);
+  fl->history_pos += count;
+  if (fl->history_pos >= fl->history_size)
+    fl->history_pos -= fl->history_size;
+  return;
+}
 int pngparts_inflate_history_fetch
-  (struct pngparts_flate *fl, void* put_data, int(*put_cb)(void*,int))
+  (struct pngparts_flate *fl, struct pngparts_inflate_io* io)
 {
+  if (io->out != NULL)
+    return pngparts_inflate_window_fetch(fl,io);
   while (fl->repeat_length > 0){
     int value = pngparts_flate_history_get(fl,fl->repeat_distance);
-    int result = (*put_cb)(put_data,value);
+    int result = pngparts_inflate_put(io,value);
     if (result != PNGPARTS_API_OK){
       return result;
     }
@@ -70,9 +257,17 @@ void pngparts_inflate_init(struct pngparts_flate *fl){
   pngparts_flate_huff_init(&fl->code_table);
   pngparts_flate_huff_init(&fl->length_table);
   pngparts_flate_huff_init(&fl->distance_table);
+  pngparts_flate_lut_init(&fl->code_lut);
+  pngparts_flate_lut_init(&fl->length_lut);
+  pngparts_flate_lut_init(&fl->distance_lut);
+  fl->fixed_lut_tf = 0;
   return;
 }
 void pngparts_inflate_free(struct pngparts_flate *fl){
+  pngparts_flate_lut_free(&fl->distance_lut);
+  pngparts_flate_lut_free(&fl->length_lut);
+  pngparts_flate_lut_free(&fl->code_lut);
+  fl->fixed_lut_tf = 0;
   pngparts_flate_huff_free(&fl->distance_table);
   pngparts_flate_huff_free(&fl->length_table);
   pngparts_flate_huff_free(&fl->code_table);
@@ -89,6 +284,7 @@ void pngparts_inflate_assign_api
   fcb->dict_cb = pngparts_inflate_dict;
   fcb->one_cb = pngparts_inflate_one;
   fcb->finish_cb = pngparts_inflate_finish;
+  fcb->block_cb = pngparts_inflate_block;
   return;
 }
 
@@ -101,11 +297,16 @@ int pngparts_inflate_start
   if (cinfo > 7) return PNGPARTS_API_UNSUPPORTED;
   {
     unsigned int nsize = 1u<<(cinfo+8);
-    unsigned char* ptr = (unsigned char*)malloc(nsize);
-    if (ptr == NULL) return PNGPARTS_API_MEMORY;
-    free(fl->history_bytes);
-    fl->history_bytes = ptr;
-    fl->history_size = (unsigned int)nsize;
+    if (fl->history_bytes == NULL || fl->history_size != nsize) {
+      unsigned char* ptr = (unsigned char*)malloc(nsize);
+      if (ptr == NULL) return PNGPARTS_API_MEMORY;
+      free(fl->history_bytes);
+      fl->history_bytes = ptr;
+      fl->history_size = (unsigned int)nsize;
+    } else {
+      /* keep the window from the last stream, but not its contents */
+      memset(fl->history_bytes, 0, nsize);
+    }
     fl->history_pos = 0;
     fl->bitpos = 0;
     fl->last_input_byte = -1;
@@ -120,483 +321,407 @@ int pngparts_inflate_dict(void* data, int ch){
   pngparts_flate_history_add(fl,ch);
   return PNGPARTS_API_OK;
 }
-int pngparts_inflate_bit
-  (int b, struct pngparts_flate *fl, void* put_data, int(*put_cb)(void*,int))
+int pngparts_inflate_run
+  (struct pngparts_flate *fl, struct pngparts_inflate_io* io)
 {
   int result = PNGPARTS_API_OK;
-  int bit = (b&255)?1:0;
-  int repeat_tf = b&256;
   int state = fl->state&PNGPARTS_INFLATE_STATE;
   int last_block = fl->state&PNGPARTS_INFLATE_LAST;
-  switch (state){
-  case 0: /*header*/
-    {
-      if (fl->bitlength < 3){
-        fl->bitline |= (bit<<fl->bitlength);
-        fl->bitlength += 1;
-      }
-      if (fl->bitlength >= 3){
+  /* pending input bits; first bit is lsb */
+  pngparts_flate_bits bitline = fl->bitline;
+  int bitlength = fl->bitlength;
+  int stall = 0;
+  while (result == PNGPARTS_API_OK && !stall){
+    switch (state){
+    case 0: /*header*/
+      {
+        if (bitlength < 3){
+          stall = !pngparts_inflate_refill(&bitline,&bitlength,io);
+          break;
+        }
         /* final block? */
-        if ((fl->bitline&1) == 1){
+        if ((bitline&1) == 1){
           last_block = PNGPARTS_INFLATE_LAST;
         }
-        switch (fl->bitline&6){
+        switch (bitline&6){
         case 0: /* direct */
           {
-            if (fl->bitpos == 7){
-              state = 2;
-              fl->short_pos = 0;
-            } else state = 1;/* wait until end of block */
+            /* skip to the end of the byte */
+            int const skip = (bitlength-3)&7;
+            bitline >>= (3+skip);
+            bitlength -= (3+skip);
+            state = 2;
+            fl->short_pos = 0;
           }break;
         case 2: /* text Huffman */
           {
             /* set up the text Huffman */
-            result = pngparts_flate_huff_resize(&fl->length_table,288);
-            if (result != PNGPARTS_API_OK) break;
-            result = pngparts_flate_huff_resize(&fl->distance_table,32);
+            result = pngparts_inflate_fixed_setup(fl);
             if (result != PNGPARTS_API_OK) break;
-            pngparts_flate_fixed_lengths(&fl->length_table);
-            pngparts_flate_fixed_distances(&fl->distance_table);
-            pngparts_flate_huff_bit_sort(&fl->length_table);
+            bitline >>= 3;
+            bitlength -= 3;
             /* do length,distance reading */
             state = 6;
-            fl->bitline = 0;
-            fl->bitlength = 0;
           }break;
         case 4: /* custom codes */
           {
             /* do read code tree first */
+            bitline >>= 3;
+            bitlength -= 3;
             state = 11;
-            fl->bitline = 0;
-            fl->bitlength = 0;
           }break;
         default:
           state = 5;
           result = PNGPARTS_API_BAD_BLOCK;
           break;
         }
-      }
-    }break;
-  case 1: /* direct patience */
-    {
-      /* do nothing */
-      if (fl->bitpos == 7){
-        state = 2;
-        fl->short_pos = 0;
-      }
-    }break;
-  case 2: /* direct length */
-    break;
-  case 3: /* direct characters */
-    break;
-  case 4:
-    result = PNGPARTS_API_DONE;
-    break;
-  case 5: /* NOTE reserved: bad block */
-    result = PNGPARTS_API_BAD_BLOCK;
-    break;
-  case 6: /* coded length */
-    {
-      int value;
-      if (!repeat_tf){
-        fl->bitline = (fl->bitline<<1)|bit;
-        fl->bitlength += 1;
-      }
-      value = pngparts_flate_huff_bit_bsearch
-        (&fl->length_table, fl->bitlength, fl->bitline);
-      if (value >= 0){
-        if (value == 256){/* stop code */
+      }break;
+    case 2: /* forward and reverse lengths */
+      {
+        if (bitlength < 8){
+          stall = !pngparts_inflate_refill(&bitline,&bitlength,io);
+          break;
+        }
+        if (fl->short_pos < 2){
+          fl->shortbuf[fl->short_pos++] = (unsigned char)(bitline&255);
+        } else {
+          fl->shortbuf[fl->short_pos++] = (unsigned char)((~bitline)&255);
+        }
+        bitline >>= 8;
+        bitlength -= 8;
+        if (fl->short_pos >= 4){
+          if (fl->shortbuf[0] != fl->shortbuf[2]
+          ||  fl->shortbuf[1] != fl->shortbuf[3])
+          {
+            result = PNGPARTS_API_CORRUPT_LENGTH;
+            break;
+          } else {
+            fl->block_length =
+              fl->shortbuf[0]|((unsigned int)fl->shortbuf[1]<<8);
+            if (fl->block_length > 0)
+              state = 3;
+            else state = 0;
+          }
+        }
+      }break;
+    case 3: /* direct characters */
+      {
+        int const ch = (int)(bitline&255);
+        if (bitlength == 0 && io->out != NULL){
+          /* copy straight from input to output */
+          int count = io->in_len-io->in_pos;
+          if (count > io->out_len-io->out_pos)
+            count = io->out_len-io->out_pos;
+          if ((unsigned int)count > fl->block_length)
+            count = (int)fl->block_length;
+          if (count == 0){
+            if (io->in_pos < io->in_len)
+              result = PNGPARTS_API_OVERFLOW;
+            else stall = 1;
+            break;
+          }
+          memcpy(io->out+io->out_pos, io->in+io->in_pos, count);
+          io->in_pos += count;
+          io->out_pos += count;
+          /* drop bits that belonged to skipped input */
+          bitline = 0;
+          fl->block_length -= count;
+          if (fl->block_length == 0)
+            state = 0;
+          break;
+        } else if (bitlength < 8){
+          stall = !pngparts_inflate_refill(&bitline,&bitlength,io);
+          break;
+        }
+        result = pngparts_inflate_put(io,ch);
+        if (result != PNGPARTS_API_OK)
+          break;
+        if (io->out == NULL)
+          pngparts_flate_history_add(fl,ch);
+        bitline >>= 8;
+        bitlength -= 8;
+        fl->block_length -= 1;
+        if (fl->block_length == 0)
           state = 0;
-          fl->bitlength = 0;
-          fl->bitline = 0;
+      }break;
+    case 4:
+      result = PNGPARTS_API_DONE;
+      break;
+    case 5: /* NOTE reserved: bad block */
+      result = PNGPARTS_API_BAD_BLOCK;
+      break;
+    case 6: /* coded length */
+      {
+        int length;
+        int const value = pngparts_inflate_decode
+          (&fl->length_lut, (unsigned int)bitline, bitlength, &length);
+        if (value == PNGPARTS_API_NOT_FOUND){
+          stall = !pngparts_inflate_refill(&bitline,&bitlength,io);
+        } else if (value < 0){
+          result = value;
         } else if (value < 256){/* literal */
-          result = (*put_cb)(put_data,value);
-          if (result != PNGPARTS_API_OK){
+          result = pngparts_inflate_put(io,value);
+          if (result != PNGPARTS_API_OK)
             break;
-          } else {
+          if (io->out == NULL)
             pngparts_flate_history_add(fl,value);
-          }
-          fl->bitlength = 0;
-          fl->bitline = 0;
+          bitline >>= length;
+          bitlength -= length;
+        } else if (value == 256){/* stop code */
+          bitline >>= length;
+          bitlength -= length;
+          state = 0;
         } else {/* do history stuff */
-          struct pngparts_flate_extra extra;
-          extra = pngparts_flate_length_decode(value);
+          struct pngparts_flate_extra const extra =
+            pngparts_flate_length_decode(value);
+          if (extra.length_value < 0){
+            result = PNGPARTS_API_BAD_BITS;
+            break;
+          }
+          bitline >>= length;
+          bitlength -= length;
           fl->repeat_length = extra.length_value;
-          fl->bitline = 0;
           fl->short_pos = extra.extra_bits;
-          fl->bitlength = 0;
           if (extra.extra_bits > 0){
             state = 7;
           } else state = 8;
         }
-      } else if (value == PNGPARTS_API_NOT_FOUND){
-        result = PNGPARTS_API_OK;
-      } else {
-        result = value;
-      }
-    }break;
-  case 7: /* coded length extra bits */
-    {
-      if (!repeat_tf){
-        if (fl->bitlength < fl->short_pos){
-          fl->bitline |= (bit<<fl->bitlength);
-          fl->bitlength += 1;
+      }break;
+    case 7: /* coded length extra bits */
+      {
+        if (bitlength < fl->short_pos){
+          stall = !pngparts_inflate_refill(&bitline,&bitlength,io);
+          break;
         }
-      }
-      if (fl->short_pos == fl->bitlength){
-        fl->repeat_length += fl->bitline;
-        fl->bitline = 0;
-        fl->bitlength = 0;
+        fl->repeat_length += bitline&((1u<<fl->short_pos)-1u);
+        bitline >>= fl->short_pos;
+        bitlength -= fl->short_pos;
         state = 8;
-      }
-    }break;
-  case 8: /* coded distance */
-    {
-      int value;
-      if (!repeat_tf){
-        fl->bitline = (fl->bitline<<1)|bit;
-        fl->bitlength += 1;
-      }
-      value = pngparts_flate_huff_bit_bsearch
-        (&fl->distance_table, fl->bitlength, fl->bitline);
-      if (value >= 0){
-        struct pngparts_flate_extra extra;
-        extra = pngparts_flate_distance_decode(value);
-        fl->repeat_distance = extra.length_value;
-        fl->bitline = 0;
-        fl->short_pos = extra.extra_bits;
-        fl->bitlength = 0;
-        if (extra.extra_bits > 0){
-          state = 9;
-        } else state = 10;
-        if (state == 10){
-          result = pngparts_inflate_history_fetch(fl,put_data,put_cb);
-          if (result == PNGPARTS_API_OK){
-            state = 6;
+      }break;
+    case 8: /* coded distance */
+      {
+        int length;
+        int const value = pngparts_inflate_decode
+          (&fl->distance_lut, (unsigned int)bitline, bitlength, &length);
+        if (value == PNGPARTS_API_NOT_FOUND){
+          stall = !pngparts_inflate_refill(&bitline,&bitlength,io);
+        } else if (value < 0){
+          result = value;
+        } else {
+          struct pngparts_flate_extra const extra =
+            pngparts_flate_distance_decode(value);
+          if (extra.length_value < 0){
+            result = PNGPARTS_API_BAD_BITS;
+            break;
           }
+          bitline >>= length;
+          bitlength -= length;
+          fl->repeat_distance = extra.length_value;
+          fl->short_pos = extra.extra_bits;
+          if (extra.extra_bits > 0){
+            state = 9;
+          } else state = 10;
         }
-      } else if (value == PNGPARTS_API_NOT_FOUND){
-        result = PNGPARTS_API_OK;
-      } else {
-        result = value;
-      }
-    }break;
-  case 9: /* distance extra */
-    {
-      if (!repeat_tf){
-        if (fl->bitlength < fl->short_pos){
-          fl->bitline |= (bit<<fl->bitlength);
-          fl->bitlength += 1;
+      }break;
+    case 9: /* distance extra */
+      {
+        if (bitlength < fl->short_pos){
+          stall = !pngparts_inflate_refill(&bitline,&bitlength,io);
+          break;
         }
-      }
-      if (fl->short_pos == fl->bitlength){
-        fl->repeat_distance += fl->bitline;
-        fl->bitline = 0;
-        fl->bitlength = 0;
+        fl->repeat_distance += bitline&((1u<<fl->short_pos)-1u);
+        bitline >>= fl->short_pos;
+        bitlength -= fl->short_pos;
         state = 10;
-        result = pngparts_inflate_history_fetch(fl,put_data,put_cb);
+      }break;
+    case 10: /* code history fetch */
+      {
+        result = pngparts_inflate_history_fetch(fl,io);
         if (result == PNGPARTS_API_OK){
           state = 6;
         }
-      }
-    }break;
-  case 10: /* code history fetch */
-    {
-      result = pngparts_inflate_history_fetch(fl,put_data,put_cb);
-      if (result == PNGPARTS_API_OK){
-        state = 6;
-        fl->bitlength = 0;
-        fl->bitline = 0;
-      }
-    }break;
-  case 11: /* microheader for dynamic block */
-    {
-      if (fl->bitlength < 14){
-        fl->bitline |= (bit<<fl->bitlength);
-        fl->bitlength += 1;
-      }
-      if (fl->bitlength >= 14){
+      }break;
+    case 11: /* microheader for dynamic block */
+      {
+        if (bitlength < 14){
+          stall = !pngparts_inflate_refill(&bitline,&bitlength,io);
+          break;
+        }
         result = pngparts_flate_huff_resize
-          (&fl->code_table,4+((fl->bitline>>10)&15));
-        pngparts_flate_dynamic_codes(&fl->code_table);
+          (&fl->code_table,4+((bitline>>10)&15));
         if (result != PNGPARTS_API_OK) break;
+        pngparts_flate_dynamic_codes(&fl->code_table);
         result = pngparts_flate_huff_resize
-          (&fl->distance_table,1+((fl->bitline>>5)&31));
+          (&fl->distance_table,1+((bitline>>5)&31));
         if (result != PNGPARTS_API_OK) break;
         result = pngparts_flate_huff_resize
-          (&fl->length_table,257+((fl->bitline)&31));
+          (&fl->length_table,257+((bitline)&31));
         if (result != PNGPARTS_API_OK) break;
+        bitline >>= 14;
+        bitlength -= 14;
         state = 12;
         fl->short_pos = 0;
-        fl->bitlength = 0;
-        fl->bitline = 0;
-      }
-    }break;
-  case 12: /* 3 bit integers */
-    {
-      if (fl->bitlength < 3){
-        fl->bitline |= (bit<<fl->bitlength);
-        fl->bitlength += 1;
-      }
-      if (fl->bitlength >= 3){
-        struct pngparts_flate_code code =
-          pngparts_flate_huff_index_get(&fl->code_table, fl->short_pos);
-        code.length = fl->bitline;
+      }break;
+    case 12: /* 3 bit integers */
+      {
+        struct pngparts_flate_code code;
+        if (bitlength < 3){
+          stall = !pngparts_inflate_refill(&bitline,&bitlength,io);
+          break;
+        }
+        code = pngparts_flate_huff_index_get(&fl->code_table, fl->short_pos);
+        code.length = (short)(bitline&7);
         pngparts_flate_huff_index_set(&fl->code_table, fl->short_pos, code);
+        bitline >>= 3;
+        bitlength -= 3;
         fl->short_pos += 1;
         if (fl->short_pos == pngparts_flate_huff_get_size(&fl->code_table)){
           pngparts_flate_huff_value_sort(&fl->code_table);
           result = pngparts_flate_huff_generate(&fl->code_table);
           if (result != PNGPARTS_API_OK) break;
-          pngparts_flate_huff_bit_sort(&fl->code_table);
+          result = pngparts_flate_lut_build
+            (&fl->code_lut, &fl->code_table, PNGPARTS_INFLATE_CODE_BITS);
+          if (result != PNGPARTS_API_OK) break;
           state = 14;
           fl->short_pos = 0;
           fl->shortbuf[0] = 0;
         }
-        fl->bitline = 0;
-        fl->bitlength = 0;
-      }
-    }break;
-  case 14: /* length extraction */
-  case 15: /* distance extraction */
-    {
-      int value;
-      int reset_short_pos = fl->short_pos;
-      if (!repeat_tf){
-        fl->bitline = (fl->bitline<<1)|bit;
-        fl->bitlength += 1;
-      }
-      value = pngparts_flate_huff_bit_bsearch
-        (&fl->code_table, fl->bitlength, fl->bitline);
-      if (value >= 0){
-        if (value < 16){/* literal */
+      }break;
+    case 14: /* length extraction */
+    case 15: /* distance extraction */
+      {
+        int length;
+        int const value = pngparts_inflate_decode
+          (&fl->code_lut, (unsigned int)bitline, bitlength, &length);
+        if (value == PNGPARTS_API_NOT_FOUND){
+          stall = !pngparts_inflate_refill(&bitline,&bitlength,io);
+          break;
+        } else if (value < 0){
+          result = value;
+          break;
+        } else if (value < 16){/* literal */
           struct pngparts_flate_code code;
           code.value = fl->short_pos;
-          code.length = value;
-          pngparts_inflate_dynamic_set(fl,code);
-          result = pngparts_inflate_advance_dynamic(fl);
-          if (result != PNGPARTS_API_OK){
-            fl->short_pos = reset_short_pos;
+          code.length = (short)value;
+          pngparts_inflate_dynamic_set(fl,state,code);
+          result = pngparts_inflate_advance_dynamic(fl,&state);
+          if (result != PNGPARTS_API_OK)
             break;
-          } else {
-            state = fl->state;
-          }
           fl->shortbuf[0] = (unsigned char)value;
-          fl->bitlength = 0;
-          fl->bitline = 0;
         } else if (value == 16){/* previous copy */
           state += 2;
-          fl->bitlength = 0;
-          fl->bitline = 0;
         } else if (value == 17){/* do zero stuff */
           state += 4;
-          fl->bitlength = 0;
-          fl->bitline = 0;
         } else if (value == 18){/* do zero stuff */
           state += 6;
-          fl->bitlength = 0;
-          fl->bitline = 0;
         }
-      } else if (value == PNGPARTS_API_NOT_FOUND){
-        result = PNGPARTS_API_OK;
-      } else {
-        result = value;
-      }
-    }break;
-  case 16: /* lengths: repeat value */
-  case 17: /* distances: repeat value */
-    {
-      int reset_short_pos = fl->short_pos;
-      if (!repeat_tf){
-        if (fl->bitlength < 2){
-          fl->bitline |= (bit<<fl->bitlength);
-          fl->bitlength += 1;
+        bitline >>= length;
+        bitlength -= length;
+      }break;
+    case 16: /* lengths: repeat value */
+    case 17: /* distances: repeat value */
+    case 18: /* lengths: zero value 3 bit */
+    case 19: /* distances: zero value 3 bit */
+    case 20: /* lengths: zero value 7 bit */
+    case 21: /* distances: zero value 7 bit */
+      {
+        int const kind = (state-14)>>1;
+        int const extra_bits = (kind == 1) ? 2 : ((kind == 2) ? 3 : 7);
+        int const base = (kind == 3) ? 11 : 3;
+        int count, i;
+        short const repeat_length = (kind == 1) ? fl->shortbuf[0] : 0;
+        if (bitlength < extra_bits){
+          stall = !pngparts_inflate_refill(&bitline,&bitlength,io);
+          break;
         }
-      }
-      if (fl->bitlength >= 2){
-        int i;
-        fl->bitline += 3;
-        for (i = 0; i < fl->bitline; ++i){
+        count = base + (int)(bitline&((1u<<extra_bits)-1u));
+        state -= (kind*2);
+        for (i = 0; i < count; ++i){
           struct pngparts_flate_code code;
-          code.value = fl->short_pos;
-          code.length = fl->shortbuf[0];
-          pngparts_inflate_dynamic_set(fl,code);
-          result = pngparts_inflate_advance_dynamic(fl);
-          if (result != PNGPARTS_API_OK){
-            fl->short_pos = reset_short_pos;
+          if (state == 6){
+            /* repeat runs past the last distance code */
+            result = PNGPARTS_API_BAD_CODE_LENGTH;
             break;
-          } else {
-            state = fl->state;
           }
-        }
-        if (result != PNGPARTS_API_OK) break;
-        /*fl->shortbuf[0] = (unsigned char)value;*/
-        fl->bitline = 0;
-        fl->bitlength = 0;
-        if (state != 6) state -= 2;
-      }
-    }break;
-  case 18: /* lengths: zero value 3 bit */
-  case 19: /* distances: zero value 3 bit */
-    {
-      int reset_short_pos = fl->short_pos;
-      if (!repeat_tf){
-        if (fl->bitlength < 3){
-          fl->bitline |= (bit<<fl->bitlength);
-          fl->bitlength += 1;
-        }
-      }
-      if (fl->bitlength >= 3){
-        int i;
-        fl->bitline += 3;
-        for (i = 0; i < fl->bitline; ++i){
-          struct pngparts_flate_code code;
           code.value = fl->short_pos;
-          code.length = 0;
-          pngparts_inflate_dynamic_set(fl,code);
-          result = pngparts_inflate_advance_dynamic(fl);
-          if (result != PNGPARTS_API_OK){
-            fl->short_pos = reset_short_pos;
+          code.length = repeat_length;
+          pngparts_inflate_dynamic_set(fl,state,code);
+          result = pngparts_inflate_advance_dynamic(fl,&state);
+          if (result != PNGPARTS_API_OK)
             break;
-          } else {
-            state = fl->state;
-          }
         }
         if (result != PNGPARTS_API_OK) break;
-        fl->shortbuf[0] = 0u;
-        fl->bitline = 0;
-        fl->bitlength = 0;
-        if (state != 6) state -= 4;
-      }
-    }break;
-  case 20: /* lengths: zero value 7 bit */
-  case 21: /* distances: zero value 7 bit */
-    {
-      int reset_short_pos = fl->short_pos;
-      if (!repeat_tf){
-        if (fl->bitlength < 7){
-          fl->bitline |= (bit<<fl->bitlength);
-          fl->bitlength += 1;
-        }
-      }
-      if (fl->bitlength >= 7){
-        int i;
-        fl->bitline += 11;
-        for (i = 0; i < fl->bitline; ++i){
-          struct pngparts_flate_code code;
-          code.value = fl->short_pos;
-          code.length = 0;
-          pngparts_inflate_dynamic_set(fl,code);
-          result = pngparts_inflate_advance_dynamic(fl);
-          if (result != PNGPARTS_API_OK){
-            fl->short_pos = reset_short_pos;
-            break;
-          } else {
-            state = fl->state;
-          }
-        }
-        if (result != PNGPARTS_API_OK) break;
-        fl->shortbuf[0] = 0u;
-        fl->bitline = 0;
-        fl->bitlength = 0;
-        if (state != 6) state -= 6;
-      }
-    }break;
-  default:
-    result = PNGPARTS_API_BAD_STATE;
-    break;
+        fl->shortbuf[0] = (unsigned char)repeat_length;
+        bitline >>= extra_bits;
+        bitlength -= extra_bits;
+      }break;
+    default:
+      result = PNGPARTS_API_BAD_STATE;
+      break;
+    }
+    if (state == 0 && last_block != 0){
+      result = PNGPARTS_API_DONE;
+      state = 4;
+    }
+  }
+  if (result != PNGPARTS_API_OK && io->in != NULL){
+    /* give back whole bytes not yet needed */
+    int back = bitlength>>3;
+    if (back > io->in_pos)
+      back = io->in_pos;
+    io->in_pos -= back;
+    bitlength -= (back<<3);
   }
-  if (state == 0 && last_block != 0){
-    result = PNGPARTS_API_DONE;
-    state = 4;
+  if (io->out != NULL){
+    /* the output served as the window; keep its tail for next time */
+    pngparts_inflate_history_sync(fl,io->out,io->out_pos);
   }
-  fl->state = state|last_block;
+  if (bitlength < 64)
+    bitline &= ((((pngparts_flate_bits)1u)<<bitlength)-1u);
+  fl->bitline = bitline;
+  fl->bitlength = (unsigned char)bitlength;
+  fl->state = (signed char)(state|last_block);
   return result;
 }
 int pngparts_inflate_one
   (void* data, int ch, void* put_data, int(*put_cb)(void*,int))
 {
   struct pngparts_flate *fl = (struct pngparts_flate *)data;
-  int res = PNGPARTS_API_OK;
-  int state = fl->state&PNGPARTS_INFLATE_STATE;
-  if (state >= 2 && state <= 3){
-    int last_block = fl->state&PNGPARTS_INFLATE_LAST;
-    if (ch < 0){
-      ch = fl->last_input_byte;
-    }
-    /* direct bytes mode */
-    switch (state){
-    case 2: /* forward and reverse lengths */
-      {
-        if (fl->short_pos < 2){
-          fl->shortbuf[fl->short_pos++] = ((unsigned char)(ch&255));
-        } else if (fl->short_pos < 4){
-          fl->shortbuf[fl->short_pos++] = ((unsigned char)((~ch)&255));
-        }
-        if (fl->short_pos >= 4){
-          if (fl->shortbuf[0] != fl->shortbuf[2]
-          ||  fl->shortbuf[1] != fl->shortbuf[3])
-          {
-            res = PNGPARTS_API_CORRUPT_LENGTH;
-            break;
-          } else {
-            fl->block_length =
-              fl->shortbuf[0]|((unsigned int)fl->shortbuf[1]<<8);
-            if (fl->block_length > 0)
-              state = 3;
-            else if (last_block) {
-              state = 4;
-              res = PNGPARTS_API_DONE;
-            } else {
-              state = 0;
-              fl->bitline = 0;
-              fl->bitlength = 0;
-            }
-          }
-        }
-      }break;
-    case 3:
-      {
-        if (fl->block_length > 0){
-          res = (*put_cb)(put_data,ch);
-          if (res != PNGPARTS_API_OK){
-            break;
-          } else {
-            fl->block_length -= 1;
-            pngparts_flate_history_add(fl,ch);
-          }
-        }
-        if (fl->block_length == 0){
-          if (last_block) {
-            state = 4;
-            res = PNGPARTS_API_DONE;
-          } else {
-            state = 0;
-            fl->bitline = 0;
-            fl->bitlength = 0;
-          }
-        }
-      }break;
-    }
-    fl->state = state|last_block;
-    if (res != PNGPARTS_API_OK) fl->last_input_byte = ch;
-    return res;
-  } else if (ch >= 0)
-    fl->bitpos = 0;
-  else {
-    ch = fl->last_input_byte;
-    res = pngparts_inflate_bit((ch&(1<<fl->bitpos))|256,fl,put_data,put_cb);
-    if (res != 0) return res;
-    else fl->bitpos += 1;
-  }
-  for (; fl->bitpos < 8; ++fl->bitpos){
-    res = pngparts_inflate_bit(ch&(1<<fl->bitpos),fl,put_data,put_cb);
-    if (res != 0) break;
+  struct pngparts_inflate_io io;
+  if (ch >= 0){
+    /* append the byte to the pending bits */
+    fl->bitline |= ((pngparts_flate_bits)(ch&255))<<fl->bitlength;
+    fl->bitlength += 8;
   }
-  if (fl->bitpos < 8){
-    fl->last_input_byte = ch;
-  }
-  return res;
+  io.in = NULL;
+  io.in_len = 0;
+  io.in_pos = 0;
+  io.out = NULL;
+  io.out_len = 0;
+  io.out_pos = 0;
+  io.put_data = put_data;
+  io.put_cb = put_cb;
+  return pngparts_inflate_run(fl,&io);
+}
+int pngparts_inflate_block
+  ( void* data, unsigned char const* in, int* in_len,
+    unsigned char* out, int* out_len)
+{
+  struct pngparts_flate *fl = (struct pngparts_flate *)data;
+  struct pngparts_inflate_io io;
+  int result;
+  io.in = in;
+  io.in_len = *in_len;
+  io.in_pos = 0;
+  io.out = out;
+  io.out_len = *out_len;
+  io.out_pos = 0;
+  io.put_data = NULL;
+  io.put_cb = NULL;
+  result = pngparts_inflate_run(fl,&io);
+  *in_len = io.in_pos;
+  *out_len = io.out_pos;
+  return result;
 }
 int pngparts_inflate_finish
   (void* data, void* put_data, int(*put_cb)(void*,int))
@@ -69,6 +69,21 @@ int pngparts_inflate_dict(void *fl, int ch);
 PNGPARTS_API
 int pngparts_inflate_one
   (void *fl, int ch, void* put_data, int(*put_cb)(void*,int));
+/*
+ * Block callback.
+ * - fl the flate struct to use
+ * - in input bytes
+ * - in_len number of input bytes; receives the number of bytes used
+ * - out output buffer
+ * - out_len space in the output buffer; receives the number
+ *   of bytes written
+ * @return zero if more input is needed, OVERFLOW if the output
+ *   buffer is too full, or DONE at the end of the bit stream
+ */
+PNGPARTS_API
+int pngparts_inflate_block
+  ( void *fl, unsigned char const* in, int* in_len,
+    unsigned char* out, int* out_len);
 /*
  * Finish callback.
  * - fl the flate struct to use
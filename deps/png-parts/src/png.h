@@ -26,7 +26,9 @@ struct pngparts_png_chunk_link;
 enum pngparts_png_flags {
   PNGPARTS_PNG_REPEAT_CHAR = 2,
   PNGPARTS_PNG_CHUNK_RW = 4,
-  PNGPARTS_PNG_IHDR_DONE = 8
+  PNGPARTS_PNG_IHDR_DONE = 8,
+  /* the active chunk callback takes GET_SPAN messages */
+  PNGPARTS_PNG_CHUNK_SPAN = 16
 };
 
 /*
@@ -45,6 +47,18 @@ struct pngparts_png_plte_item {
   unsigned char alpha;
 };
 
+/*
+ * Row filter kernel families.
+ */
+enum pngparts_png_simd {
+  /* portable scalar kernels */
+  PNGPARTS_PNG_SIMD_NONE = 0,
+  /* SSE2 kernels */
+  PNGPARTS_PNG_SIMD_SSE2 = 1,
+  /* AVX2 kernels */
+  PNGPARTS_PNG_SIMD_AVX2 = 2
+};
+
 /*
  * Size of an Adam7 interlace pass.
  */
@@ -68,7 +82,9 @@ enum pngparts_png_message_type {
    */
   PNGPARTS_PNG_M_PUT = 3,
   /* Start this chunk
-   * - byte nonzero in write mode, zero in read mode
+   * - byte nonzero in write mode, zero in read mode; in read mode,
+   *        the callback may set this to PNGPARTS_PNG_M_GET_SPAN
+   *        to receive the chunk in spans instead of bytes
    */
   PNGPARTS_PNG_M_START = 4,
   /* Finish this chunk
@@ -79,7 +95,16 @@ enum pngparts_png_message_type {
   /* At end of stream */
   PNGPARTS_PNG_M_ALL_DONE = 6,
   /* Destructor */
-  PNGPARTS_PNG_M_DESTROY = 7
+  PNGPARTS_PNG_M_DESTROY = 7,
+  /* Span getter (send bytes to the callback), for callbacks that
+   *   asked for it when the chunk started
+   * - ptr the next bytes in the chunk (unsigned char*), valid only
+   *        during the call
+   * - byte number of bytes at `ptr`, at least one
+   */
+  PNGPARTS_PNG_M_GET_SPAN = 8,
+  /* Get ready for another stream, keeping any memory worth keeping */
+  PNGPARTS_PNG_M_RESET = 9
 };
 /*
  * Chunk callback message.
@@ -210,6 +235,32 @@ struct pngparts_png_size pngparts_png_adam7_pass_size
 PNGPARTS_API
 int pngparts_png_paeth_predict(int left, int up, int corner);
 
+/*
+ * Find the best row filter kernels available on this processor.
+ * @return a value from enum pngparts_png_simd
+ */
+PNGPARTS_API
+int pngparts_png_simd_support(void);
+
+/*
+ * Reverse a scan line filter in place.
+ * - simd kernel family to use (enum pngparts_png_simd); families
+ *     beyond what the processor supports fall back to the best
+ *     available, and NONE selects the scalar reference kernels
+ * - filter filter code from the start of the scan line
+ * - row filtered scan line bytes, not including the filter code
+ * - prev reconstructed previous scan line of the same pass, or
+ *     all zeroes for the first line of a pass
+ * - len length of both lines in bytes
+ * - bpp distance in bytes to the corresponding byte of the
+ *     previous pixel (at least one)
+ * @return OK on success, WEIRD_FILTER for unknown filter codes
+ */
+PNGPARTS_API
+int pngparts_png_unfilter_row
+  ( int simd, int filter, unsigned char* row, unsigned char const* prev,
+    unsigned long int len, int bpp);
+
 /*
  * @return an 8-byte signature for PNG files
  */
@@ -245,6 +296,19 @@ unsigned long int pngparts_png_crc32_tol(struct pngparts_png_crc32 chk);
 PNGPARTS_API
 struct pngparts_png_crc32 pngparts_png_crc32_accum
   (struct pngparts_png_crc32 chk, int ch);
+/*
+ * Accumulate a run of bytes. Gives the same result as calling
+ *   `pngparts_png_crc32_accum` on each byte, but takes eight bytes
+ *   per step, or uses carry-less multiplication where the processor
+ *   has it.
+ * - chk the current checksum accumulator state
+ * - buf the bytes to accumulate
+ * - len number of bytes to accumulate
+ * @return the new accumulator state
+ */
+PNGPARTS_API
+struct pngparts_png_crc32 pngparts_png_crc32_update
+  (struct pngparts_png_crc32 chk, void const* buf, unsigned long int len);
 
 /*
  * Setup a read-write buffer for next use.
@@ -357,6 +421,13 @@ void pngparts_png_remove_chunk_cb
  */
 PNGPARTS_API
 void pngparts_png_drop_chunk_cbs(struct pngparts_png* p);
+/*
+ * Send a RESET message to all chunk callbacks.
+ * - p PNG structure
+ * @return OK on success, or the first error from a chunk callback
+ */
+PNGPARTS_API
+int pngparts_png_reset_chunk_cbs(struct pngparts_png* p);
 /*
  * Find a chunk callback by name.
  * - p PNG structure
@@ -23,6 +23,14 @@ static unsigned long int pngparts_pngread_get32(unsigned char const*);
  * @return a pointer to the allocation on success, NULL otherwise
  */
 static void* pngparts_pngread_calloc(unsigned long int sz);
+/*
+ * Add a span of chunk bytes from the buffer to the CRC.
+ * - p the reader
+ * - from position of the first byte to add
+ * - to position just past the last byte to add
+ */
+static void pngparts_pngread_check_span
+  (struct pngparts_png* p, int from, int to);
 
 unsigned long int pngparts_pngread_get32(unsigned char const* b) {
   return (((unsigned long int)(b[0] & 255)) << 24)
@@ -41,6 +49,15 @@ void* pngparts_pngread_calloc(unsigned long int sz){
     return NULL;
   else return calloc((size_t)sz, sizeof(unsigned char));
 }
+void pngparts_pngread_check_span
+  (struct pngparts_png* p, int from, int to)
+{
+  if (to > from) {
+    p->check = pngparts_png_crc32_update(p->check,
+      p->buf + from, (unsigned long int)(to - from));
+  }
+  return;
+}
 
 void pngparts_pngread_init(struct pngparts_png* p) {
   p->state = 0;
@@ -60,10 +77,23 @@ void pngparts_pngread_free(struct pngparts_png* p) {
   p->palette = NULL;
   return;
 }
+int pngparts_pngread_reset(struct pngparts_png* p) {
+  p->state = 0;
+  p->check = pngparts_png_crc32_new();
+  p->shortpos = 0;
+  p->last_result = 0;
+  p->flags_tf = 0;
+  p->active_chunk_cb = NULL;
+  /* keep the palette array for the next PLTE */
+  p->palette_count = 0;
+  return pngparts_png_reset_chunk_cbs(p);
+}
 int pngparts_pngread_parse(struct pngparts_png* p) {
   int result = p->last_result;
   int state = p->state;
   int shortpos = p->shortpos;
+  /* callback chunk bytes not yet added to the CRC */
+  int check_from = 0, check_to = 0;
   while (result == PNGPARTS_API_OK
     &&  (p->pos < p->size))
   {
@@ -156,6 +186,10 @@ int pngparts_pngread_parse(struct pngparts_png* p) {
               result = pngparts_png_send_chunk_msg(p, link, &message);
               if (result == PNGPARTS_API_OK) {
                 p->active_chunk_cb = link;
+                if (message.byte == PNGPARTS_PNG_M_GET_SPAN)
+                  p->flags_tf |= PNGPARTS_PNG_CHUNK_SPAN;
+                else
+                  p->flags_tf &= ~PNGPARTS_PNG_CHUNK_SPAN;
                 if (p->chunk_size > 0) state = 8;
                 else state = 9;
                 shortpos = 0;
@@ -174,8 +208,14 @@ int pngparts_pngread_parse(struct pngparts_png* p) {
     case 2: /* IEND chunk data */
       {
         if (p->chunk_size > 0 && ch >= 0) {
-          p->check = pngparts_png_crc32_accum(p->check, ch);
-          p->chunk_size -= 1;
+          /* take as much of the chunk as the buffer has at once */
+          unsigned long int n = (unsigned long int)(p->size - p->pos);
+          if (n > p->chunk_size)
+            n = p->chunk_size;
+          p->check = pngparts_png_crc32_update(p->check, p->buf + p->pos, n);
+          p->chunk_size -= n;
+          /* the last byte moves with the others below */
+          p->pos += (int)(n - 1);
         }
         if (p->chunk_size == 0) {
           state = 3;
@@ -220,8 +260,14 @@ int pngparts_pngread_parse(struct pngparts_png* p) {
     case 5: /* unknown chunk data */
       {
         if (p->chunk_size > 0 && ch >= 0) {
-          p->check = pngparts_png_crc32_accum(p->check, ch);
-          p->chunk_size -= 1;
+          /* take as much of the chunk as the buffer has at once */
+          unsigned long int n = (unsigned long int)(p->size - p->pos);
+          if (n > p->chunk_size)
+            n = p->chunk_size;
+          p->check = pngparts_png_crc32_update(p->check, p->buf + p->pos, n);
+          p->chunk_size -= n;
+          /* the last byte moves with the others below */
+          p->pos += (int)(n - 1);
         }
         if (p->chunk_size == 0) {
           state = 6;
@@ -287,18 +333,37 @@ int pngparts_pngread_parse(struct pngparts_png* p) {
         if (p->chunk_size > 0 && ch >= 0) {
           unsigned long int const chunk_size = p->chunk_size;
           struct pngparts_png_crc32 const check = p->check;
+          /* send as much of the chunk as the buffer has, or one byte */
+          unsigned long int n = 1;
+          if (p->flags_tf & PNGPARTS_PNG_CHUNK_SPAN) {
+            n = (unsigned long int)(p->size - p->pos);
+            if (n > chunk_size)
+              n = chunk_size;
+          }
           /* notify */ {
             struct pngparts_png_message message;
-            message.byte = ch;
             memcpy(message.name, p->active_chunk_cb->name,
               4 * sizeof(unsigned char));
-            message.ptr = NULL;
-            message.type = PNGPARTS_PNG_M_GET;
+            if (p->flags_tf & PNGPARTS_PNG_CHUNK_SPAN) {
+              message.byte = (int)n;
+              message.ptr = p->buf + p->pos;
+              message.type = PNGPARTS_PNG_M_GET_SPAN;
+            } else {
+              message.byte = ch;
+              message.ptr = NULL;
+              message.type = PNGPARTS_PNG_M_GET;
+            }
             result = pngparts_png_send_chunk_msg
               (p, p->active_chunk_cb, &message);
           }
-          p->check = pngparts_png_crc32_accum(check, ch);
-          p->chunk_size = chunk_size-1;
+          /* the CRC takes these bytes as a span, later */
+          if (check_from == check_to)
+            check_from = p->pos;
+          check_to = p->pos + (int)n;
+          p->check = check;
+          p->chunk_size = chunk_size-n;
+          /* the last byte moves with the others below */
+          p->pos += (int)(n - 1);
         }
         if (p->chunk_size == 0) {
           state = 9;
@@ -315,6 +380,8 @@ int pngparts_pngread_parse(struct pngparts_png* p) {
           /* check the sum */
           unsigned long int stream_chk
             = pngparts_pngread_get32(p->shortbuf);
+          pngparts_pngread_check_span(p, check_from, check_to);
+          check_from = check_to;
           if (pngparts_png_crc32_tol(p->check) != stream_chk) {
             /* notify */ {
               struct pngparts_png_message message;
@@ -361,6 +428,7 @@ int pngparts_pngread_parse(struct pngparts_png* p) {
       p->pos += 1;
     }
   }
+  pngparts_pngread_check_span(p, check_from, check_to);
   p->last_result = result;
   p->state = (short)state;
   p->shortpos = (short)shortpos;
@@ -374,193 +442,327 @@ int pngparts_pngread_parse(struct pngparts_png* p) {
 struct pngparts_pngread_idat {
   int level;
   int pixel_size;
+  /* distance in bytes between corresponding bytes of adjacent pixels */
+  int filter_size;
+  /* row filter kernel family */
+  int simd;
   unsigned long int line_width;
   unsigned long int line_height;
-  long int x;
   long int y;
   struct pngparts_api_z z;
-  /* amount of next pixel space remaining */
-  int next_left;
-  /* current and same-line previous pixel data */
-  unsigned char nextbuf[16];
-  /* previous scan line */
+  /* filter code and current scan line */
+  unsigned char *rowbuf;
+  /* filter code and previous scan line */
   unsigned char *outbuf;
+  /* scan line length in bytes, excluding the filter code */
   unsigned long int outsize;
+  /* room in each buffer for a scan line, excluding the filter code */
+  unsigned long int outcap;
+  /* amount of the current line received, including the filter code */
   unsigned long int outpos;
   int filter_mode;
+  /* nonzero once the image callback wants no more lines */
+  int halted;
   unsigned long int byte_count;
 };
 static int pngparts_pngread_start_line
   (struct pngparts_png*, struct pngparts_pngread_idat*);
 static int pngparts_pngread_idat_msg
   (struct pngparts_png*, void* cb_data, struct pngparts_png_message* msg);
-static void pngparts_pngread_idat_shift
-  (struct pngparts_pngread_idat*, int shift);
-static void pngparts_pngread_idat_add
-  (struct pngparts_pngread_idat*, int shift);
-static void pngparts_pngread_idat_submit
+/*
+ * Hand a reconstructed scan line to the image callback.
+ * - p the reader
+ * - idat IDAT state with the line in `rowbuf`
+ * @return OK, or DONE if the image callback wants no more lines
+ */
+static int pngparts_pngread_idat_submit
+  (struct pngparts_png*, struct pngparts_pngread_idat* idat);
+/*
+ * Hand the palette to the image callback, one entry at a time.
+ * - p the reader
+ */
+static void pngparts_pngread_idat_palette(struct pngparts_png* p);
+/*
+ * Widen an 8-bit sample, unless 8-bit output was requested.
+ * - put8 nonzero for 8-bit output
+ * - v the sample
+ * @return the sample for the image callback
+ */
+static unsigned int pngparts_pngread_sample8(int put8, unsigned int v);
+/*
+ * Read a big-endian 16-bit sample, reducing it with rounding
+ *   if 8-bit output was requested.
+ * - put8 nonzero for 8-bit output
+ * - px the sample bytes
+ * @return the sample for the image callback
+ */
+static unsigned int pngparts_pngread_sample16
+  (int put8, unsigned char const* px);
+/*
+ * Unfilter and submit a completed scan line, then move to the next
+ *   line or pass.
+ * - p the reader
+ * - idat IDAT state with a full line in `rowbuf`
+ * @return OK on success, WEIRD_FILTER on a bad filter code
+ */
+static int pngparts_pngread_idat_line
   (struct pngparts_png*, struct pngparts_pngread_idat* idat);
+/*
+ * Inflate part of the IDAT stream into scan lines.
+ * - p the reader
+ * - idat IDAT state
+ * - buf compressed bytes
+ * - len number of bytes in `buf`
+ * @return OK on success, or an error code
+ */
+static int pngparts_pngread_idat_input
+  (struct pngparts_png*, struct pngparts_pngread_idat* idat,
+    unsigned char* buf, int len);
 
-void pngparts_pngread_idat_submit
+unsigned int pngparts_pngread_sample8(int put8, unsigned int v) {
+  return put8 ? v : ((v << 8) | v);
+}
+unsigned int pngparts_pngread_sample16
+  (int put8, unsigned char const* px)
+{
+  unsigned long int const v = (px[0] << 8) | px[1];
+  /* v/257, rounded to nearest */
+  return put8 ? (unsigned int)((v * 255u + 32895u) >> 16) : (unsigned int)v;
+}
+void pngparts_pngread_idat_palette(struct pngparts_png* p) {
+  struct pngparts_api_image img;
+  int put8;
+  int i;
+  int const size = pngparts_png_get_plte_size(p);
+  pngparts_png_get_image_cb(p, &img);
+  if (img.put_plte_cb == NULL)
+    return;
+  put8 = (img.flags & PNGPARTS_API_IMAGE_PUT_8BIT) != 0;
+  for (i = 0; i < size; ++i) {
+    struct pngparts_png_plte_item const color =
+      pngparts_png_get_plte_item(p, i);
+    (*img.put_plte_cb)(img.cb_data, i,
+      pngparts_pngread_sample8(put8, color.red),
+      pngparts_pngread_sample8(put8, color.green),
+      pngparts_pngread_sample8(put8, color.blue),
+      pngparts_pngread_sample8(put8, color.alpha));
+  }
+  return;
+}
+int pngparts_pngread_idat_submit
   (struct pngparts_png* p, struct pngparts_pngread_idat* idat)
 {
   int const color_type = p->header.color_type;
   static const int multiplier[9] =
     { 0, 0xffff, 0x5555, 0x2492, 0x1111, 0, 0, 0, 0x0101 };
+  static const int multiplier8[9] =
+    { 0, 0xff, 0x55, 0, 0x11, 0, 0, 0, 0x01 };
+  unsigned char const* const row = idat->rowbuf + 1;
+  unsigned long int const line_width = idat->line_width;
   struct pngparts_api_image img;
+  long int nx, ny, x_step;
+  unsigned long int x;
+  int put8;
+  unsigned int opaque;
+  /* pixels to put, or NULL for all of them */
+  unsigned char const* want = NULL;
+  int by_row;
   pngparts_png_get_image_cb(p, &img);
+  /* see whether the row callback takes this color type */{
+    int const row_flags = img.flags
+      & (PNGPARTS_API_IMAGE_ROW_PALETTE | PNGPARTS_API_IMAGE_ROW_GREY);
+    if (img.put_row_cb == NULL)
+      by_row = 0;
+    else if (row_flags == 0)
+      by_row = 1;
+    else if (color_type == 3)
+      by_row = (row_flags & PNGPARTS_API_IMAGE_ROW_PALETTE) != 0;
+    else if ((color_type & 3) == 0)
+      by_row = (row_flags & PNGPARTS_API_IMAGE_ROW_GREY) != 0;
+    else
+      by_row = 0;
+  }
+  /* find where this line lands in the full image */{
+    long int next_x, next_y;
+    pngparts_png_adam7_reverse_xy(idat->level, &nx, &ny, 0, idat->y);
+    pngparts_png_adam7_reverse_xy(idat->level, &next_x, &next_y, 1, idat->y);
+    x_step = next_x - nx;
+  }
+  if (img.want_cb != NULL) {
+    switch ((*img.want_cb)(img.cb_data, idat->level, ny, nx, x_step,
+      line_width, &want))
+    {
+    case PNGPARTS_API_IMAGE_WANT_NONE:
+      return PNGPARTS_API_OK;
+    case PNGPARTS_API_IMAGE_WANT_DONE:
+      return PNGPARTS_API_DONE;
+    case PNGPARTS_API_IMAGE_WANT_SOME:
+      break;
+    default:
+      want = NULL;
+      break;
+    }
+  }
+  if (by_row) {
+    /* hand over the whole line as is */
+    (*img.put_row_cb)(img.cb_data, idat->level, ny, nx, x_step,
+      line_width, row);
+    return PNGPARTS_API_OK;
+  }
+  put8 = (img.flags & PNGPARTS_API_IMAGE_PUT_8BIT) != 0;
+  opaque = put8 ? 255 : 65535;
   switch (idat->pixel_size) {
   case 1: /* either L/1 or index/1 */
   case 2: /* either L/2 or index/2 */
   case 4: /* either L/4 or index/4 */
   case 8: /* either L/8 or index/8 */
     {
-      int i, count = 8/idat->pixel_size;
-      int mask = (1 << idat->pixel_size) - 1;
-      long int nx, ny;
-      for (i = count-1; i >= 0; --i) {
-        pngparts_png_adam7_reverse_xy(idat->level, &nx, &ny, idat->x, idat->y);
-        if (nx < p->header.width) {
-          unsigned int const bit_string =
-            (idat->nextbuf[8] >> (i*idat->pixel_size))&mask;
-          switch (color_type) {
-          case 0: /* L/i */
-            {
-              unsigned int const lumin
-                = bit_string*multiplier[idat->pixel_size];
-              (*img.put_cb)(img.cb_data, nx, ny, lumin, lumin, lumin, 65535);
-            }break;
-          case 3: /* index/i */
-            {
-              struct pngparts_png_plte_item color;
-              if (bit_string < pngparts_png_get_plte_size(p)) {
-                color = pngparts_png_get_plte_item(p, bit_string);
-                (*img.put_cb)(img.cb_data, nx, ny,
-                  (color.red << 8) | color.red,
-                  (color.green << 8) | color.green,
-                  (color.blue << 8) | color.blue,
-                  (color.alpha << 8) | color.alpha);
-              } else {
-                /* skip this pixel */
-              }
-            }break;
+      int const pixel_size = idat->pixel_size;
+      unsigned int const mask = (1u << pixel_size) - 1u;
+      unsigned int const lumin_scale =
+        put8 ? multiplier8[pixel_size] : multiplier[pixel_size];
+      for (x = 0; x < line_width; ++x, nx += x_step) {
+        unsigned long int const bit_pos = x * pixel_size;
+        unsigned int const bit_string = (row[bit_pos >> 3]
+          >> (8 - pixel_size - (int)(bit_pos & 7))) & mask;
+        if (want != NULL && !want[x])
+          continue;
+        if (color_type == 3) { /* index/i */
+          struct pngparts_png_plte_item color;
+          if (bit_string < (unsigned int)pngparts_png_get_plte_size(p)) {
+            color = pngparts_png_get_plte_item(p, bit_string);
+            (*img.put_cb)(img.cb_data, nx, ny,
+              pngparts_pngread_sample8(put8, color.red),
+              pngparts_pngread_sample8(put8, color.green),
+              pngparts_pngread_sample8(put8, color.blue),
+              pngparts_pngread_sample8(put8, color.alpha));
+          } else {
+            /* skip this pixel */
           }
-          idat->x += 1;
+        } else { /* L/i */
+          unsigned int const lumin = bit_string*lumin_scale;
+          (*img.put_cb)(img.cb_data, nx, ny, lumin, lumin, lumin, opaque);
         }
       }
-      pngparts_pngread_idat_add(idat, 1);
-      pngparts_pngread_idat_shift(idat, 1);
     }break;
   case 16: /* either L/16, LA/8 */
     {
-      long int nx, ny;
-      pngparts_png_adam7_reverse_xy(idat->level, &nx, &ny, idat->x, idat->y);
-      if (nx < p->header.width) {
-        switch (color_type) {
-        case 0: /* L/16 */
-          {
-            unsigned int lumin;
-            lumin = (idat->nextbuf[8] << 8) | (idat->nextbuf[9]);
-            (*img.put_cb)(img.cb_data, nx, ny, lumin, lumin, lumin, 65535);
-          }break;
-        case 4: /* LA/8 */
-          {
-            unsigned int lumin, alpha;
-            lumin = (idat->nextbuf[8] << 8) | (idat->nextbuf[8]);
-            alpha = (idat->nextbuf[9] << 8) | (idat->nextbuf[9]);
-            (*img.put_cb)(img.cb_data, nx, ny, lumin, lumin, lumin, alpha);
-          }break;
+      unsigned char const* px = row;
+      for (x = 0; x < line_width; ++x, nx += x_step, px += 2) {
+        if (want != NULL && !want[x])
+          continue;
+        if (color_type == 4) { /* LA/8 */
+          unsigned int const lumin = pngparts_pngread_sample8(put8, px[0]);
+          unsigned int const alpha = pngparts_pngread_sample8(put8, px[1]);
+          (*img.put_cb)(img.cb_data, nx, ny, lumin, lumin, lumin, alpha);
+        } else { /* L/16 */
+          unsigned int const lumin = pngparts_pngread_sample16(put8, px);
+          (*img.put_cb)(img.cb_data, nx, ny, lumin, lumin, lumin, opaque);
         }
       }
-      pngparts_pngread_idat_add(idat, 2);
-      pngparts_pngread_idat_shift(idat, 2);
-      idat->x += 1;
     }break;
   case 24: /* either RGB/8 */
     {
-      long int nx, ny;
-      pngparts_png_adam7_reverse_xy(idat->level, &nx, &ny, idat->x, idat->y);
-      if (nx < p->header.width) {
-        unsigned int red, green, blue;
-        red = (idat->nextbuf[8] << 8) | (idat->nextbuf[8]);
-        green = (idat->nextbuf[9] << 8) | (idat->nextbuf[9]);
-        blue = (idat->nextbuf[10] << 8) | (idat->nextbuf[10]);
-        (*img.put_cb)(img.cb_data, nx, ny, red, green, blue, 65535);
+      unsigned char const* px = row;
+      for (x = 0; x < line_width; ++x, nx += x_step, px += 3) {
+        unsigned int const red = pngparts_pngread_sample8(put8, px[0]);
+        unsigned int const green = pngparts_pngread_sample8(put8, px[1]);
+        unsigned int const blue = pngparts_pngread_sample8(put8, px[2]);
+        if (want != NULL && !want[x])
+          continue;
+        (*img.put_cb)(img.cb_data, nx, ny, red, green, blue, opaque);
       }
-      pngparts_pngread_idat_add(idat, 3);
-      pngparts_pngread_idat_shift(idat, 3);
-      idat->x += 1;
     }break;
   case 32: /* either LA/16 or RGBA/8 */
     {
-      long int nx, ny;
-      pngparts_png_adam7_reverse_xy(idat->level, &nx, &ny, idat->x, idat->y);
-      if (nx < p->header.width) {
-        switch (color_type) {
-        case 4: /* LA/16 */
-          {
-            unsigned int lumin, alpha;
-            lumin = (idat->nextbuf[8] << 8) | (idat->nextbuf[9]);
-            alpha = (idat->nextbuf[10] << 8) | (idat->nextbuf[11]);
-            (*img.put_cb)(img.cb_data, nx, ny, lumin, lumin, lumin, alpha);
-          }break;
-        case 6: /* RGBA/8 */
-          {
-            unsigned int red, green, blue, alpha;
-            red = (idat->nextbuf[8] << 8) | (idat->nextbuf[8]);
-            green = (idat->nextbuf[9] << 8) | (idat->nextbuf[9]);
-            blue = (idat->nextbuf[10] << 8) | (idat->nextbuf[10]);
-            alpha = (idat->nextbuf[11] << 8) | (idat->nextbuf[11]);
-            (*img.put_cb)(img.cb_data, nx, ny, red, green, blue, alpha);
-          }break;
+      unsigned char const* px = row;
+      for (x = 0; x < line_width; ++x, nx += x_step, px += 4) {
+        if (want != NULL && !want[x])
+          continue;
+        if (color_type == 4) { /* LA/16 */
+          unsigned int const lumin = pngparts_pngread_sample16(put8, px+0);
+          unsigned int const alpha = pngparts_pngread_sample16(put8, px+2);
+          (*img.put_cb)(img.cb_data, nx, ny, lumin, lumin, lumin, alpha);
+        } else { /* RGBA/8 */
+          unsigned int const red = pngparts_pngread_sample8(put8, px[0]);
+          unsigned int const green = pngparts_pngread_sample8(put8, px[1]);
+          unsigned int const blue = pngparts_pngread_sample8(put8, px[2]);
+          unsigned int const alpha = pngparts_pngread_sample8(put8, px[3]);
+          (*img.put_cb)(img.cb_data, nx, ny, red, green, blue, alpha);
         }
       }
-      pngparts_pngread_idat_add(idat, 4);
-      pngparts_pngread_idat_shift(idat, 4);
-      idat->x += 1;
     }break;
   case 48: /* only RGB/16 */
     {
-      long int nx, ny;
-      pngparts_png_adam7_reverse_xy(idat->level, &nx, &ny, idat->x, idat->y);
-      if (nx < p->header.width) {
-        unsigned int red, green, blue;
-        red   = (idat->nextbuf[ 8] << 8) | (idat->nextbuf[ 9]);
-        green = (idat->nextbuf[10] << 8) | (idat->nextbuf[11]);
-        blue  = (idat->nextbuf[12] << 8) | (idat->nextbuf[13]);
-        (*img.put_cb)(img.cb_data, nx, ny, red, green, blue, 65535);
+      unsigned char const* px = row;
+      for (x = 0; x < line_width; ++x, nx += x_step, px += 6) {
+        unsigned int const red   = pngparts_pngread_sample16(put8, px+0);
+        unsigned int const green = pngparts_pngread_sample16(put8, px+2);
+        unsigned int const blue  = pngparts_pngread_sample16(put8, px+4);
+        if (want != NULL && !want[x])
+          continue;
+        (*img.put_cb)(img.cb_data, nx, ny, red, green, blue, opaque);
       }
-      pngparts_pngread_idat_add(idat, 6);
-      pngparts_pngread_idat_shift(idat, 6);
-      idat->x += 1;
     }break;
   case 64: /* only RGBA/16 */
     {
-      long int nx, ny;
-      pngparts_png_adam7_reverse_xy(idat->level, &nx, &ny, idat->x, idat->y);
-      if (nx < p->header.width) {
-        unsigned int red, green, blue, alpha;
-        red  = (idat->nextbuf[ 8] << 8) | (idat->nextbuf[ 9]);
-        green= (idat->nextbuf[10] << 8) | (idat->nextbuf[11]);
-        blue = (idat->nextbuf[12] << 8) | (idat->nextbuf[13]);
-        alpha= (idat->nextbuf[14] << 8) | (idat->nextbuf[15]);
+      unsigned char const* px = row;
+      for (x = 0; x < line_width; ++x, nx += x_step, px += 8) {
+        unsigned int const red   = pngparts_pngread_sample16(put8, px+0);
+        unsigned int const green = pngparts_pngread_sample16(put8, px+2);
+        unsigned int const blue  = pngparts_pngread_sample16(put8, px+4);
+        unsigned int const alpha = pngparts_pngread_sample16(put8, px+6);
+        if (want != NULL && !want[x])
+          continue;
         (*img.put_cb)(img.cb_data, nx, ny, red, green, blue, alpha);
       }
-      pngparts_pngread_idat_add(idat, 8);
-      pngparts_pngread_idat_shift(idat, 8);
-      idat->x += 1;
     }break;
   }
+  return PNGPARTS_API_OK;
 }
-void pngparts_pngread_idat_shift(struct pngparts_pngread_idat* d, int shift) {
-  d->next_left += shift;
-  memmove(d->nextbuf, d->nextbuf + shift, 16 - shift);
-}
-void pngparts_pngread_idat_add(struct pngparts_pngread_idat* d, int shift) {
-  if (d->outpos >= shift) {
-    memcpy(d->outbuf + d->outpos - shift, d->nextbuf + 8 - shift, shift);
+int pngparts_pngread_idat_line
+  (struct pngparts_png* p, struct pngparts_pngread_idat* idat)
+{
+  int const filter_result = pngparts_png_unfilter_row(idat->simd,
+    idat->rowbuf[0], idat->rowbuf + 1, idat->outbuf + 1,
+    idat->outsize, idat->filter_size);
+  if (filter_result != PNGPARTS_API_OK)
+    return filter_result;
+  if (pngparts_pngread_idat_submit(p, idat) == PNGPARTS_API_DONE) {
+    /* nothing more is wanted, so stop inflating */
+    idat->filter_mode = 5;
+    idat->halted = 1;
+    return PNGPARTS_API_OK;
+  }
+  /* the reconstructed line becomes the previous line */{
+    unsigned char* const swap = idat->outbuf;
+    idat->outbuf = idat->rowbuf;
+    idat->rowbuf = swap;
+  }
+  idat->outpos = 0;
+  idat->y += 1;
+  if (idat->y >= (long int)idat->line_height) {
+    /* continue to next phase */
+    if (idat->level == 0 || idat->level == 7) {
+      /* cease translation */
+      idat->filter_mode = 5;
+    } else {
+      int level_result;
+      idat->y = 0;
+      do {
+        idat->level += 1;
+        level_result =
+          pngparts_pngread_start_line(p, idat);
+        if (level_result != PNGPARTS_API_OVERFLOW) break;
+      } while (idat->level < 7);
+      if (level_result == PNGPARTS_API_OVERFLOW) {
+        idat->filter_mode = 5;
+      } else if (level_result != PNGPARTS_API_OK) {
+        return level_result;
+      }
+    }
   }
-  d->outpos += shift;
+  return PNGPARTS_API_OK;
 }
 int pngparts_pngread_start_line
   (struct pngparts_png* p, struct pngparts_pngread_idat* idat)
@@ -581,32 +783,105 @@ int pngparts_pngread_start_line
       return PNGPARTS_API_OVERFLOW;
     }
     if (idat->pixel_size == 0
-    ||  idat->line_width >= ULONG_MAX/idat->pixel_size)
+    ||  idat->line_width >= (ULONG_MAX-8)/idat->pixel_size)
     {
       return PNGPARTS_API_TOO_WIDE;
     }
     line_length = idat->line_width*idat->pixel_size;
     buffer_length = (line_length + 7) >> 3;
   }
-  if (idat->outsize != buffer_length) {
-    /* resize the buffer */
+  if (idat->outcap < buffer_length) {
+    /* resize the buffers, with room for the filter code */
     unsigned char* new_buffer;
     free(idat->outbuf);
+    free(idat->rowbuf);
     idat->outbuf = NULL;
-    new_buffer = (unsigned char*)pngparts_pngread_calloc(buffer_length);
+    idat->rowbuf = NULL;
+    idat->outsize = 0;
+    idat->outcap = 0;
+    new_buffer = (unsigned char*)pngparts_pngread_calloc(buffer_length+1);
     if (new_buffer == NULL) {
       return PNGPARTS_API_MEMORY;
     }
     idat->outbuf = new_buffer;
+    new_buffer = (unsigned char*)pngparts_pngread_calloc(buffer_length+1);
+    if (new_buffer == NULL) {
+      return PNGPARTS_API_MEMORY;
+    }
+    idat->rowbuf = new_buffer;
     idat->outsize = buffer_length;
+    idat->outcap = buffer_length;
   } else {
-    memset(idat->outbuf, 0, idat->outsize * sizeof(unsigned char));
+    /* reuse the buffers, as for smaller passes and later images */
+    idat->outsize = buffer_length;
+    memset(idat->outbuf, 0, (idat->outsize+1) * sizeof(unsigned char));
   }
-  memset(idat->nextbuf, 0, 8*sizeof(unsigned char));
   idat->outpos = 0;
   idat->filter_mode = -1;
   return PNGPARTS_API_OK;
 }
+int pngparts_pngread_idat_input
+  (struct pngparts_png* p, struct pngparts_pngread_idat* idat,
+    unsigned char* buf, int len)
+{
+  int result;
+  int z_result;
+  /* landing space for anything past the last scan line */
+  unsigned char discard[16];
+  if (idat->halted)
+    return PNGPARTS_API_OK;
+  (*idat->z.set_input_cb)(idat->z.cb_data, buf, len);
+  do {
+    unsigned long int out_left;
+    unsigned char* out;
+    int byte_count;
+    if (idat->filter_mode == -1) {
+      /* inflate straight into the line */
+      out = idat->rowbuf + idat->outpos;
+      out_left = idat->outsize + 1 - idat->outpos;
+      if (out_left > INT_MAX)
+        out_left = INT_MAX;
+    } else {
+      out = discard;
+      out_left = sizeof(discard);
+    }
+    (*idat->z.set_output_cb)(idat->z.cb_data, out, (int)out_left);
+    z_result = (*idat->z.churn_cb)
+      (idat->z.cb_data, PNGPARTS_API_Z_NORMAL);
+    /* a span can finish a line and fail the stream in one churn,
+     * so keep the output either way */
+    byte_count = (*idat->z.output_left_cb)(idat->z.cb_data);
+    idat->byte_count += byte_count;
+    if (idat->filter_mode == -1) {
+      idat->outpos += byte_count;
+      if (idat->outpos > idat->outsize) {
+        /* line complete */
+        int const line_result = pngparts_pngread_idat_line(p, idat);
+        if (z_result < 0) {
+          /* the zlib stream is corrupted; give up and */break;
+        } else if (line_result != PNGPARTS_API_OK) {
+          z_result = line_result;
+          /* the scanline stream is broken, so */break;
+        } else if (idat->halted) {
+          z_result = PNGPARTS_API_OK;
+          break;
+        }
+      }
+    }
+    if (z_result < 0){
+      /* the zlib stream is corrupted; give up and */break;
+    }
+  } while (z_result == PNGPARTS_API_OVERFLOW);
+  result = z_result;
+  if (result == PNGPARTS_API_DONE) {
+    /* last chance check */
+    if (idat->filter_mode == 5)
+      result = PNGPARTS_API_OK;
+    else
+      result = PNGPARTS_API_SHORT_IDAT;
+  }
+  return result;
+}
 int pngparts_pngread_idat_msg
   (struct pngparts_png* p, void* cb_data, struct pngparts_png_message* msg)
 {
@@ -620,6 +895,8 @@ int pngparts_pngread_idat_msg
     }break;
   case PNGPARTS_PNG_M_START:
     {
+      /* take the stream in spans */
+      msg->byte = PNGPARTS_PNG_M_GET_SPAN;
       if (idat->level == -1) {
         idat->byte_count = 0;
         /* get level */
@@ -649,192 +926,35 @@ int pngparts_pngread_idat_msg
             idat->pixel_size = p->header.bit_depth * 4;
             break;
           }
+          idat->filter_size = (idat->pixel_size + 7) / 8;
         }
+        idat->simd = pngparts_png_simd_support();
+        idat->y = 0;
+        if (p->header.color_type == 3)
+          pngparts_pngread_idat_palette(p);
         /* prepare the line */{
           int line_out = pngparts_pngread_start_line(p, idat);
           if (line_out == PNGPARTS_API_OVERFLOW) {
             /* give up */
             idat->filter_mode = 5;
             break;
-          } else if (line_out == PNGPARTS_API_MEMORY){
-            result = PNGPARTS_API_MEMORY;
+          } else if (line_out != PNGPARTS_API_OK){
+            result = line_out;
             break;
           }
         }
-        idat->filter_mode = -1;
-        idat->next_left = 8;
-        idat->x = 0;
-        idat->y = 0;
       } else result = PNGPARTS_API_OK;
     }break;
   case PNGPARTS_PNG_M_GET:
     {
-      int z_result;
-      int gold = 0;/* continuation flag */
       unsigned char inbuf[1];
-      int const pixel_byte_size = ((idat->pixel_size + 7) / 8);
-      int const pixel_left = 8 - pixel_byte_size;
       inbuf[0] = (unsigned char)(msg->byte & 255);
-      /*fprintf(stderr, "x+%2x\n", inbuf[0]);*/
-      (*idat->z.set_input_cb)(idat->z.cb_data, inbuf, 1);
-      do {
-        gold = 0;
-        if (idat->next_left > 0) {
-          (*idat->z.set_output_cb)(idat->z.cb_data,
-            idat->nextbuf + 16 - idat->next_left, idat->next_left);
-          z_result = (*idat->z.churn_cb)
-            (idat->z.cb_data, PNGPARTS_API_Z_NORMAL);
-          if (z_result < 0){
-            /* the zlib stream is corrupted; give up and */break;
-          }
-        } else z_result = PNGPARTS_API_OK;
-        /* report bytes */ {
-          unsigned int byte_count = (*idat->z.output_left_cb)(idat->z.cb_data);
-          idat->byte_count += byte_count;
-          /* print bytes *//*{
-            fprintf(stderr, "\tbytes: [");
-            unsigned int bi;
-            unsigned char*const report_buf =
-              idat->nextbuf + 16 - idat->next_left;
-            for (bi = 0; bi < byte_count; ++bi) {
-              fprintf(stderr, "%s%2x", bi ? ", " : "", report_buf[bi]);
-            }
-            fprintf(stderr, "]\n");
-          }*/
-          idat->next_left -= byte_count;
-        }
-        switch (idat->filter_mode) {
-        case -1: /* filter search */
-          {
-            if (idat->next_left <= 7) {
-              /* filter code available */
-              int const filter_code = idat->nextbuf[8];
-              pngparts_pngread_idat_shift(idat, 1);
-              memset(idat->nextbuf, 0, 8 * sizeof(unsigned char));
-              if (filter_code > 4) {
-                z_result = PNGPARTS_API_WEIRD_FILTER;
-                break;
-              }
-              /*fprintf(stderr, "line %3li: filter %i\n",
-                idat->y, filter_code);*/
-              idat->filter_mode = filter_code;
-              gold = 1;
-            }
-          }break;
-        case 0:
-          {
-            if (idat->next_left <= pixel_left) {
-              /* null filter */
-              pngparts_pngread_idat_submit(p,idat);
-              gold = 1;
-            }
-          }break;
-        case 1:
-          {
-            if (idat->next_left <= pixel_left) {
-              /* subtraction filter */
-              int i;
-              for (i = 0; i < pixel_byte_size; ++i) {
-                idat->nextbuf[8 + i] = (idat->nextbuf[8 + i]
-                  + idat->nextbuf[pixel_left + i]) & 255;
-              }
-              pngparts_pngread_idat_submit(p, idat);
-              gold = 1;
-            }
-          }break;
-        case 2:
-          {
-            if (idat->next_left <= pixel_left) {
-              /* up filter */
-              int i;
-              for (i = 0; i < pixel_byte_size; ++i) {
-                idat->nextbuf[8 + i] = (idat->nextbuf[8 + i]
-                  + idat->outbuf[idat->outpos + i]) & 255;
-              }
-              pngparts_pngread_idat_submit(p, idat);
-              gold = 1;
-            }
-          }break;
-        case 3:
-          {
-            if (idat->next_left <= pixel_left) {
-              /* average filter */
-              int i;
-              for (i = 0; i < pixel_byte_size; ++i) {
-                unsigned int average = idat->outbuf[idat->outpos + i];
-                average += idat->nextbuf[pixel_left + i];
-                idat->nextbuf[8 + i] =
-                  (idat->nextbuf[8+i]+(average >> 1))&255;
-              }
-              pngparts_pngread_idat_submit(p, idat);
-              gold = 1;
-            }
-          }break;
-        case 4:
-          {
-            if (idat->next_left <= pixel_left) {
-              /* Paeth filter */
-              int i;
-              for (i = 0; i < pixel_byte_size; ++i) {
-                int const corner_byte = (idat->outpos >= pixel_byte_size)
-                  ? idat->outbuf[idat->outpos - pixel_byte_size + i]
-                  : 0;
-                idat->nextbuf[8 + i] = (pngparts_png_paeth_predict
-                  ( idat->nextbuf[pixel_left + i],
-                    idat->outbuf[idat->outpos + i],
-                    corner_byte) + idat->nextbuf[8 + i]) & 255;
-              }
-              pngparts_pngread_idat_submit(p, idat);
-              gold = 1;
-            }
-          }break;
-        case 5:
-          {
-            /* done */
-          }break;
-        }
-        if (z_result == PNGPARTS_API_WEIRD_FILTER){
-          /* the scanline stream is broken, so */break;
-        }
-        if (idat->x >= idat->line_width) {
-          pngparts_pngread_idat_add(idat, pixel_byte_size);
-          idat->x = 0;
-          idat->y += 1;
-          idat->outpos = 0;
-          memset(idat->nextbuf, 0, 8*sizeof(unsigned char));
-          idat->filter_mode = -1;
-        }
-        if (idat->y >= idat->line_height) {
-          /* continue to next phase */
-          if (idat->level == 0 || idat->level == 7) {
-            /* cease translation */
-            idat->filter_mode = 5;
-          } else {
-            int level_result;
-            idat->x = 0;
-            idat->y = 0;
-            idat->filter_mode = -1;
-            do {
-              idat->level += 1;
-              level_result =
-                pngparts_pngread_start_line(p, idat);
-              if (level_result != PNGPARTS_API_OVERFLOW) break;
-            } while (idat->level <= 7);
-            if (level_result == PNGPARTS_API_OVERFLOW) {
-              idat->filter_mode = 5;
-            }
-          }
-        }
-      } while (z_result == PNGPARTS_API_OVERFLOW || gold);
-      result = z_result;
-      /*fprintf(stderr, "byte count: %lu\n", idat->byte_count);*/
-      if (result == PNGPARTS_API_DONE) {
-        /* last chance check */
-        if (idat->filter_mode == 5)
-          result = PNGPARTS_API_OK;
-        else
-          result = PNGPARTS_API_SHORT_IDAT;
-      }
+      result = pngparts_pngread_idat_input(p, idat, inbuf, 1);
+    }break;
+  case PNGPARTS_PNG_M_GET_SPAN:
+    {
+      result = pngparts_pngread_idat_input
+        (p, idat, (unsigned char*)msg->ptr, msg->byte);
     }break;
   case PNGPARTS_PNG_M_FINISH:
     {
@@ -847,9 +967,19 @@ int pngparts_pngread_idat_msg
       else
         result = PNGPARTS_API_SHORT_IDAT;
     }break;
+  case PNGPARTS_PNG_M_RESET:
+    {
+      /* keep the scan line buffers for the next image */
+      idat->level = -1;
+      idat->outpos = 0;
+      idat->filter_mode = -2;
+      idat->halted = 0;
+      result = PNGPARTS_API_OK;
+    }break;
   case PNGPARTS_PNG_M_DESTROY:
     {
       free(idat->outbuf);
+      free(idat->rowbuf);
       free(idat);
       result = PNGPARTS_API_OK;
     }break;
@@ -871,10 +1001,13 @@ int pngparts_pngread_assign_idat_api
     memcpy(cb->name, name, 4 * sizeof(unsigned char));
     memcpy(&ptr->z, z, sizeof(*z));
     ptr->level = -1;
+    ptr->rowbuf = NULL;
     ptr->outbuf = NULL;
     ptr->outsize = 0;
+    ptr->outcap = 0;
     ptr->outpos = 0;
     ptr->filter_mode = -2;
+    ptr->halted = 0;
     cb->cb_data = ptr;
     cb->message_cb = pngparts_pngread_idat_msg;
     return PNGPARTS_API_OK;
@@ -892,6 +1025,44 @@ struct pngparts_pngread_plte {
   int done;
   struct pngparts_png_plte_item color;
 };
+/*
+ * Take the next byte of the palette.
+ * - p the reader
+ * - plte PLTE state
+ * - byte the byte
+ */
+static void pngparts_pngread_plte_put
+  (struct pngparts_png* p, struct pngparts_pngread_plte* plte, int byte);
+
+void pngparts_pngread_plte_put
+  (struct pngparts_png* p, struct pngparts_pngread_plte* plte, int byte)
+{
+  switch (plte->sample) {
+  case 0:
+    plte->color.red = (unsigned char)(byte);
+    plte->sample += 1;
+    break;
+  case 1:
+    plte->color.green = (unsigned char)(byte);
+    plte->sample += 1;
+    break;
+  case 2:
+    plte->color.blue = (unsigned char)(byte);
+    /* set the color to the palette */ {
+      pngparts_png_set_plte_item(p, plte->pos, plte->color);
+    }
+    plte->sample = 0;
+    plte->pos += 1;
+    if (plte->pos >= pngparts_png_get_plte_size(p)) {
+      plte->sample = 4;
+    }
+    break;
+  case 4:
+    /* unused */
+    break;
+  }
+  return;
+}
 int pngparts_pngread_plte_msg
   (struct pngparts_png* p, void* cb_data, struct pngparts_png_message* msg)
 {
@@ -919,33 +1090,20 @@ int pngparts_pngread_plte_msg
       plte->pos = 0;
       plte->sample = 0;
       plte->color.alpha = 255;
+      /* take the palette in spans */
+      msg->byte = PNGPARTS_PNG_M_GET_SPAN;
     }break;
   case PNGPARTS_PNG_M_GET:
     {
-      switch (plte->sample) {
-      case 0:
-        plte->color.red = (unsigned char)(msg->byte);
-        plte->sample += 1;
-        break;
-      case 1:
-        plte->color.green = (unsigned char)(msg->byte);
-        plte->sample += 1;
-        break;
-      case 2:
-        plte->color.blue = (unsigned char)(msg->byte);
-        /* set the color to the palette */ {
-          pngparts_png_set_plte_item(p, plte->pos, plte->color);
-        }
-        plte->sample = 0;
-        plte->pos += 1;
-        if (plte->pos >= pngparts_png_get_plte_size(p)) {
-          plte->sample = 4;
-        }
-        break;
-      case 4:
-        /* unused */
-        break;
-      }
+      pngparts_pngread_plte_put(p, plte, msg->byte);
+      result = PNGPARTS_API_OK;
+    }break;
+  case PNGPARTS_PNG_M_GET_SPAN:
+    {
+      unsigned char const* bytes = (unsigned char const*)msg->ptr;
+      int i;
+      for (i = 0; i < msg->byte; ++i)
+        pngparts_pngread_plte_put(p, plte, bytes[i]);
       result = PNGPARTS_API_OK;
     }break;
   case PNGPARTS_PNG_M_FINISH:
@@ -956,6 +1114,13 @@ int pngparts_pngread_plte_msg
     {
       result = PNGPARTS_API_OK;
     }break;
+  case PNGPARTS_PNG_M_RESET:
+    {
+      plte->pos = -1;
+      plte->sample = 0;
+      plte->done = 0;
+      result = PNGPARTS_API_OK;
+    }break;
   case PNGPARTS_PNG_M_DESTROY:
     {
       free(plte);
@@ -31,6 +31,15 @@ void pngparts_pngread_init(struct pngparts_png* p);
  */
 PNGPARTS_API
 void pngparts_pngread_free(struct pngparts_png* p);
+/*
+ * Prepare a reader for another PNG stream, keeping its chunk
+ *   callbacks and palette storage.
+ * - p the reader to reset; any registered chunks receive the
+ *     RESET message at this point
+ * @return OK on success, or the first error from a chunk callback
+ */
+PNGPARTS_API
+int pngparts_pngread_reset(struct pngparts_png* p);
 /*
  * Process the active buffer.
  * - p the reader to use
@@ -45,6 +45,15 @@ static void* pngparts_pngwrite_calloc(unsigned long int sz);
 
 static int pngparts_pngwrite_signal_finish(struct pngparts_png* p);
 
+/*
+ * Add a span of chunk bytes from the buffer to the CRC.
+ * - p the png writer state structure
+ * - from position of the first byte to add
+ * - to position just past the last byte to add
+ */
+static void pngparts_pngwrite_check_span
+  (struct pngparts_png* p, int from, int to);
+
 /*
  * Start a new interlace section.
  * - p the png writer state structure
@@ -164,6 +173,8 @@ int pngparts_pngwrite_generate(struct pngparts_png* w){
   int result = w->last_result;
   int state = w->state;
   int shortpos = w->shortpos;
+  /* chunk bytes written but not yet added to the CRC */
+  int check_from = 0, check_to = 0;
   while (result == PNGPARTS_API_OK
     &&  (w->pos < w->size))
   {
@@ -309,7 +320,10 @@ int pngparts_pngwrite_generate(struct pngparts_png* w){
         } else {
           ch = 0;
         }
-        w->check = pngparts_png_crc32_accum(w->check, ch);
+        /* the CRC takes these bytes as a span, later */
+        if (check_from == check_to)
+          check_from = w->pos;
+        check_to = w->pos + 1;
         w->chunk_size -= 1;
       }
       if (w->chunk_size == 0){
@@ -327,8 +341,10 @@ int pngparts_pngwrite_generate(struct pngparts_png* w){
     case 3: /* IEND CRC */
     case 6: /* unknown CRC */
       if (shortpos == 0){
-        unsigned long int const final_check =
-          pngparts_png_crc32_tol(w->check);
+        unsigned long int final_check;
+        pngparts_pngwrite_check_span(w, check_from, check_to);
+        check_from = check_to;
+        final_check = pngparts_png_crc32_tol(w->check);
         pngparts_pngwrite_put32(w->shortbuf+0, final_check);
       }
       if (shortpos < 4){
@@ -426,11 +442,21 @@ int pngparts_pngwrite_generate(struct pngparts_png* w){
       w->pos += 1;
     }
   }
+  pngparts_pngwrite_check_span(w, check_from, check_to);
   w->last_result = result;
   w->state = (short)state;
   w->shortpos = (short)shortpos;
   return result;
 }
+void pngparts_pngwrite_check_span
+  (struct pngparts_png* p, int from, int to)
+{
+  if (to > from) {
+    p->check = pngparts_png_crc32_update(p->check,
+      p->buf + from, (unsigned long int)(to - from));
+  }
+  return;
+}
 
 /*BEGIN IDAT*/
 struct pngparts_pngwrite_idat {
@@ -11,6 +11,60 @@
 #include "z.h"
 #include <string.h>
 
+#if (defined PNGPARTS_PNG_NO_SIMD)
+#  define PNGPARTS_Z_SIMD_X86 0
+#elif (defined __GNUC__) && ((defined __x86_64__) || (defined __i386__))
+#  define PNGPARTS_Z_SIMD_X86 1
+#  include <immintrin.h>
+#  define PNGPARTS_Z_SSSE3 __attribute__((target("ssse3")))
+#  define PNGPARTS_Z_AVX2 __attribute__((target("avx2")))
+#else
+#  define PNGPARTS_Z_SIMD_X86 0
+#endif /*PNGPARTS_PNG_NO_SIMD*/
+
+enum pngparts_z_adler32_const {
+  /* Adler-32 modulus */
+  PNGPARTS_Z_ADLER32_BASE = 65521,
+  /*
+   * Most bytes that can go into the sums before they overflow 32 bits:
+   * largest n with 255n(n+1)/2 + (n+1)(BASE-1) < 2**32
+   */
+  PNGPARTS_Z_ADLER32_NMAX = 5552
+};
+
+/*
+ * Scalar Adler-32 kernel.
+ * - s1 flat sum, reduced
+ * - s2 compound sum, reduced
+ * - buf bytes to accumulate
+ * - len number of bytes, at most NMAX
+ */
+static void pngparts_z_adler32_block
+  ( unsigned long int* s1, unsigned long int* s2,
+    unsigned char const* buf, unsigned long int len);
+#if PNGPARTS_Z_SIMD_X86
+/*
+ * Vector kernels. These take 32 bytes at a time: one sum of absolute
+ * differences against zero adds them to s1, and a multiply by the
+ * weights 32 down to 1 adds them to s2.
+ * - s1 flat sum, reduced
+ * - s2 compound sum, reduced
+ * - buf bytes to accumulate
+ * - n number of 32-byte runs, with 32n at most NMAX
+ */
+static void pngparts_z_adler32_ssse3
+  ( unsigned long int* s1, unsigned long int* s2,
+    unsigned char const* buf, unsigned long int n) PNGPARTS_Z_SSSE3;
+static void pngparts_z_adler32_avx2
+  ( unsigned long int* s1, unsigned long int* s2,
+    unsigned char const* buf, unsigned long int n) PNGPARTS_Z_AVX2;
+/*
+ * Find the best Adler-32 kernel for this processor.
+ * @return 0 for scalar, 1 for SSSE3, 2 for AVX2
+ */
+static int pngparts_z_adler32_support(void);
+#endif /*PNGPARTS_Z_SIMD_X86*/
+
 int pngparts_z_header_check(struct pngparts_z_header hdr){
   int holding = 0;
   holding |= (hdr.fdict&1)<<5;
@@ -67,6 +121,139 @@ struct pngparts_z_adler32 pngparts_z_adler32_accum
   out.s2 = (chk.s2+xs1)%65521;
   return out;
 }
+void pngparts_z_adler32_block
+  ( unsigned long int* s1, unsigned long int* s2,
+    unsigned char const* buf, unsigned long int len)
+{
+  unsigned long int a = *s1, b = *s2;
+  unsigned long int i;
+  for (i = 0; i + 4 <= len; i += 4) {
+    a += buf[i+0]; b += a;
+    a += buf[i+1]; b += a;
+    a += buf[i+2]; b += a;
+    a += buf[i+3]; b += a;
+  }
+  for (; i < len; ++i) {
+    a += buf[i]; b += a;
+  }
+  *s1 = a % PNGPARTS_Z_ADLER32_BASE;
+  *s2 = b % PNGPARTS_Z_ADLER32_BASE;
+  return;
+}
+#if PNGPARTS_Z_SIMD_X86
+void pngparts_z_adler32_ssse3
+  ( unsigned long int* s1, unsigned long int* s2,
+    unsigned char const* buf, unsigned long int n)
+{
+  __m128i const zero = _mm_setzero_si128();
+  __m128i const ones = _mm_set1_epi16(1);
+  __m128i const taps_lo = _mm_setr_epi8(
+    32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+  __m128i const taps_hi = _mm_setr_epi8(
+    16, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1);
+  __m128i v1 = _mm_cvtsi32_si128((int)*s1);
+  __m128i v2 = _mm_cvtsi32_si128((int)*s2);
+  /* s1 before each run, each to be counted 32 times into s2 */
+  __m128i vp = zero;
+  unsigned long int i;
+  for (i = 0; i < n; ++i, buf += 32) {
+    __m128i const lo = _mm_loadu_si128((__m128i const*)buf);
+    __m128i const hi = _mm_loadu_si128((__m128i const*)(buf+16));
+    vp = _mm_add_epi32(vp, v1);
+    v1 = _mm_add_epi32(v1, _mm_sad_epu8(lo, zero));
+    v1 = _mm_add_epi32(v1, _mm_sad_epu8(hi, zero));
+    v2 = _mm_add_epi32(v2,
+      _mm_madd_epi16(_mm_maddubs_epi16(lo, taps_lo), ones));
+    v2 = _mm_add_epi32(v2,
+      _mm_madd_epi16(_mm_maddubs_epi16(hi, taps_hi), ones));
+  }
+  v2 = _mm_add_epi32(v2, _mm_slli_epi32(vp, 5));
+  /* add the four lanes together */
+  v1 = _mm_add_epi32(v1, _mm_shuffle_epi32(v1, _MM_SHUFFLE(1,0,3,2)));
+  v1 = _mm_add_epi32(v1, _mm_shuffle_epi32(v1, _MM_SHUFFLE(2,3,0,1)));
+  v2 = _mm_add_epi32(v2, _mm_shuffle_epi32(v2, _MM_SHUFFLE(1,0,3,2)));
+  v2 = _mm_add_epi32(v2, _mm_shuffle_epi32(v2, _MM_SHUFFLE(2,3,0,1)));
+  *s1 = ((unsigned long int)(unsigned int)_mm_cvtsi128_si32(v1))
+    % PNGPARTS_Z_ADLER32_BASE;
+  *s2 = ((unsigned long int)(unsigned int)_mm_cvtsi128_si32(v2))
+    % PNGPARTS_Z_ADLER32_BASE;
+  return;
+}
+void pngparts_z_adler32_avx2
+  ( unsigned long int* s1, unsigned long int* s2,
+    unsigned char const* buf, unsigned long int n)
+{
+  __m256i const zero = _mm256_setzero_si256();
+  __m256i const ones = _mm256_set1_epi16(1);
+  __m256i const taps = _mm256_setr_epi8(
+    32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+    16, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1);
+  __m256i v1 = _mm256_setr_epi32((int)*s1, 0, 0, 0, 0, 0, 0, 0);
+  __m256i v2 = _mm256_setr_epi32((int)*s2, 0, 0, 0, 0, 0, 0, 0);
+  __m256i vp = zero;
+  __m128i h1, h2;
+  unsigned long int i;
+  for (i = 0; i < n; ++i, buf += 32) {
+    __m256i const x = _mm256_loadu_si256((__m256i const*)buf);
+    vp = _mm256_add_epi32(vp, v1);
+    v1 = _mm256_add_epi32(v1, _mm256_sad_epu8(x, zero));
+    v2 = _mm256_add_epi32(v2,
+      _mm256_madd_epi16(_mm256_maddubs_epi16(x, taps), ones));
+  }
+  v2 = _mm256_add_epi32(v2, _mm256_slli_epi32(vp, 5));
+  /* add the eight lanes together */
+  h1 = _mm_add_epi32(_mm256_castsi256_si128(v1),
+    _mm256_extracti128_si256(v1, 1));
+  h2 = _mm_add_epi32(_mm256_castsi256_si128(v2),
+    _mm256_extracti128_si256(v2, 1));
+  h1 = _mm_add_epi32(h1, _mm_shuffle_epi32(h1, _MM_SHUFFLE(1,0,3,2)));
+  h1 = _mm_add_epi32(h1, _mm_shuffle_epi32(h1, _MM_SHUFFLE(2,3,0,1)));
+  h2 = _mm_add_epi32(h2, _mm_shuffle_epi32(h2, _MM_SHUFFLE(1,0,3,2)));
+  h2 = _mm_add_epi32(h2, _mm_shuffle_epi32(h2, _MM_SHUFFLE(2,3,0,1)));
+  *s1 = ((unsigned long int)(unsigned int)_mm_cvtsi128_si32(h1))
+    % PNGPARTS_Z_ADLER32_BASE;
+  *s2 = ((unsigned long int)(unsigned int)_mm_cvtsi128_si32(h2))
+    % PNGPARTS_Z_ADLER32_BASE;
+  return;
+}
+int pngparts_z_adler32_support(void) {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return 2;
+  else if (__builtin_cpu_supports("ssse3"))
+    return 1;
+  else return 0;
+}
+#endif /*PNGPARTS_Z_SIMD_X86*/
+struct pngparts_z_adler32 pngparts_z_adler32_update
+  (struct pngparts_z_adler32 chk, void const* buf, unsigned long int len)
+{
+  unsigned char const* ptr = (unsigned char const*)buf;
+#if PNGPARTS_Z_SIMD_X86
+  int const simd = (len >= 32) ? pngparts_z_adler32_support() : 0;
+#endif /*PNGPARTS_Z_SIMD_X86*/
+  /* reduce only once per NMAX bytes */
+  while (len > 0) {
+    unsigned long int n = (len < PNGPARTS_Z_ADLER32_NMAX)
+      ? len : PNGPARTS_Z_ADLER32_NMAX;
+    len -= n;
+#if PNGPARTS_Z_SIMD_X86
+    if (simd > 0 && n >= 32) {
+      unsigned long int const runs = n/32;
+      if (simd >= 2)
+        pngparts_z_adler32_avx2(&chk.s1, &chk.s2, ptr, runs);
+      else
+        pngparts_z_adler32_ssse3(&chk.s1, &chk.s2, ptr, runs);
+      ptr += runs*32;
+      n -= runs*32;
+    }
+#endif /*PNGPARTS_Z_SIMD_X86*/
+    if (n > 0)
+      pngparts_z_adler32_block(&chk.s1, &chk.s2, ptr, n);
+    ptr += n;
+  }
+  return chk;
+}
 
 void pngparts_z_setup_input
   (void* zs, void* inbuf, int insize)
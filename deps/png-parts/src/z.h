@@ -138,6 +138,19 @@ unsigned long int pngparts_z_adler32_tol(struct pngparts_z_adler32 chk);
 PNGPARTS_API
 struct pngparts_z_adler32 pngparts_z_adler32_accum
   (struct pngparts_z_adler32 chk, int ch);
+/*
+ * Accumulate a run of bytes. Gives the same result as calling
+ *   `pngparts_z_adler32_accum` on each byte, but reduces the sums
+ *   only once every few thousand bytes and uses vector kernels where
+ *   the processor has them.
+ * - chk the current checksum accumulator state
+ * - buf the bytes to accumulate
+ * - len number of bytes to accumulate
+ * @return the new accumulator state
+ */
+PNGPARTS_API
+struct pngparts_z_adler32 pngparts_z_adler32_update
+  (struct pngparts_z_adler32 chk, void const* buf, unsigned long int len);
 
 /*
  * Setup an input buffer for next use.
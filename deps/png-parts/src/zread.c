@@ -60,6 +60,8 @@ int pngparts_zread_parse(void *prs_v, int mode){
   int shortpos = prs->shortpos;
   int sticky_finish = ((mode&PNGPARTS_API_Z_FINISH) != 0);
   unsigned int trouble_count = 0;
+  /* output not yet added to the checksum */
+  int check_from = prs->outpos;
   if (result == PNGPARTS_API_OVERFLOW){
     if (prs->outpos < prs->outsize)
       result = PNGPARTS_API_OK;
@@ -74,6 +76,7 @@ int pngparts_zread_parse(void *prs_v, int mode){
      * 4  - done
      */
     int ch;
+    int bulk_tf = 0;
     if (prs->flags_tf&2) {
       /* put dummy character */
       ch = -1;
@@ -137,7 +140,22 @@ int pngparts_zread_parse(void *prs_v, int mode){
         }
       }break;
     case 2: /*data processing callback */
-      if (ch >= -1) {
+      if (ch >= -1 && prs->cb.block_cb != NULL) {
+        /* bulk mode: pass all available input and output space */
+        int in_len = prs->insize - prs->inpos;
+        int out_len = prs->outsize - prs->outpos;
+        result = (*prs->cb.block_cb)(prs->cb.cb_data,
+              prs->inbuf + prs->inpos, &in_len,
+              prs->outbuf + prs->outpos, &out_len);
+        prs->inpos += in_len;
+        prs->outpos += out_len;
+        bulk_tf = 1;
+        if (result == PNGPARTS_API_DONE){
+          state = 3;
+          shortpos = 0;
+          result = PNGPARTS_API_OK;
+        }
+      } else if (ch >= -1) {
         result = (*prs->cb.one_cb)(prs->cb.cb_data,ch,
               prs,&pngparts_zread_put_cb);
         if (result == PNGPARTS_API_DONE){
@@ -165,6 +183,10 @@ int pngparts_zread_parse(void *prs_v, int mode){
           /* check the sum */
           unsigned long int stream_chk
             = pngparts_zread_get32(prs->shortbuf);
+          prs->check = pngparts_z_adler32_update(prs->check,
+            prs->outbuf + check_from,
+            (unsigned long int)(prs->outpos - check_from));
+          check_from = prs->outpos;
           if (pngparts_z_adler32_tol(prs->check) != stream_chk){
             result = PNGPARTS_API_BAD_SUM;
           } else {
@@ -190,7 +212,12 @@ int pngparts_zread_parse(void *prs_v, int mode){
       result = PNGPARTS_API_BAD_STATE;
       break;
     }
-    if (result != PNGPARTS_API_OK){
+    if (bulk_tf){
+      /* the block callback already moved the input position */
+      prs->flags_tf &= ~2;
+      if (result != PNGPARTS_API_OK)
+        break;
+    } else if (result != PNGPARTS_API_OK){
       break;
     } else if (prs->flags_tf & 2){
       /* reset the flag */
@@ -200,6 +227,11 @@ int pngparts_zread_parse(void *prs_v, int mode){
       prs->inpos += 1;
     }
   }
+  if (prs->outpos > check_from){
+    prs->check = pngparts_z_adler32_update(prs->check,
+      prs->outbuf + check_from,
+      (unsigned long int)(prs->outpos - check_from));
+  }
   prs->last_result = result;
   prs->state = (short)state;
   prs->shortpos = (short)shortpos;
@@ -213,7 +245,6 @@ int pngparts_zread_put_cb(void* data, int ch){
   if (prs->outpos < prs->outsize){
     unsigned char chc = (unsigned char)(ch&255);
     prs->outbuf[prs->outpos++] = chc;
-    prs->check = pngparts_z_adler32_accum(prs->check, chc);
     return PNGPARTS_API_OK;
   } else {
     return PNGPARTS_API_OVERFLOW;
@@ -229,10 +260,8 @@ int pngparts_zread_set_dictionary
     unsigned long int dict_chk
             = pngparts_zread_get32(prs->shortbuf);
     /* confirm the dictionary */
-    check = pngparts_z_adler32_new();
-    for (i = 0; i < len; ++i){
-      check = pngparts_z_adler32_accum(check, ptr[i]&255);
-    }
+    check = pngparts_z_adler32_update(pngparts_z_adler32_new(),
+      ptr, (unsigned long int)len);
     if (pngparts_z_adler32_tol(check) != dict_chk){
       return PNGPARTS_API_WRONG_DICT;
     } else {
@@ -14,6 +14,13 @@
 
 static int pngparts_zwrite_put_cb(void* prs, int ch);
 static void pngparts_zwrite_put32(unsigned char* , unsigned long int );
+/*
+ * Add the input taken since a given position to the checksum.
+ * - zs zlib writer
+ * - from position of the first input byte not yet checked
+ * @return the position of the next input byte to check
+ */
+static int pngparts_zwrite_check_input(struct pngparts_z* zs, int from);
 
 void pngparts_zwrite_put32(unsigned char* b, unsigned long int v){
   b[3] = (v>>0)&255;
@@ -22,6 +29,15 @@ void pngparts_zwrite_put32(unsigned char* b, unsigned long int v){
   b[0] = (v>>24)&255;
   return;
 }
+int pngparts_zwrite_check_input(struct pngparts_z* zs, int from){
+  /* retries after the last byte may step past the end of the input */
+  int const to = zs->inpos < zs->insize ? zs->inpos : zs->insize;
+  if (to > from){
+    zs->check = pngparts_z_adler32_update(zs->check,
+      zs->inbuf + from, (unsigned long int)(to - from));
+    return to;
+  } else return from;
+}
 
 void pngparts_zwrite_init(struct pngparts_z *zs){
   zs->state = 0;
@@ -63,6 +79,8 @@ int pngparts_zwrite_generate(void *zs_v, int mode){
   int state = zs->state;
   int sticky_finish = ((mode&PNGPARTS_API_Z_FINISH) != 0);
   int trouble_counter = 0;
+  /* input not yet added to the checksum */
+  int check_from = zs->inpos;
   if (result == PNGPARTS_API_OVERFLOW){
     if (zs->outpos < zs->outsize)
       result = PNGPARTS_API_OK;
@@ -149,13 +167,7 @@ int pngparts_zwrite_generate(void *zs_v, int mode){
           );
         if (result != PNGPARTS_API_OK)
           break;
-        /* check the byte only after the byte succeeds */if (ch >= 0){
-          zs->check = pngparts_z_adler32_accum(zs->check, ch);
-        } else if (ch == -1){
-          /* ch is a repeat code; get the actual character */
-          int const actual_ch = zs->inbuf[zs->inpos]&255;
-          zs->check = pngparts_z_adler32_accum(zs->check, actual_ch);
-        }
+        /* the byte gets checked once it has been taken */
       } else if (sticky_finish) {
         /* notify the deflater of the finale */
         result = (*zs->cb.finish_cb)(
@@ -171,8 +183,9 @@ int pngparts_zwrite_generate(void *zs_v, int mode){
       break;
     case 3:
       if (zs->shortpos == 0){
-        unsigned long int const text_check =
-          pngparts_z_adler32_tol(zs->check);
+        unsigned long int text_check;
+        check_from = pngparts_zwrite_check_input(zs, check_from);
+        text_check = pngparts_z_adler32_tol(zs->check);
         /* generate the bytes for the checksum */{
           pngparts_zwrite_put32(zs->shortbuf, text_check);
         }
@@ -213,6 +226,7 @@ int pngparts_zwrite_generate(void *zs_v, int mode){
       zs->inpos += 1;
     }
   }
+  pngparts_zwrite_check_input(zs, check_from);
   zs->last_result = result;
   zs->state = (short)state;
   if (result){
@@ -241,10 +255,8 @@ int pngparts_zwrite_set_dictionary
     struct pngparts_z_adler32 check;
     unsigned long int dict_chk;
     /* compute the dictionary checksum */
-    check = pngparts_z_adler32_new();
-    for (i = 0; i < len; ++i){
-      check = pngparts_z_adler32_accum(check, ptr[i]&255);
-    }
+    check = pngparts_z_adler32_update(pngparts_z_adler32_new(),
+      ptr, (unsigned long int)len);
     dict_chk = pngparts_z_adler32_tol(check);
     /* write the checksum */{
       pngparts_zwrite_put32(zs->shortbuf+2, dict_chk);
@@ -28,6 +28,12 @@ static int test_image_header
 static void test_image_recv_pixel
   ( void* img, long int x, long int y, unsigned int red,
     unsigned int green, unsigned int blue, unsigned int alpha);
+static int test_read_mem
+  ( struct pngparts_aux_reader* reader, struct pngparts_api_image* img_api,
+    char const* in_fname);
+static int test_read
+  ( struct pngparts_aux_reader* reader, struct test_image* img,
+    int source, char const* in_fname);
 
 int test_image_header
   ( void* img_ptr, long int width, long int height, short bit_depth,
@@ -67,6 +73,62 @@ void test_image_recv_pixel
   pixel[3] = alpha;
   return;
 }
+int test_read_mem
+  ( struct pngparts_aux_reader* reader, struct pngparts_api_image* img_api,
+    char const* in_fname)
+{
+  FILE *to_read = fopen(in_fname, "rb");
+  unsigned char* data = NULL;
+  size_t len = 0;
+  int result;
+  if (to_read == NULL) {
+    return PNGPARTS_API_IO_ERROR;
+  }
+  /* load the whole file */for (;;) {
+    unsigned char* const next = (unsigned char*)realloc(data, len + 4096);
+    size_t readlen;
+    if (next == NULL) {
+      free(data);
+      fclose(to_read);
+      return PNGPARTS_API_MEMORY;
+    }
+    data = next;
+    readlen = fread(data + len, sizeof(unsigned char), 4096, to_read);
+    len += readlen;
+    if (readlen < 4096) break;
+  }
+  fclose(to_read);
+  if (reader != NULL)
+    result = pngparts_aux_reader_read_png_mem_8(reader, img_api, data, len);
+  else
+    result = pngparts_aux_read_png_mem_8(img_api, data, len);
+  free(data);
+  return result;
+}
+int test_read
+  ( struct pngparts_aux_reader* reader, struct test_image* img,
+    int source, char const* in_fname)
+{
+  struct pngparts_api_image img_api;
+  img_api.cb_data = img;
+  img_api.start_cb = &test_image_header;
+  img_api.put_cb = &test_image_recv_pixel;
+  img_api.put_row_cb = NULL;
+  img_api.want_cb = NULL;
+  img_api.put_plte_cb = NULL;
+  img_api.flags = 0;
+  /* parse the PNG stream */
+  if (source == 'b')
+    return test_read_mem(reader, &img_api, in_fname);
+  else if (reader != NULL && source == 'm')
+    return pngparts_aux_reader_read_png_map_8(reader, &img_api, in_fname);
+  else if (reader != NULL)
+    return pngparts_aux_reader_read_png_8(reader, &img_api, in_fname);
+  else if (source == 'm')
+    return pngparts_aux_read_png_map_8(&img_api, in_fname);
+  else
+    return pngparts_aux_read_png_8(&img_api, in_fname);
+}
 void test_image_put_ppm(struct test_image* img) {
   int x, y;
   fprintf(img->outfile, "P3\n%i %i\n255\n",
@@ -96,7 +158,10 @@ int main(int argc, char**argv) {
   FILE *to_write = NULL;
   char const* in_fname = NULL, *out_fname = NULL;
   char const* alpha_fname = NULL;
+  char const* prior_fname = NULL;
+  struct pngparts_aux_reader* reader = NULL;
   int help_tf = 0;
+  int source = 0;
   int result = 0;
   struct test_image img = { 0,0,NULL,NULL,NULL };
   {
@@ -104,6 +169,15 @@ int main(int argc, char**argv) {
     for (argi = 1; argi < argc; ++argi) {
       if (strcmp(argv[argi], "-?") == 0) {
         help_tf = 1;
+      } else if (strcmp("-m",argv[argi]) == 0){
+        source = 'm';
+      } else if (strcmp("-b",argv[argi]) == 0){
+        source = 'b';
+      } else if (strcmp("-p",argv[argi]) == 0){
+        if (argi+1 < argc){
+          argi += 1;
+          prior_fname = argv[argi];
+        }
       } else if (strcmp("-a",argv[argi]) == 0){
         if (argi+1 < argc){
           argi += 1;
@@ -122,6 +196,9 @@ int main(int argc, char**argv) {
         "  -?                 help message\n"
         "options:\n"
         "  -a (file)          alpha channel output file\n"
+        "  -m                 map the input file into memory\n"
+        "  -b                 load the input file into a buffer first\n"
+        "  -p (file)          read this file first with the same reader\n"
       );
       return 2;
     }
@@ -142,14 +219,21 @@ int main(int argc, char**argv) {
     }
   }
   img.outfile = to_write;
-  /* set image callback */{
-    struct pngparts_api_image img_api;
-    img_api.cb_data = &img;
-    img_api.start_cb = &test_image_header;
-    img_api.put_cb = &test_image_recv_pixel;
-    /* parse the PNG stream */
-    result = pngparts_aux_read_png_8(&img_api, in_fname);
+  /* warm up a reader */if (prior_fname != NULL){
+    struct test_image prior = { 0,0,NULL,NULL,NULL };
+    int prior_result;
+    reader = pngparts_aux_reader_new();
+    if (reader == NULL){
+      fprintf(stderr, "Failed to make a reader.\n");
+      if (to_write != stdout) fclose(to_write);
+      return 1;
+    }
+    prior_result = test_read(reader, &prior, source, prior_fname);
+    fprintf(stderr, "Result code for '%s': %i\n", prior_fname, prior_result);
+    free(prior.bytes);
   }
+  result = test_read(reader, &img, source, in_fname);
+  pngparts_aux_reader_free(reader);
   /* output to PPM */ {
     test_image_put_ppm(&img);
   }
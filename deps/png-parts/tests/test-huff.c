@@ -35,7 +35,7 @@ void code_to_string
 
 int main(int argc, char **argv){
   int mode = -1;
-  int usage_tf = 0, c_tf  =0, sort_tf = 0;
+  int usage_tf = 0, c_tf  =0, sort_tf = 0, lut_tf = 0;
   int result = 0;
   struct pngparts_flate_huff code_table;
   char const* text_informator = NULL;
@@ -54,6 +54,9 @@ int main(int argc, char **argv){
       } else if (strcmp(argv[argi],"-q") == 0){
         /* sort */
         sort_tf = 1;
+      } else if (strcmp(argv[argi],"-l") == 0){
+        /* lookup table check */
+        lut_tf = 1;
       } else if (strcmp(argv[argi],"-v") == 0){
         /* variable code: auto */
         if (++argi < argc){
@@ -101,7 +104,7 @@ int main(int argc, char **argv){
   }
   if (usage_tf || mode == -1){
     fprintf(stderr,"usage: test_huff (-v ...|-m ...|-h ...|-f|-z|-vc)"
-        " [-s ...] [-q]\n"
+        " [-s ...] [-q] [-l]\n"
       "  -vc           checked variable code, randomly many numbers\n"
       "  -v (number)   variable code, this many numbers\n"
       "  -m (file)     list of code lengths\n"
@@ -110,6 +113,7 @@ int main(int argc, char **argv){
       "  -fx           fixed codes, runtime generated\n"
       "  -s (seed)     random seed\n"
       "  -q            sort by bit strings\n"
+      "  -l            check lookup table against the code table\n"
       "  -z            ascii table\n"
       "  -?            help text\n");
     return 1;
@@ -316,6 +320,38 @@ int main(int argc, char **argv){
   /* sort bits */if (sort_tf){
     pngparts_flate_huff_bit_sort(&code_table);
   }
+  /* lookup table check */if (lut_tf && result == PNGPARTS_API_OK){
+    struct pngparts_flate_lut lut;
+    int i;
+    int const l = pngparts_flate_huff_get_size(&code_table);
+    pngparts_flate_lut_init(&lut);
+    result = pngparts_flate_lut_build(&lut, &code_table, 9);
+    if (result != PNGPARTS_API_OK){
+      fprintf(stderr,"failed to build lookup table: %s\n",
+          pngparts_api_strerror(result));
+    } else for (i = 0; i < l; ++i){
+      struct pngparts_flate_code const cd
+        = pngparts_flate_huff_index_get(&code_table,i);
+      unsigned int stream_bits = 0;
+      int j, length = 0, value;
+      if (cd.length == 0)
+        continue;
+      /* put the first bit in the lsb */
+      for (j = 0; j < cd.length; ++j){
+        stream_bits |= ((cd.bits>>(cd.length-1-j))&1u)<<j;
+      }
+      /* follow with noise */
+      stream_bits |= ((unsigned int)rand())<<cd.length;
+      value = pngparts_flate_lut_get(&lut, stream_bits, &length);
+      if (value != cd.value || length != cd.length){
+        fprintf(stderr,"lookup mismatch for %i: got %i (length %i)\n",
+          cd.value, value, length);
+        result = PNGPARTS_API_NOT_FOUND;
+        break;
+      }
+    }
+    pngparts_flate_lut_free(&lut);
+  }
   /* text output of bits */if (result == PNGPARTS_API_OK){
     int i;
     int const l = pngparts_flate_huff_get_size(&code_table);
@@ -10,6 +10,7 @@
  */
 
 #include "../src/png.h"
+#include "../src/pngread.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -18,6 +19,46 @@
 
 static int sig_main(int argc, char **argv);
 static int crc32_accum_main(int argc, char **argv);
+static int crc32_update_main(int argc, char **argv);
+static int crc32_check_main(int argc, char **argv);
+static int unfilter_main(int argc, char **argv);
+static int chunk_span_main(int argc, char **argv);
+
+/* chunk bytes seen by a test chunk callback */
+struct test_chunk_record {
+  /* nonzero to ask for spans instead of bytes */
+  int span_tf;
+  /* payload bytes of every chunk, back to back */
+  unsigned char* bytes;
+  unsigned long int len;
+  unsigned long int cap;
+  /* FINISH result for each chunk */
+  int finish[8];
+  int chunk_count;
+  /* span messages received, and the longest span */
+  unsigned long int spans;
+  unsigned long int max_span;
+};
+/*
+ * Chunk callback that records the payload it receives.
+ * - p the reader
+ * - cb_data a `struct test_chunk_record`
+ * - msg the message
+ * @return OK, or MEMORY if the payload did not fit
+ */
+static int test_chunk_record_cb
+  (struct pngparts_png* p, void* cb_data, struct pngparts_png_message* msg);
+/*
+ * Read a PNG stream a block at a time with one recording callback.
+ * - stream the stream
+ * - stream_len length of the stream in bytes
+ * - block_size bytes to hand the reader at a time
+ * - rec the record to fill
+ * @return the last parse result
+ */
+static int test_chunk_record_parse
+  ( unsigned char const* stream, unsigned long int stream_len,
+    int block_size, struct test_chunk_record* rec);
 
 int sig_main(int argc, char **argv){
   int help_tf = 0;
@@ -158,17 +199,523 @@ int crc32_accum_main(int argc, char **argv){
   return result;
 }
 
+int crc32_update_main(int argc, char **argv){
+  FILE* to_read = NULL;
+  char const* fname = NULL;
+  int argi;
+  int help_tf = 0;
+  long int block_size = 65536;
+  unsigned char* buf = NULL;
+  struct pngparts_png_crc32 chk;
+  for (argi = 1; argi < argc; ++argi){
+    if (strcmp("-?",argv[argi]) == 0){
+      help_tf = 1;
+    } else if (strcmp("-b",argv[argi]) == 0){
+      if (++argi < argc){
+        block_size = strtol(argv[argi], NULL, 0);
+      }
+    } else {
+      fname = argv[argi];
+    }
+  }
+  /* print help */if (help_tf){
+    fprintf(stderr,"usage: test_png crc32_update ... [file]\n"
+      "  -                  read from stdin\n"
+      "  -?                 help message\n"
+      "  -b (number)        bytes to accumulate at a time\n"
+      );
+    return 2;
+  }
+  if (block_size <= 0){
+    fprintf(stderr,"Block size must be positive.\n");
+    return 2;
+  }
+  /* get file */
+  if (fname == NULL){
+    fprintf(stderr,"No filename given.\n");
+    return 2;
+  } else if (strcmp(fname,"-") == 0){
+    to_read = stdin;
+  } else {
+    to_read = fopen(fname,"rb");
+    if (to_read == NULL){
+      int errval = errno;
+      fprintf(stderr,"Failed to open '%s'.\n\t%s\n",
+        fname, strerror(errval));
+      return 2;
+    }
+  }
+  buf = (unsigned char*)malloc((size_t)block_size);
+  if (buf == NULL){
+    fprintf(stderr,"Failed to allocate a block.\n");
+    if (to_read != stdin){
+      fclose(to_read);
+    }
+    return 2;
+  }
+  /* read file */{
+    size_t n;
+    chk = pngparts_png_crc32_new();
+    while ((n = fread(buf, sizeof(unsigned char), (size_t)block_size,
+        to_read)) > 0)
+    {
+      chk = pngparts_png_crc32_update(chk, buf, (unsigned long int)n);
+    }
+  }
+  /* close file */
+  if (to_read != stdin){
+    fclose(to_read);
+  }
+  free(buf);
+  fprintf(stdout,"%#lX\n",pngparts_png_crc32_tol(chk));
+  return 0;
+}
+
+int crc32_check_main(int argc, char **argv){
+  int argi;
+  int help_tf = 0;
+  int result = 0;
+  unsigned int seed = 1;
+  long int trials = 400;
+  unsigned long int const max_len = 65536;
+  unsigned char* buf;
+  for (argi = 1; argi < argc; ++argi){
+    if (strcmp("-?",argv[argi]) == 0){
+      help_tf = 1;
+    } else if (strcmp("-s",argv[argi]) == 0){
+      if (++argi < argc)
+        seed = (unsigned int)strtoul(argv[argi], NULL, 0);
+    } else if (strcmp("-n",argv[argi]) == 0){
+      if (++argi < argc)
+        trials = strtol(argv[argi], NULL, 0);
+    }
+  }
+  /* print help */if (help_tf){
+    fprintf(stderr,"usage: test_png crc32_check ...\n"
+      "  -?                 help message\n"
+      "  -s (number)        random seed\n"
+      "  -n (number)        random lengths to try per fill\n"
+      );
+    return 2;
+  }
+  srand(seed);
+  buf = (unsigned char*)malloc(max_len + 16);
+  if (buf == NULL){
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  /* compare block updates against the byte-wise checksum */{
+    int fill;
+    for (fill = 0; fill < 2 && result == 0; ++fill) {
+      long int t;
+      unsigned long int i;
+      for (i = 0; i < max_len + 16; ++i)
+        buf[i] = (unsigned char)(fill ? 255 : (rand() & 255));
+      /* every length through a few folds, then random ones */
+      for (t = 0; t < 272 + trials && result == 0; ++t) {
+        unsigned long int const len = (t < 272) ? (unsigned long int)t
+          : ((((unsigned long int)rand()) << 15)
+              ^ (unsigned long int)rand()) % (max_len + 1);
+        unsigned long int const split = ((unsigned long int)rand())
+          % (len + 1);
+        unsigned char const* const data = buf + (rand() & 15);
+        struct pngparts_png_crc32 expect = pngparts_png_crc32_new();
+        struct pngparts_png_crc32 whole;
+        struct pngparts_png_crc32 parts;
+        for (i = 0; i < len; ++i)
+          expect = pngparts_png_crc32_accum(expect, data[i]);
+        whole = pngparts_png_crc32_update
+          (pngparts_png_crc32_new(), data, len);
+        parts = pngparts_png_crc32_update
+          (pngparts_png_crc32_new(), data, split);
+        parts = pngparts_png_crc32_update(parts, data + split, len - split);
+        if (pngparts_png_crc32_tol(whole) != pngparts_png_crc32_tol(expect)
+        ||  pngparts_png_crc32_tol(parts) != pngparts_png_crc32_tol(expect))
+        {
+          fprintf(stderr, "%s data, length %lu split at %lu: "
+            "%#lX and %#lX, expected %#lX\n",
+            fill ? "0xFF" : "random", len, split,
+            pngparts_png_crc32_tol(whole), pngparts_png_crc32_tol(parts),
+            pngparts_png_crc32_tol(expect));
+          result = 1;
+        }
+      }
+    }
+  }
+  free(buf);
+  return result;
+}
+
+int unfilter_main(int argc, char **argv){
+  static char const* filter_names[5] =
+    { "none", "sub", "up", "average", "paeth" };
+  int argi;
+  int help_tf = 0;
+  int simd_max = pngparts_png_simd_support();
+  int result = 0;
+  unsigned int seed = 1;
+  long int lengths = 100;
+  for (argi = 1; argi < argc; ++argi){
+    if (strcmp("-?",argv[argi]) == 0){
+      help_tf = 1;
+    } else if (strcmp("-s",argv[argi]) == 0){
+      if (++argi < argc)
+        seed = (unsigned int)strtoul(argv[argi], NULL, 0);
+    } else if (strcmp("-n",argv[argi]) == 0){
+      if (++argi < argc)
+        lengths = strtol(argv[argi], NULL, 0);
+    }
+  }
+  /* print help */if (help_tf){
+    fprintf(stderr,"usage: test_png unfilter ...\n"
+      "  -?                 help message\n"
+      "  -s (number)        random seed\n"
+      "  -n (number)        pixel counts to try per line\n"
+      );
+    return 2;
+  }
+  srand(seed);
+  /* compare each kernel family against the scalar reference */{
+    long int const max_len = lengths * 8 + 64;
+    unsigned char* const prev = (unsigned char*)malloc(max_len);
+    unsigned char* const line = (unsigned char*)malloc(max_len);
+    unsigned char* const ref = (unsigned char*)malloc(max_len);
+    unsigned char* const row = (unsigned char*)malloc(max_len);
+    int bpp, filter, simd;
+    long int count;
+    if (prev == NULL || line == NULL || ref == NULL || row == NULL) {
+      fprintf(stderr, "out of memory\n");
+      result = 1;
+    } else for (bpp = 1; bpp <= 8 && result == 0; ++bpp) {
+      for (count = 0; count <= lengths && result == 0; ++count) {
+        unsigned long int const len = (unsigned long int)(count * bpp);
+        unsigned long int i;
+        for (i = 0; i < len; ++i) {
+          prev[i] = (unsigned char)(rand() & 255);
+          line[i] = (unsigned char)(rand() & 255);
+        }
+        for (filter = 0; filter < 5 && result == 0; ++filter) {
+          memcpy(ref, line, len);
+          pngparts_png_unfilter_row
+            (PNGPARTS_PNG_SIMD_NONE, filter, ref, prev, len, bpp);
+          for (simd = PNGPARTS_PNG_SIMD_NONE+1; simd <= simd_max; ++simd) {
+            int filter_result;
+            memcpy(row, line, len);
+            /* guard bytes past the end of the line */
+            memset(row + len, 0xA5, 64);
+            filter_result = pngparts_png_unfilter_row
+              (simd, filter, row, prev, len, bpp);
+            if (filter_result != PNGPARTS_API_OK) {
+              fprintf(stderr, "%s: unexpected result %i\n",
+                filter_names[filter], filter_result);
+              result = 1;
+              break;
+            }
+            for (i = 0; i < len + 64; ++i) {
+              if (i < len ? (row[i] != ref[i]) : (row[i] != 0xA5))
+                break;
+            }
+            if (i < len + 64) {
+              fprintf(stderr, "%s (kernels %i): bpp %i length %lu: "
+                "mismatch at byte %lu\n",
+                filter_names[filter], simd, bpp, len, i);
+              result = 1;
+              break;
+            }
+          }
+        }
+      }
+    }
+    /* the reference Paeth kernel must follow the predictor */
+    if (result == 0) {
+      unsigned long int i;
+      for (i = 0; i < 24; ++i) {
+        prev[i] = (unsigned char)(rand() & 255);
+        line[i] = ref[i] = (unsigned char)(rand() & 255);
+      }
+      pngparts_png_unfilter_row(PNGPARTS_PNG_SIMD_NONE, 4, ref, prev, 24, 3);
+      for (i = 0; i < 24; ++i) {
+        int const left = i >= 3 ? ref[i-3] : 0;
+        int const corner = i >= 3 ? prev[i-3] : 0;
+        int const expect = (line[i]
+          + pngparts_png_paeth_predict(left, prev[i], corner)) & 255;
+        if (expect != ref[i]) {
+          fprintf(stderr, "paeth: reference mismatch at byte %lu\n", i);
+          result = 1;
+          break;
+        }
+      }
+    }
+    if (result == 0 && pngparts_png_unfilter_row
+        (simd_max, 5, row, prev, 0, 1) != PNGPARTS_API_WEIRD_FILTER)
+    {
+      fprintf(stderr, "filter code 5 accepted\n");
+      result = 1;
+    }
+    free(prev);
+    free(line);
+    free(ref);
+    free(row);
+  }
+  return result;
+}
+
+int test_chunk_record_cb
+  (struct pngparts_png* p, void* cb_data, struct pngparts_png_message* msg)
+{
+  struct test_chunk_record* const rec = (struct test_chunk_record*)cb_data;
+  unsigned char byte;
+  unsigned char const* data = NULL;
+  unsigned long int n = 0;
+  (void)p;
+  switch (msg->type) {
+  case PNGPARTS_PNG_M_START:
+    if (msg->byte == 0 && rec->span_tf)
+      msg->byte = PNGPARTS_PNG_M_GET_SPAN;
+    break;
+  case PNGPARTS_PNG_M_GET:
+    if (rec->span_tf)
+      return PNGPARTS_API_BAD_STATE;
+    byte = (unsigned char)msg->byte;
+    data = &byte;
+    n = 1;
+    break;
+  case PNGPARTS_PNG_M_GET_SPAN:
+    if (!rec->span_tf || msg->byte < 1)
+      return PNGPARTS_API_BAD_STATE;
+    data = (unsigned char const*)msg->ptr;
+    n = (unsigned long int)msg->byte;
+    rec->spans += 1;
+    if (n > rec->max_span)
+      rec->max_span = n;
+    break;
+  case PNGPARTS_PNG_M_FINISH:
+    if (rec->chunk_count < 8)
+      rec->finish[rec->chunk_count] = msg->byte;
+    rec->chunk_count += 1;
+    break;
+  default:
+    break;
+  }
+  if (n > 0) {
+    if (rec->len + n > rec->cap)
+      return PNGPARTS_API_MEMORY;
+    memcpy(rec->bytes + rec->len, data, n);
+    rec->len += n;
+  }
+  return PNGPARTS_API_OK;
+}
+
+int test_chunk_record_parse
+  ( unsigned char const* stream, unsigned long int stream_len,
+    int block_size, struct test_chunk_record* rec)
+{
+  struct pngparts_png parser;
+  struct pngparts_png_chunk_cb cb;
+  unsigned char block[4096];
+  unsigned long int pos;
+  int result = PNGPARTS_API_OK;
+  pngparts_pngread_init(&parser);
+  /* set image callback */{
+    struct pngparts_api_image img_api;
+    memset(&img_api, 0, sizeof(img_api));
+    pngparts_png_set_image_cb(&parser, &img_api);
+  }
+  cb.cb_data = rec;
+  memcpy(cb.name, "spAn", 4);
+  cb.message_cb = &test_chunk_record_cb;
+  if (pngparts_png_add_chunk_cb(&parser, &cb) != PNGPARTS_API_OK) {
+    pngparts_pngread_free(&parser);
+    return PNGPARTS_API_MEMORY;
+  }
+  for (pos = 0; pos < stream_len && result >= 0; pos += block_size) {
+    unsigned long int n = stream_len - pos;
+    if (n > (unsigned long int)block_size)
+      n = (unsigned long int)block_size;
+    /* a fresh copy, so stale spans cannot match by accident */
+    memcpy(block, stream + pos, n);
+    pngparts_png_buffer_setup(&parser, block, (int)n);
+    while (!pngparts_png_buffer_done(&parser)) {
+      result = pngparts_pngread_parse(&parser);
+      if (result < 0) break;
+    }
+    memset(block, 0xA5, n);
+  }
+  pngparts_pngread_free(&parser);
+  return result;
+}
+
+int chunk_span_main(int argc, char **argv){
+  static int const block_sizes[] = { 1, 2, 3, 7, 64, 1000, 4096 };
+  static unsigned long int const chunk_lens[] = { 0, 1, 17, 300, 2500 };
+  int const chunk_total = (int)(sizeof(chunk_lens)/sizeof(chunk_lens[0]));
+  int argi;
+  int help_tf = 0;
+  int result = 0;
+  unsigned int seed = 1;
+  unsigned char* stream;
+  unsigned char* payload;
+  unsigned char* got;
+  unsigned long int stream_len = 0;
+  unsigned long int payload_len = 0;
+  unsigned long int last_crc_at = 0;
+  for (argi = 1; argi < argc; ++argi){
+    if (strcmp("-?",argv[argi]) == 0){
+      help_tf = 1;
+    } else if (strcmp("-s",argv[argi]) == 0){
+      if (++argi < argc)
+        seed = (unsigned int)strtoul(argv[argi], NULL, 0);
+    }
+  }
+  /* print help */if (help_tf){
+    fprintf(stderr,"usage: test_png chunk_span ...\n"
+      "  -?                 help message\n"
+      "  -s (number)        random seed\n"
+      );
+    return 2;
+  }
+  srand(seed);
+  stream = (unsigned char*)malloc(4096);
+  payload = (unsigned char*)malloc(4096);
+  got = (unsigned char*)malloc(4096);
+  if (stream == NULL || payload == NULL || got == NULL) {
+    fprintf(stderr, "out of memory\n");
+    free(stream);
+    free(payload);
+    free(got);
+    return 1;
+  }
+  /* build a stream: IHDR, a run of spAn chunks, IEND */{
+    static unsigned char const ihdr[13] =
+      { 0,0,0,4, 0,0,0,4, 8, 0, 0, 0, 0 };
+    int c;
+    memcpy(stream, pngparts_png_signature(), 8);
+    stream_len = 8;
+    for (c = -1; c <= chunk_total; ++c) {
+      unsigned long int const len = (c < 0) ? 13u
+        : (c < chunk_total ? chunk_lens[c] : 0u);
+      unsigned char* const chunk = stream + stream_len;
+      struct pngparts_png_crc32 chk;
+      unsigned long int i, crc;
+      chunk[0] = (unsigned char)((len >> 24) & 255);
+      chunk[1] = (unsigned char)((len >> 16) & 255);
+      chunk[2] = (unsigned char)((len >> 8) & 255);
+      chunk[3] = (unsigned char)(len & 255);
+      memcpy(chunk+4, c < 0 ? "IHDR" : (c < chunk_total ? "spAn" : "IEND"),
+        4);
+      for (i = 0; i < len; ++i) {
+        chunk[8+i] = (c < 0) ? ihdr[i] : (unsigned char)(rand() & 255);
+        if (c >= 0)
+          payload[payload_len++] = chunk[8+i];
+      }
+      chk = pngparts_png_crc32_update
+        (pngparts_png_crc32_new(), chunk+4, len+4);
+      crc = pngparts_png_crc32_tol(chk);
+      chunk[8+len] = (unsigned char)((crc >> 24) & 255);
+      chunk[9+len] = (unsigned char)((crc >> 16) & 255);
+      chunk[10+len] = (unsigned char)((crc >> 8) & 255);
+      chunk[11+len] = (unsigned char)(crc & 255);
+      if (c == chunk_total-1)
+        last_crc_at = stream_len + 8 + len;
+      stream_len += len + 12;
+    }
+  }
+  /* bytes and spans, with every split, must see the same chunks */{
+    int corrupt;
+    for (corrupt = 0; corrupt < 2 && result == 0; ++corrupt) {
+      int b;
+      if (corrupt)
+        stream[last_crc_at] ^= 0x40;
+      for (b = 0; b < (int)(sizeof(block_sizes)/sizeof(block_sizes[0]))
+          && result == 0; ++b)
+      {
+        int span_tf;
+        for (span_tf = 0; span_tf < 2 && result == 0; ++span_tf) {
+          struct test_chunk_record rec;
+          int const expect = corrupt ? PNGPARTS_API_BAD_CRC
+            : PNGPARTS_API_DONE;
+          int parse_result, c;
+          memset(&rec, 0, sizeof(rec));
+          rec.span_tf = span_tf;
+          rec.bytes = got;
+          rec.cap = 4096;
+          parse_result = test_chunk_record_parse
+            (stream, stream_len, block_sizes[b], &rec);
+          if (parse_result != expect) {
+            fprintf(stderr, "%s, block %i%s: parse result %i\n",
+              span_tf ? "spans" : "bytes", block_sizes[b],
+              corrupt ? ", bad CRC" : "", parse_result);
+            result = 1;
+            break;
+          } else if (rec.len != payload_len
+          ||  memcmp(rec.bytes, payload, payload_len) != 0)
+          {
+            fprintf(stderr, "%s, block %i%s: payload mismatch\n",
+              span_tf ? "spans" : "bytes", block_sizes[b],
+              corrupt ? ", bad CRC" : "");
+            result = 1;
+            break;
+          } else if (rec.chunk_count != chunk_total) {
+            fprintf(stderr, "%s, block %i%s: %i chunks finished\n",
+              span_tf ? "spans" : "bytes", block_sizes[b],
+              corrupt ? ", bad CRC" : "", rec.chunk_count);
+            result = 1;
+            break;
+          }
+          for (c = 0; c < chunk_total; ++c) {
+            int const want = (corrupt && c == chunk_total-1)
+              ? PNGPARTS_API_BAD_CRC : PNGPARTS_API_OK;
+            if (rec.finish[c] != want) {
+              fprintf(stderr, "%s, block %i%s: chunk %i finished with %i\n",
+                span_tf ? "spans" : "bytes", block_sizes[b],
+                corrupt ? ", bad CRC" : "", c, rec.finish[c]);
+              result = 1;
+              break;
+            }
+          }
+          /* spans never cross a block, and small blocks split chunks */
+          if (result == 0 && span_tf
+          &&  (rec.max_span > (unsigned long int)block_sizes[b]
+            || (block_sizes[b] < 2500 && rec.spans <= (unsigned long int)
+                  (chunk_total-1))))
+          {
+            fprintf(stderr, "spans, block %i: %lu spans, longest %lu\n",
+              block_sizes[b], rec.spans, rec.max_span);
+            result = 1;
+          }
+        }
+      }
+    }
+  }
+  free(stream);
+  free(payload);
+  free(got);
+  return result;
+}
+
 int main(int argc, char **argv){
   if (argc < 2){
     fprintf(stderr,"available commands: \n"
       "  sig            output the PNG signature\n"
       "  crc32_accum    compute PNG checksum for data\n"
+      "  crc32_update   compute PNG checksum a block at a time\n"
+      "  crc32_check    check block checksums against crc32_accum\n"
+      "  unfilter       check row filter kernels\n"
+      "  chunk_span     check chunk payloads delivered in spans\n"
       );
     return 2;
   } else if (strcmp("sig",argv[1]) == 0){
     return sig_main(argc-1,argv+1);
   } else if (strcmp("crc32_accum",argv[1]) == 0){
     return crc32_accum_main(argc-1,argv+1);
+  } else if (strcmp("crc32_update",argv[1]) == 0){
+    return crc32_update_main(argc-1,argv+1);
+  } else if (strcmp("crc32_check",argv[1]) == 0){
+    return crc32_check_main(argc-1,argv+1);
+  } else if (strcmp("unfilter",argv[1]) == 0){
+    return unfilter_main(argc-1,argv+1);
+  } else if (strcmp("chunk_span",argv[1]) == 0){
+    return chunk_span_main(argc-1,argv+1);
   } else {
     fprintf(stdout,"unknown command: %s\n", argv[1]);
     return 2;
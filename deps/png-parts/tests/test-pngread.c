@@ -23,6 +23,19 @@ struct test_image {
   unsigned char* bytes;
   FILE* outfile;
   FILE* alphafile;
+  short bit_depth;
+  short color_type;
+  /* palette source for scan line mode */
+  struct pngparts_png const* parser;
+  /* last Adam7 pass to decode */
+  int last_pass;
+  /* distance between the columns to decode */
+  int column_step;
+  /* column flags for `column_step` */
+  unsigned char* mask;
+  /* palette from the palette callback */
+  int plte_size;
+  unsigned int plte[256][4];
 };
 static int test_image_header
   ( void* img, long int width, long int height, short bit_depth,
@@ -30,6 +43,15 @@ static int test_image_header
 static void test_image_recv_pixel
   ( void* img, long int x, long int y, unsigned int red,
     unsigned int green, unsigned int blue, unsigned int alpha);
+static void test_image_recv_row
+  ( void* img, int pass, long int y, long int x, long int x_stride,
+    unsigned long int width, unsigned char const* row);
+static int test_image_want
+  ( void* img, int pass, long int y, long int x, long int x_stride,
+    unsigned long int width, unsigned char const** mask);
+static void test_image_recv_plte
+  ( void* img, int index, unsigned int red, unsigned int green,
+    unsigned int blue, unsigned int alpha);
 
 int test_image_header
   ( void* img_ptr, long int width, long int height, short bit_depth,
@@ -52,8 +74,14 @@ int test_image_header
   if (bytes == NULL) return PNGPARTS_API_UNSUPPORTED;
   img->width = (int)width;
   img->height = (int)height;
+  img->bit_depth = bit_depth;
+  img->color_type = color_type;
   img->bytes = (unsigned char*)bytes;
   memset(bytes, 55, width*height * 4);
+  if (img->column_step > 1) {
+    img->mask = (unsigned char*)malloc(width+1);
+    if (img->mask == NULL) return PNGPARTS_API_UNSUPPORTED;
+  }
   return PNGPARTS_API_OK;
 }
 void test_image_recv_pixel
@@ -69,6 +97,96 @@ void test_image_recv_pixel
   pixel[3] = alpha / 257;
   return;
 }
+void test_image_recv_row
+  ( void* img_ptr, int pass, long int y, long int x, long int x_stride,
+    unsigned long int width, unsigned char const* row)
+{
+  struct test_image *img = (struct test_image*)img_ptr;
+  int const depth = img->bit_depth;
+  int channels;
+  unsigned long int i;
+  switch (img->color_type) {
+  case 2: channels = 3; break;
+  case 4: channels = 2; break;
+  case 6: channels = 4; break;
+  default: channels = 1; break;
+  }
+  /*fprintf(stderr, "row for pass %i at %li..\n", pass, y);*/
+  for (i = 0; i < width; ++i, x += x_stride) {
+    unsigned int sample[4] = { 0, 0, 0, 65535 };
+    int c;
+    for (c = 0; c < channels; ++c) {
+      unsigned long int const index = i*channels + c;
+      if (depth == 16) {
+        sample[c] = (row[index*2] << 8) | row[index*2 + 1];
+      } else if (depth == 8) {
+        sample[c] = row[index];
+      } else {
+        unsigned long int const bit_pos = index*depth;
+        sample[c] = (row[bit_pos >> 3] >> (8 - depth - (bit_pos & 7)))
+          & ((1u << depth) - 1u);
+      }
+    }
+    if (img->color_type == 3 && img->plte_size > 0) {
+      unsigned int const* color;
+      if (sample[0] >= (unsigned int)img->plte_size)
+        continue;
+      color = img->plte[sample[0]];
+      test_image_recv_pixel(img, x, y, color[0], color[1], color[2],
+        color[3]);
+    } else if (img->color_type == 3) {
+      struct pngparts_png_plte_item color;
+      if (sample[0] >= (unsigned int)pngparts_png_get_plte_size(img->parser))
+        continue;
+      color = pngparts_png_get_plte_item(img->parser, sample[0]);
+      test_image_recv_pixel(img, x, y, color.red*257, color.green*257,
+        color.blue*257, color.alpha*257);
+    } else {
+      /* expand to 16 bits as the pixel callback would see it */
+      for (c = 0; c < channels; ++c) {
+        if (depth < 16)
+          sample[c] = sample[c] * 65535u / ((1u << depth) - 1u);
+      }
+      if (channels <= 2) {
+        test_image_recv_pixel(img, x, y, sample[0], sample[0], sample[0],
+          channels == 2 ? sample[1] : 65535);
+      } else {
+        test_image_recv_pixel(img, x, y, sample[0], sample[1], sample[2],
+          sample[3]);
+      }
+    }
+  }
+  return;
+}
+int test_image_want
+  ( void* img_ptr, int pass, long int y, long int x, long int x_stride,
+    unsigned long int width, unsigned char const** mask)
+{
+  struct test_image *img = (struct test_image*)img_ptr;
+  unsigned long int i;
+  (void)y;
+  if (pass > img->last_pass)
+    return PNGPARTS_API_IMAGE_WANT_DONE;
+  else if (img->column_step <= 1)
+    return PNGPARTS_API_IMAGE_WANT_ALL;
+  for (i = 0; i < width; ++i, x += x_stride) {
+    img->mask[i] = (x % img->column_step) == 0;
+  }
+  *mask = img->mask;
+  return PNGPARTS_API_IMAGE_WANT_SOME;
+}
+void test_image_recv_plte
+  ( void* img_ptr, int index, unsigned int red, unsigned int green,
+    unsigned int blue, unsigned int alpha)
+{
+  struct test_image *img = (struct test_image*)img_ptr;
+  img->plte[index][0] = red;
+  img->plte[index][1] = green;
+  img->plte[index][2] = blue;
+  img->plte[index][3] = alpha;
+  img->plte_size = index+1;
+  return;
+}
 void test_image_put_ppm(struct test_image* img) {
   int x, y;
   fprintf(img->outfile, "P3\n%i %i\n255\n",
@@ -115,13 +233,36 @@ int main(int argc, char**argv) {
   struct pngparts_z zreader;
   struct pngparts_flate inflater;
   int help_tf = 0;
+  int row_tf = 0;
+  int want_tf = 0;
+  int palette_tf = 0;
+  int grey_tf = 0;
   int result = 0;
-  struct test_image img = { 0,0,NULL,NULL,NULL };
+  struct test_image img =
+    { 0,0,NULL,NULL,NULL,0,0,NULL,7,1,NULL,0,{{0}} };
   {
     int argi;
     for (argi = 1; argi < argc; ++argi) {
       if (strcmp(argv[argi], "-?") == 0) {
         help_tf = 1;
+      } else if (strcmp("-r",argv[argi]) == 0){
+        row_tf = 1;
+      } else if (strcmp("-i",argv[argi]) == 0){
+        palette_tf = 1;
+      } else if (strcmp("-g",argv[argi]) == 0){
+        grey_tf = 1;
+      } else if (strcmp("-k",argv[argi]) == 0){
+        if (argi+1 < argc){
+          argi += 1;
+          img.last_pass = atoi(argv[argi]);
+          want_tf = 1;
+        }
+      } else if (strcmp("-c",argv[argi]) == 0){
+        if (argi+1 < argc){
+          argi += 1;
+          img.column_step = atoi(argv[argi]);
+          want_tf = 1;
+        }
       } else if (strcmp("-p",argv[argi]) == 0){
         if (argi+1 < argc){
           argi += 1;
@@ -146,6 +287,14 @@ int main(int argc, char**argv) {
         "options:\n"
         "  -p (file)          palette output file\n"
         "  -a (file)          alpha channel output file\n"
+        "  -r                 receive whole scan lines\n"
+      );
+      fprintf(stderr,
+        "  -i                 receive scan lines of palette images only,\n"
+        "                       with the palette ahead of them\n"
+        "  -g                 receive scan lines of greyscale images only\n"
+        "  -k (pass)          stop after the given Adam7 pass\n"
+        "  -c (n)             only receive every n-th column\n"
       );
       return 2;
     }
@@ -187,8 +336,15 @@ int main(int argc, char**argv) {
     img_api.cb_data = &img;
     img_api.start_cb = &test_image_header;
     img_api.put_cb = &test_image_recv_pixel;
+    img_api.put_row_cb =
+      (row_tf || palette_tf || grey_tf) ? &test_image_recv_row : NULL;
+    img_api.want_cb = want_tf ? &test_image_want : NULL;
+    img_api.put_plte_cb = palette_tf ? &test_image_recv_plte : NULL;
+    img_api.flags = (palette_tf ? PNGPARTS_API_IMAGE_ROW_PALETTE : 0)
+      | (grey_tf ? PNGPARTS_API_IMAGE_ROW_GREY : 0);
     pngparts_png_set_image_cb(&parser, &img_api);
   }
+  img.parser = &parser;
   img.outfile = to_write;
   /* set IDAT callback */ {
     struct pngparts_api_z z_api;
@@ -243,6 +399,7 @@ int main(int argc, char**argv) {
       pngparts_inflate_free(&inflater);
       /* close */
       free(img.bytes);
+      free(img.mask);
       if (to_write != stdout) fclose(to_write);
       if (to_read != stdin) fclose(to_read);
       return 1;
@@ -268,6 +425,7 @@ int main(int argc, char**argv) {
       pngparts_inflate_free(&inflater);
       /* close */
       free(img.bytes);
+      free(img.mask);
       if (to_write != stdout) fclose(to_write);
       if (to_read != stdin) fclose(to_read);
       return 1;
@@ -284,6 +442,7 @@ int main(int argc, char**argv) {
   pngparts_inflate_free(&inflater);
   /* close */
   free(img.bytes);
+  free(img.mask);
   if (to_write != stdout) fclose(to_write);
   if (to_read != stdin) fclose(to_read);
   fflush(NULL);
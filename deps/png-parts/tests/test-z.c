@@ -20,6 +20,8 @@ static int fcheck_main(int argc, char **argv);
 static int encode_header_main(int argc, char **argv);
 static int decode_header_main(int argc, char **argv);
 static int adler32_accum_main(int argc, char **argv);
+static int adler32_update_main(int argc, char **argv);
+static int adler32_check_main(int argc, char **argv);
 
 int fcheck_main(int argc, char **argv){
   int argi;
@@ -358,6 +360,188 @@ int adler32_accum_main(int argc, char **argv){
   }
   return result;
 }
+int adler32_update_main(int argc, char **argv){
+  FILE* to_read = NULL;
+  char const* fname = NULL;
+  int argi;
+  int help_tf = 0;
+  long int count = LONG_MAX;
+  long int byte_position = -1;
+  long int block_size = 65536;
+  int result = 0;
+  unsigned char* buf = NULL;
+  struct pngparts_z_adler32 chk;
+  for (argi = 1; argi < argc; ++argi){
+    if (strcmp("-?",argv[argi]) == 0){
+      help_tf = 1;
+    } else if (strcmp("-n",argv[argi]) == 0){
+      if (++argi < argc){
+        byte_position = strtol(argv[argi], NULL, 0);
+      }
+    } else if (strcmp("-c",argv[argi]) == 0){
+      if (++argi < argc){
+        count = strtol(argv[argi], NULL, 0);
+      }
+    } else if (strcmp("-b",argv[argi]) == 0){
+      if (++argi < argc){
+        block_size = strtol(argv[argi], NULL, 0);
+      }
+    } else {
+      fname = argv[argi];
+    }
+  }
+  /* print help */if (help_tf){
+    fprintf(stderr,"usage: test_z adler32_update ... [file]\n"
+      "  -                  read from stdin\n"
+      "  -?                 help message\n"
+      "  -n (number)        byte position for reading\n"
+      "  -c (number)        number of bytes to read\n"
+      "  -b (number)        bytes to accumulate at a time\n"
+      );
+    return 2;
+  }
+  if (block_size <= 0){
+    fprintf(stderr,"Block size must be positive.\n");
+    return 2;
+  }
+  buf = (unsigned char*)malloc((size_t)block_size);
+  if (buf == NULL){
+    fprintf(stderr,"Failed to allocate a block.\n");
+    return 2;
+  }
+  /* get file */
+  if (fname == NULL){
+    fprintf(stderr,"No filename given.\n");
+    free(buf);
+    return 2;
+  } else if (strcmp(fname,"-") == 0){
+    to_read = stdin;
+  } else {
+    to_read = fopen(fname,"rb");
+    if (to_read == NULL){
+      int errval = errno;
+      fprintf(stderr,"Failed to open '%s'.\n\t%s\n",
+        fname, strerror(errval));
+      free(buf);
+      return 2;
+    }
+  }
+  do {
+    /* seek file */if (byte_position >= 0
+    &&  to_read != stdin)
+    {
+      int seek_response = fseek(to_read,byte_position,SEEK_SET);
+      if (seek_response != 0){
+        int errval = errno;
+        fprintf(stderr,"Failed to seek '%s' to %li.\n\t%s\n",
+          fname, byte_position, strerror(errval));
+        result = 2;break;
+      }
+    }
+    /* read file */{
+      chk = pngparts_z_adler32_new();
+      while (count > 0){
+        size_t const want = (size_t)(count < block_size ? count : block_size);
+        size_t const n = fread(buf, sizeof(unsigned char), want, to_read);
+        chk = pngparts_z_adler32_update(chk, buf, (unsigned long int)n);
+        count -= (long int)n;
+        if (n < want){
+          break;
+        }
+      }
+    }
+  } while(0);
+  /* close file */
+  if (to_read != stdin){
+    fclose(to_read);
+  }
+  free(buf);
+  if (result == 0){
+    fprintf(stdout,"%#lX\n",pngparts_z_adler32_tol(chk));
+  }
+  return result;
+}
+
+int adler32_check_main(int argc, char **argv){
+  /* lengths near each multiple of NMAX, as offsets from it */
+  static long int const near_nmax[] = { -33, -32, -31, -1, 0, 1, 31, 32, 33 };
+  static unsigned long int const block_sizes[] =
+    { 1, 7, 31, 32, 33, 1000, 5552, 5553, 65536 };
+  int const near_total = (int)(sizeof(near_nmax)/sizeof(near_nmax[0]));
+  int const block_total = (int)(sizeof(block_sizes)/sizeof(block_sizes[0]));
+  int argi;
+  int help_tf = 0;
+  int result = 0;
+  unsigned int seed = 1;
+  long int trials = 100;
+  unsigned long int const max_len = 4*5552 + 64;
+  unsigned char* buf;
+  for (argi = 1; argi < argc; ++argi){
+    if (strcmp("-?",argv[argi]) == 0){
+      help_tf = 1;
+    } else if (strcmp("-s",argv[argi]) == 0){
+      if (++argi < argc)
+        seed = (unsigned int)strtoul(argv[argi], NULL, 0);
+    } else if (strcmp("-n",argv[argi]) == 0){
+      if (++argi < argc)
+        trials = strtol(argv[argi], NULL, 0);
+    }
+  }
+  /* print help */if (help_tf){
+    fprintf(stderr,"usage: test_z adler32_check ...\n"
+      "  -?                 help message\n"
+      "  -s (number)        random seed\n"
+      "  -n (number)        random lengths to try per fill\n"
+      );
+    return 2;
+  }
+  srand(seed);
+  buf = (unsigned char*)malloc(max_len + 32);
+  if (buf == NULL){
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  /* compare block updates against the byte-wise checksum */{
+    int fill;
+    for (fill = 0; fill < 2 && result == 0; ++fill) {
+      long int const fixed = 65 + 4*near_total;
+      long int t;
+      unsigned long int i;
+      for (i = 0; i < max_len + 32; ++i)
+        buf[i] = (unsigned char)(fill ? 255 : (rand() & 255));
+      /* short lengths, lengths near NMAX multiples, then random ones */
+      for (t = 0; t < fixed + trials && result == 0; ++t) {
+        unsigned long int const len = (t < 65) ? (unsigned long int)t
+          : (t < fixed) ? (unsigned long int)(((t-65)/near_total + 1)*5552
+              + near_nmax[(t-65)%near_total])
+          : ((unsigned long int)rand()) % (max_len + 1);
+        unsigned char const* const data = buf + (rand() & 31);
+        struct pngparts_z_adler32 expect = pngparts_z_adler32_new();
+        int b;
+        for (i = 0; i < len; ++i)
+          expect = pngparts_z_adler32_accum(expect, data[i]);
+        for (b = 0; b < block_total; ++b) {
+          struct pngparts_z_adler32 chk = pngparts_z_adler32_new();
+          for (i = 0; i < len; i += block_sizes[b]) {
+            unsigned long int const n = (len - i < block_sizes[b])
+              ? len - i : block_sizes[b];
+            chk = pngparts_z_adler32_update(chk, data + i, n);
+          }
+          if (pngparts_z_adler32_tol(chk) != pngparts_z_adler32_tol(expect)) {
+            fprintf(stderr, "%s data, length %lu, block %lu: "
+              "%#lX, expected %#lX\n",
+              fill ? "0xFF" : "random", len, block_sizes[b],
+              pngparts_z_adler32_tol(chk), pngparts_z_adler32_tol(expect));
+            result = 1;
+            break;
+          }
+        }
+      }
+    }
+  }
+  free(buf);
+  return result;
+}
 
 int main(int argc, char **argv){
   if (argc < 2){
@@ -366,6 +550,8 @@ int main(int argc, char **argv){
       "  header_put     write a zlib header\n"
       "  header_get     read and check a zlib header\n"
       "  adler32_accum  compute Adler32 checksum for data\n"
+      "  adler32_update compute Adler32 checksum a block at a time\n"
+      "  adler32_check  check block checksums against adler32_accum\n"
       );
     return 2;
   } else if (strcmp("header_check",argv[1]) == 0){
@@ -376,6 +562,10 @@ int main(int argc, char **argv){
     return decode_header_main(argc-1,argv+1);
   } else if (strcmp("adler32_accum",argv[1]) == 0){
     return adler32_accum_main(argc-1,argv+1);
+  } else if (strcmp("adler32_update",argv[1]) == 0){
+    return adler32_update_main(argc-1,argv+1);
+  } else if (strcmp("adler32_check",argv[1]) == 0){
+    return adler32_check_main(argc-1,argv+1);
   } else {
     fprintf(stdout,"unknown command: %s\n", argv[1]);
     return 2;
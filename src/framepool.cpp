@@ -0,0 +1,182 @@
+#include "framepool.hpp"
+#include "yccbox.hpp"
+#include <exception>
+#include <utility>
+
+namespace theorize
+{
+    struct frame_pool::slot {
+        enum status { queued, running, done };
+        std::string path;
+        std::unique_ptr<ycbcr_box> frame;
+        status state;
+        bool ok;
+    };
+    struct frame_pool::band_job {
+        std::function<void(std::size_t)> const* fn;
+        std::size_t count;
+        std::size_t next;
+        std::size_t done;
+    };
+
+    //BEGIN frame_pool / rule-of-six
+    frame_pool::frame_pool(unsigned int threads, std::size_t lookahead,
+            load_fn load)
+        : load(std::move(load)), depth(lookahead ? lookahead : 1),
+          stopping(false)
+    {
+        if (threads <= 1) {
+            inline_scratch.reset(new ycbcr_box);
+            return;
+        }
+        workers.reserve(threads);
+        try {
+            for (unsigned int i = 0; i < threads; ++i)
+                workers.emplace_back(&frame_pool::work, this);
+        } catch (...) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            job_ready.notify_all();
+            for (std::thread& t : workers)
+                t.join();
+            throw;
+        }
+    }
+    frame_pool::~frame_pool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        job_ready.notify_all();
+        for (std::thread& t : workers)
+            t.join();
+    }
+    //END   frame_pool / rule-of-six
+
+    //BEGIN frame_pool / private
+    void frame_pool::run(load_fn const& load, slot& job, ycbcr_box& scratch) {
+        try {
+            job.ok = load(job.path, scratch, *job.frame);
+        } catch (std::exception const&) {
+            job.ok = false;
+        }
+        if (!job.ok)
+            job.frame->grey();
+        return;
+    }
+    bool frame_pool::work_band(std::unique_lock<std::mutex>& guard) {
+        if (band_jobs.empty())
+            return false;
+        band_job& job = *band_jobs.front();
+        std::size_t const index = job.next++;
+        if (job.next >= job.count)
+            band_jobs.pop_front();
+        guard.unlock();
+        (*job.fn)(index);
+        guard.lock();
+        if (++job.done >= job.count)
+            band_done.notify_all();
+        return true;
+    }
+    void frame_pool::work() {
+        ycbcr_box scratch;
+        std::unique_lock<std::mutex> guard(lock);
+        for (;;) {
+            if (work_band(guard))
+                continue;
+            slot* job = nullptr;
+            for (std::unique_ptr<slot>& s : slots) {
+                if (s->state == slot::queued) {
+                    job = s.get();
+                    break;
+                }
+            }
+            if (!job) {
+                if (stopping)
+                    return;
+                job_ready.wait(guard);
+                continue;
+            }
+            job->state = slot::running;
+            guard.unlock();
+            run(load, *job, scratch);
+            guard.lock();
+            job->state = slot::done;
+            frame_ready.notify_all();
+        }
+    }
+    //END   frame_pool / private
+
+    //BEGIN frame_pool / public
+    void frame_pool::submit(std::string path) {
+        std::unique_ptr<slot> job(new slot{std::move(path), nullptr,
+            slot::queued, false});
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!spares.empty()) {
+                job->frame = std::move(spares.back());
+                spares.pop_back();
+            } else job->frame.reset(new ycbcr_box);
+            slots.push_back(std::move(job));
+        }
+        job_ready.notify_one();
+        return;
+    }
+    bool frame_pool::take(std::unique_ptr<ycbcr_box>& frame) {
+        std::unique_lock<std::mutex> guard(lock);
+        if (slots.empty())
+            return false;
+        slot& job = *slots.front();
+        if (workers.empty()) {
+            guard.unlock();
+            run(load, job, *inline_scratch);
+            guard.lock();
+        } else while (job.state != slot::done)
+            frame_ready.wait(guard);
+        bool const ok = job.ok;
+        frame = std::move(job.frame);
+        slots.pop_front();
+        return ok;
+    }
+    void frame_pool::for_each_band(std::size_t count,
+        std::function<void(std::size_t)> const& fn)
+    {
+        if (workers.empty() || count <= 1) {
+            for (std::size_t i = 0; i < count; ++i)
+                fn(i);
+            return;
+        }
+        band_job job{&fn, count, 0, 0};
+        std::unique_lock<std::mutex> guard(lock);
+        band_jobs.push_back(&job);
+        job_ready.notify_all();
+        while (job.next < job.count) {
+            std::size_t const index = job.next++;
+            if (job.next >= job.count) {
+                for (auto it = band_jobs.begin(); it != band_jobs.end(); ++it) {
+                    if (*it == &job) {
+                        band_jobs.erase(it);
+                        break;
+                    }
+                }
+            }
+            guard.unlock();
+            fn(index);
+            guard.lock();
+            job.done += 1;
+        }
+        while (job.done < job.count)
+            band_done.wait(guard);
+        return;
+    }
+    void frame_pool::recycle(std::unique_ptr<ycbcr_box> frame) {
+        if (!frame)
+            return;
+        std::lock_guard<std::mutex> guard(lock);
+        spares.push_back(std::move(frame));
+        return;
+    }
+    //END   frame_pool / public
+}
@@ -0,0 +1,103 @@
+/**
+ *
+*/
+#if !(defined hg_Theorize_FramePool_h_)
+#define hg_Theorize_FramePool_h_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace theorize
+{
+    class ycbcr_box;
+
+    /**
+     * Decodes upcoming frames on worker threads, then hands the
+     * frames back in the order they were submitted.
+     */
+    class frame_pool {
+    public:
+        /**
+         * Frame loader.
+         * - path frame file to load
+         * - scratch worker-private buffer for the source image
+         * - out destination frame
+         * @return true on success
+         */
+        typedef std::function<bool(std::string const& path,
+            ycbcr_box& scratch, ycbcr_box& out)> load_fn;
+    private:
+        struct slot;
+        struct band_job;
+        load_fn load;
+        std::size_t depth;
+        std::deque<std::unique_ptr<slot>> slots;
+        std::deque<band_job*> band_jobs;
+        std::vector<std::unique_ptr<ycbcr_box>> spares;
+        std::vector<std::thread> workers;
+        std::unique_ptr<ycbcr_box> inline_scratch;
+        std::mutex lock;
+        std::condition_variable job_ready;
+        std::condition_variable frame_ready;
+        std::condition_variable band_done;
+        bool stopping;
+
+        void work();
+        bool work_band(std::unique_lock<std::mutex>& guard);
+        static void run(load_fn const& load, slot& job, ycbcr_box& scratch);
+    public:
+        /**
+         * - threads number of worker threads; with zero or one thread,
+         *   frames load on the calling thread during `take`
+         * - lookahead maximum number of frames in flight
+         * - load the frame loader
+         */
+        frame_pool(unsigned int threads, std::size_t lookahead, load_fn load);
+        frame_pool(frame_pool const&) = delete;
+        frame_pool& operator=(frame_pool const&) = delete;
+        ~frame_pool();
+        /**
+         * Queue up a frame for loading.
+         * - path frame file to load
+         */
+        void submit(std::string path);
+        /**
+         * Wait for the oldest submitted frame.
+         * - frame receives the loaded frame
+         * @return true if the frame loaded successfully
+         */
+        bool take(std::unique_ptr<ycbcr_box>& frame);
+        /**
+         * Give a frame buffer back for reuse by later frames.
+         */
+        void recycle(std::unique_ptr<ycbcr_box> frame);
+        /**
+         * Run a number of independent bands of work, sharing them with
+         * any idle worker threads, and wait for all of them. The caller
+         * runs bands too, so this may be called from within a frame
+         * loader.
+         * - count number of bands
+         * - fn band function, called once with each index below
+         *   `count`; must not throw
+         */
+        void for_each_band(std::size_t count,
+            std::function<void(std::size_t)> const& fn);
+        /**
+         * @return the number of frames submitted but not yet taken
+         */
+        std::size_t pending() const noexcept { return slots.size(); }
+        /**
+         * @return true if no more frames fit in flight
+         */
+        bool full() const noexcept { return slots.size() >= depth; }
+    };
+}
+
+#endif //hg_Theorize_FramePool_h_
@@ -1,17 +1,19 @@
 
 #include "yccbox.hpp"
+#include "scale.hpp"
+#include "resample.hpp"
 #include "pngycc.hpp"
+#include "framepool.hpp"
 #include <theora/codec.h>
 #include <theora/theoraenc.h>
 #include <iostream>
 #include <string>
 #include <fstream>
 #include <memory>
+#include <deque>
+#include <thread>
 #include <cstdlib>
 
-static
-void scale(theorize::ycbcr_box& dst, theorize::ycbcr_box const& src);
-
 class packager;
 
 static
@@ -22,7 +24,8 @@ class encoder
 private:
     th_enc_ctx* ptr;
 public:
-    encoder(int width, int height, int fps, int quality);
+    encoder(int width, int height, theorize::frame_region const& picture,
+        int fps, int quality, theorize::pixel_format format);
     encoder(encoder const&) = delete;
     encoder& operator=(encoder const&) = delete;
     ~encoder();
@@ -42,27 +45,29 @@ public:
     explicit operator bool() noexcept;
 };
 
-void scale(theorize::ycbcr_box& dst, theorize::ycbcr_box const& src) {
-    for (unsigned dst_y = 0; dst_y < dst.height(); ++dst_y) {
-        unsigned const src_y = dst_y*src.height()/dst.height();
-        for (unsigned dst_x = 0; dst_x < dst.width(); ++dst_x) {
-            unsigned const src_x = dst_x*src.width()/dst.width();
-            dst.set(dst_x,dst_y,src.get(src_x,src_y));
-        }
-    }
-    return;
-}
-encoder::encoder(int width, int height, int fps, int quality) {
+encoder::encoder(int width, int height, theorize::frame_region const& picture,
+    int fps, int quality, theorize::pixel_format format)
+{
     th_info info = {};
     th_info_init(&info);
     info.frame_width = width;
     info.frame_height = height;
-    info.pic_width = width;
-    info.pic_height = height;
-    info.pic_x = 0;
-    info.pic_y = 0;
+    info.pic_width = picture.width;
+    info.pic_height = picture.height;
+    info.pic_x = picture.x;
+    info.pic_y = picture.y;
     info.colorspace = TH_CS_ITU_REC_470M;
-    info.pixel_fmt = TH_PF_444;
+    switch (format) {
+    case theorize::pixel_format::yuv420:
+        info.pixel_fmt = TH_PF_420;
+        break;
+    case theorize::pixel_format::yuv422:
+        info.pixel_fmt = TH_PF_422;
+        break;
+    default:
+        info.pixel_fmt = TH_PF_444;
+        break;
+    }
     //info.target_bitrate = 0;
     if (quality >= 0)
         info.quality = quality;
@@ -132,6 +137,11 @@ int main(int argc, char**argv)
     int height = 480;
     int fps = 30;
     int quality = -1;
+    int threads = 1;
+    int lookahead = 0;
+    theorize::pixel_format format = theorize::pixel_format::yuv444;
+    theorize::scale_filter filter = theorize::scale_filter::nearest;
+    theorize::fit_mode fit = theorize::fit_mode::stretch;
     int result = EXIT_SUCCESS;
     std::unique_ptr<std::ifstream> input_ptr;
     if (argc > 1) {
@@ -178,6 +188,50 @@ int main(int argc, char**argv)
                 fps = std::stoi(value);
             else if (key == "quality")
                 quality = std::stoi(value);
+            else if (key == "threads")
+                threads = std::stoi(value);
+            else if (key == "lookahead")
+                lookahead = std::stoi(value);
+            else if (key == "pixel_format") {
+                if (value == "420")
+                    format = theorize::pixel_format::yuv420;
+                else if (value == "422")
+                    format = theorize::pixel_format::yuv422;
+                else if (value == "444")
+                    format = theorize::pixel_format::yuv444;
+                else {
+                    std::cerr << lineno << ": warning: unknown pixel"
+                        " format \"" << value << "\"; ignoring\n";
+                }
+            } else if (key == "scaler") {
+                if (value == "nearest")
+                    filter = theorize::scale_filter::nearest;
+                else if (value == "bilinear")
+                    filter = theorize::scale_filter::bilinear;
+                else if (value == "bicubic")
+                    filter = theorize::scale_filter::bicubic;
+                else if (value == "lanczos")
+                    filter = theorize::scale_filter::lanczos;
+                else if (value == "area")
+                    filter = theorize::scale_filter::area;
+                else {
+                    std::cerr << lineno << ": warning: unknown scaler \""
+                        << value << "\"; ignoring\n";
+                }
+            } else if (key == "fit") {
+                if (value == "stretch")
+                    fit = theorize::fit_mode::stretch;
+                else if (value == "letterbox")
+                    fit = theorize::fit_mode::letterbox;
+                else if (value == "crop")
+                    fit = theorize::fit_mode::crop;
+                else if (value == "none")
+                    fit = theorize::fit_mode::none;
+                else {
+                    std::cerr << lineno << ": warning: unknown fit \""
+                        << value << "\"; ignoring\n";
+                }
+            }
         }
     }
     if (fps <= 0) {
@@ -192,6 +246,31 @@ int main(int argc, char**argv)
         std::cerr << "error: height must be positive\n";
         return EXIT_FAILURE;
     }
+    if (threads < 0) {
+        std::cerr << "error: threads must not be negative\n";
+        return EXIT_FAILURE;
+    } else if (threads == 0) {
+        threads = static_cast<int>(std::thread::hardware_concurrency());
+        if (threads <= 0)
+            threads = 1;
+    }
+    if (lookahead < 0) {
+        std::cerr << "error: lookahead must not be negative\n";
+        return EXIT_FAILURE;
+    } else if (lookahead == 0) {
+        lookahead = threads > 1 ? threads*2 : 1;
+    }
+    // Theora frames come in whole 16x16 macroblocks; the picture
+    //   region sits centered inside, on even offsets for the sake of
+    //   subsampled chroma
+    int const frame_width = (width+15) & ~15;
+    int const frame_height = (height+15) & ~15;
+    theorize::frame_region const picture = {
+        static_cast<unsigned int>((frame_width-width)/2) & ~1u,
+        static_cast<unsigned int>((frame_height-height)/2) & ~1u,
+        static_cast<unsigned int>(width),
+        static_cast<unsigned int>(height)
+    };
     // acquire frames
     {
         std::ofstream out(output_path, std::ios::out | std::ios::binary);
@@ -200,7 +279,7 @@ int main(int argc, char**argv)
                 << output_path << std::endl;
             return EXIT_FAILURE;
         }
-        encoder enc(width, height, fps, quality);
+        encoder enc(frame_width, frame_height, picture, fps, quality, format);
         if (!enc) {
             return EXIT_FAILURE;
         }
@@ -220,57 +299,91 @@ int main(int argc, char**argv)
             if (!write_packet(out, pack, packet))
                 return EXIT_FAILURE;
         }
+        struct pending_frame {
+            std::size_t lineno;
+            int repeat_count;
+        };
         std::string file_path;
         int repeat_count = 1;
-        theorize::ycbcr_box box;
-        theorize::ycbcr_box frame;
-        frame.resize(width, height);
+        std::deque<pending_frame> pending;
+        theorize::band_runner bands;
+        theorize::frame_pool pool(threads, lookahead,
+            [frame_width,frame_height,picture,format,filter,fit,&bands]
+                (std::string const& path,
+                theorize::ycbcr_box& box, theorize::ycbcr_box& frame)
+            {
+                // placers and readers hold per-image state, so each
+                //   worker thread keeps its own
+                thread_local theorize::frame_placer placer(picture, fit,
+                    filter, bands);
+                thread_local theorize::pngycc_reader reader;
+                frame.resize(frame_width, frame_height, format);
+                placer.set_frame(frame);
+                // decode, convert and scale a row at a time; `box` only
+                //   gets used for interlaced images
+                return reader.read(path.c_str(), placer, box);
+            });
+        bands = [&pool](std::size_t count,
+            std::function<void(std::size_t)> const& fn)
+        {
+            pool.for_each_band(count, fn);
+        };
         th_ycbcr_buffer frame_source;
-        frame_source[0].width = width;
-        frame_source[0].height = height;
-        frame_source[0].stride = frame.width();
-        frame_source[0].data = frame.y_plane();
-        frame_source[1].width = width;
-        frame_source[1].height = height;
-        frame_source[1].stride = frame.width();
-        frame_source[1].data = frame.cb_plane();
-        frame_source[2].width = width;
-        frame_source[2].height = height;
-        frame_source[2].stride = frame.width();
-        frame_source[2].data = frame.cr_plane();
-        while (getline(input, file_path)) {
-            lineno += 1;
-            if (file_path.empty()
-            ||  file_path.front() == '#')
-                continue;
-            else if (file_path.front() == '*') {
-                repeat_count = std::stoi(file_path.substr(1));
-                continue;
-            }
-            // read frame
-            bool const ok = theorize::pngycc_read(file_path.c_str(), box);
+        auto const encode_next = [&]() -> bool {
+            pending_frame const next = pending.front();
+            pending.pop_front();
+            std::unique_ptr<theorize::ycbcr_box> frame;
+            bool const ok = pool.take(frame);
             if (!ok) {
-                std::cerr << lineno << ": error: failed to load frame";
-                frame.grey();
+                std::cerr << next.lineno
+                    << ": error: failed to load frame\n";
             }
-            // resize frame
-            scale(frame, box);
-            for (int i = 0; i < repeat_count; ++i) {
+            theorize::plane_view const planes[3] =
+                { frame->y_view(), frame->cb_view(), frame->cr_view() };
+            for (int i = 0; i < 3; ++i) {
+                frame_source[i].width = planes[i].width();
+                frame_source[i].height = planes[i].height();
+                frame_source[i].stride = planes[i].stride();
+                frame_source[i].data = planes[i].data();
+            }
+            for (int i = 0; i < next.repeat_count; ++i) {
                 th_encode_ycbcr_in(enc, frame_source);
                 last = 1;
                 while (last) {
                     last = th_encode_packetout(enc, false, &packet);
                     if (last == TH_EFAULT) {
-                        std::cerr << lineno << ":error: EFAULT encountered "
-                            "during frame generation\n";
-                        return EXIT_FAILURE;
+                        std::cerr << next.lineno << ":error: EFAULT "
+                            "encountered during frame generation\n";
+                        return false;
                     } else if (last) {
                         if (!write_packet(out, pack, packet))
-                            return EXIT_FAILURE;
+                            return false;
                     }
                 }
             }
+            pool.recycle(std::move(frame));
+            return true;
+        };
+        while (getline(input, file_path)) {
+            lineno += 1;
+            if (file_path.empty()
+            ||  file_path.front() == '#')
+                continue;
+            else if (file_path.front() == '*') {
+                repeat_count = std::stoi(file_path.substr(1));
+                continue;
+            }
+            // queue up the frame, then encode the oldest once the
+            //   lookahead window fills up
+            pool.submit(file_path);
+            pending.push_back(pending_frame{lineno, repeat_count});
             repeat_count = 1;
+            if (pool.full() && !encode_next())
+                return EXIT_FAILURE;
+        }
+        while (!pending.empty()) {
+            if (!encode_next())
+                return EXIT_FAILURE;
         }
         // output last packets
         last = 1;
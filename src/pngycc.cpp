@@ -1,57 +1,75 @@
-
 #include "pngycc.hpp"
 #include "yccbox.hpp"
+#include "rgbycc.hpp"
 #include "../deps/png-parts/src/api.h"
 #include "../deps/png-parts/src/auxi.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <new>
-#include <cmath>
+#include <vector>
 
 namespace theorize {
-    struct pngycc_gamma
-    {
-        double alpha;
-        double beta;
-        double delta;
-        double epsilon;
-    };
-    struct pngycc_prime
-    {
-        double red;
-        double green;
-        double blue;
+    /**
+     * Where a PNG stream comes from.
+     */
+    struct pngycc_source {
+        /* file to read, or null to read `data` */
+        char const* path;
+        /* PNG stream in memory */
+        void const* data;
+        std::size_t size;
+        /* reader session, or null for a fresh one */
+        pngparts_aux_reader* session;
     };
-    struct pngycc_ypbpr
-    {
-        double y;
-        double pb;
-        double pr;
-    };
-    struct pngycc_defrac_channel
-    {
-        double offset;
-        double excursion;
-    };
-    struct pngycc_defrac
-    {
-        pngycc_defrac_channel y;
-        pngycc_defrac_channel cb;
-        pngycc_defrac_channel cr;
-    };
-    struct pngycc_kappa
-    {
-        constexpr pngycc_kappa(double r, double b)
-            : kr(r), kb(b),
-            two_m_2kr(2.0*(1.0-r)), two_m_2kb(2.0*(1.0-b)),
-            frac_kr(r/(1.0-(b+r))), frac_kb(b/(1.0-(r+b)))
-        {
-        }
-        double kr;
-        double kb;
-        double two_m_2kr;
-        double two_m_2kb;
-        double frac_kr;
-        double frac_kb;
+    /**
+     * Reader state shared by the image callbacks.
+     */
+    struct pngycc_state {
+        /* box for whole images */
+        ycbcr_box* box;
+        /* sink for rows, or null to read into `box` */
+        ycbcr_row_sink* sink;
+        /* the row being decoded, as 8-bit red, green and blue */
+        std::vector<unsigned char> rgb;
+        /* size of what goes to `box` or the sink */
+        unsigned int width;
+        unsigned int height;
+        /* rows handed to the sink so far */
+        unsigned int sent;
+        /* whether the image goes into `box` whole */
+        bool whole;
+        /* whether `box` already holds YCbCr */
+        bool converted;
+        /* whether the chroma is in place already, leaving only luma */
+        bool flat;
+        /* layout of rows for `pngycc_put_row`: bits per sample,
+         * samples per pixel, and the factor that brings sub-byte grey
+         * levels to eight bits */
+        unsigned int sample_depth;
+        unsigned int sample_stride;
+        unsigned int sample_scale;
+        /* last Adam7 pass to decode, and the spacing of its pixels */
+        int last_pass;
+        unsigned int shift_x;
+        unsigned int shift_y;
+        /* rows the sink wants, or null for all */
+        unsigned char const* rows;
+        /* flags for the columns the sink wants, or empty for all */
+        std::vector<unsigned char> mask;
+        /* place of each wanted column in `rgb` */
+        std::vector<std::uint32_t> slots;
+        /* the wanted columns, or null for all */
+        std::uint32_t const* columns;
+        /* palette as red, green and blue */
+        unsigned char palette_rgb[256*3];
+        /* Y, Cb and Cr of each palette index or grey level */
+        unsigned char table[3][256];
+        bool table_ready;
+        /* `table` indices of one row */
+        std::vector<unsigned char> indices;
     };
+
     static
     int pngycc_start
         ( void* img, long int width, long int height, short bit_depth,
@@ -61,14 +79,51 @@ namespace theorize {
         ( void* img, long int x, long int y,
           unsigned int red, unsigned int green, unsigned int blue,
           unsigned int alpha);
+    /*
+     * Set up `table` and the chroma for a greyscale image.
+     * - state reader state after `begin` or the box resize
+     * @throw std::bad_alloc on allocation failure
+     */
+    static
+    void pngycc_grey(pngycc_state& state, unsigned int width,
+        unsigned int height);
+    /*
+     * - state reader state
+     * - row packed samples from `pngycc_put_row`
+     * - i pixel position in the row
+     * @return the `table` index of the pixel
+     */
+    static
+    unsigned int pngycc_sample(pngycc_state const& state,
+        unsigned char const* row, std::size_t i) noexcept;
+    static
+    void pngycc_put_plte
+        ( void* img, int index, unsigned int red, unsigned int green,
+          unsigned int blue, unsigned int alpha);
+    static
+    void pngycc_put_row
+        ( void* img, int pass, long int y, long int x, long int x_stride,
+          unsigned long int width, unsigned char const* row);
+    static
+    int pngycc_want
+        ( void* img, int pass, long int y, long int x, long int x_stride,
+          unsigned long int width, unsigned char const** mask);
     static
-    double pngycc_apply_gamma(pngycc_gamma const& gamma, long int channel);
+    void pngycc_interlace(pngycc_state& state,
+        unsigned int width, unsigned int height) noexcept;
     static
-    pngycc_ypbpr pngycc_to_ypbpr(pngycc_kappa const& kappa,
-        pngycc_prime const& prime);
+    void pngycc_select(pngycc_state& state, unsigned int width);
     static
-    unsigned char pngycc_runout(pngycc_defrac_channel const& defrac,
-        double channel);
+    void pngycc_send(pngycc_state& state, unsigned int end) noexcept;
+    static
+    void pngycc_convert(pngycc_state& state) noexcept;
+    static
+    bool pngycc_decode(pngycc_source const& source, pngycc_state& state);
+    static
+    bool pngycc_read_box(pngycc_source const& source, ycbcr_box& output);
+    static
+    bool pngycc_read_sink(pngycc_source const& source,
+        ycbcr_row_sink& sink, ycbcr_box& spare);
 
     //BEGIN pngycc / static
     int pngycc_start
@@ -80,8 +135,48 @@ namespace theorize {
         ||  width < 0 || height < 0)
             return PNGPARTS_API_BAD_PARAM;
         else try {
-            ycbcr_box& box = *static_cast<ycbcr_box*>(img);
-            box.resize(width, height);
+            pngycc_state& state = *static_cast<pngycc_state*>(img);
+            unsigned int const w = static_cast<unsigned int>(width);
+            unsigned int const h = static_cast<unsigned int>(height);
+            state.sent = 0;
+            state.whole = (state.sink == nullptr || interlace != 0);
+            state.last_pass = 7;
+            state.shift_x = 0;
+            state.shift_y = 0;
+            state.rows = nullptr;
+            state.columns = nullptr;
+            state.converted = false;
+            state.flat = false;
+            state.sample_depth = static_cast<unsigned int>(bit_depth);
+            state.sample_stride = (color_type == 4) ? 2u : 1u;
+            state.sample_scale = 1u;
+            if (color_type == 3) {
+                std::memset(state.palette_rgb, 0, sizeof(state.palette_rgb));
+                state.table_ready = false;
+            }
+            if (state.whole) {
+                if (state.sink != nullptr)
+                    pngycc_interlace(state, w, h);
+                state.width = (w + (1u << state.shift_x) - 1u)
+                    >> state.shift_x;
+                state.height = (h + (1u << state.shift_y) - 1u)
+                    >> state.shift_y;
+                state.box->resize(state.width, state.height,
+                    pixel_format::yuv444);
+            } else {
+                state.height = h;
+            }
+            if ((color_type & 3) == 0)
+                pngycc_grey(state, w, h);
+            else if (state.whole)
+                state.box->forget_chroma();
+            else
+                state.sink->begin(w, h);
+            if (!state.whole)
+                pngycc_select(state, w);
+            state.rgb.assign(static_cast<std::size_t>(state.width)*3u, 0);
+            if ((color_type & 1) == 1 || (color_type & 3) == 0)
+                state.indices.resize(state.width);
         } catch(const std::bad_alloc&) {
             return PNGPARTS_API_MEMORY;
         }
@@ -93,62 +188,349 @@ namespace theorize {
           unsigned int red, unsigned int green, unsigned int blue,
           unsigned int alpha)
     {
-        constexpr pngycc_gamma gamma = {4.5,0.45,0.018,0.099};
-        constexpr pngycc_kappa kappa = {0.299,0.114};
-        constexpr pngycc_defrac defrac = {
-            {16.0,219.0}, {128.0,224.0}, {128.0,224.0}
-        };
-        ycbcr_box& box = *static_cast<ycbcr_box*>(img);
-        pngycc_prime const prime = {
-            pngycc_apply_gamma(gamma, red),
-            pngycc_apply_gamma(gamma, green),
-            pngycc_apply_gamma(gamma, blue)
-        };
-        pngycc_ypbpr const ypbpr = pngycc_to_ypbpr(kappa, prime);
-        ycbcr const value = {
-            pngycc_runout(defrac.y, ypbpr.y),
-            pngycc_runout(defrac.cb, ypbpr.pb),
-            pngycc_runout(defrac.cr, ypbpr.pr)
-        };
-        box.set(x,y,value);
+        pngycc_state& state = *static_cast<pngycc_state*>(img);
+        if (state.whole) {
+            /* hold the color in place until the image is complete */
+            ycbcr_row_view const row = state.box->row(y >> state.shift_y);
+            long int const i = x >> state.shift_x;
+            row.y[i] = static_cast<unsigned char>(red);
+            row.cb[i] = static_cast<unsigned char>(green);
+            row.cr[i] = static_cast<unsigned char>(blue);
+            return;
+        }
+        if (static_cast<unsigned long int>(y) != state.sent)
+            pngycc_send(state, static_cast<unsigned int>(y));
+        std::size_t const i = state.slots.empty() ? x : state.slots[x];
+        unsigned char* const out = state.rgb.data() + i*3u;
+        out[0] = static_cast<unsigned char>(red);
+        out[1] = static_cast<unsigned char>(green);
+        out[2] = static_cast<unsigned char>(blue);
         return;
     }
 
-    inline
-    double pngycc_apply_gamma(pngycc_gamma const& gamma, long int channel) {
-        return (channel < gamma.delta*255)
-            ? channel*gamma.alpha/255.0
-            : (1+gamma.epsilon)*std::pow(channel/255.0, gamma.beta) - gamma.epsilon;
+    void pngycc_grey(pngycc_state& state, unsigned int width,
+        unsigned int height)
+    {
+        /* 255 divided by the largest level at each depth */
+        static unsigned char const scale[9] = {0, 255, 85, 0, 17, 0, 0, 0, 1};
+        if (state.sample_depth < 8)
+            state.sample_scale = scale[state.sample_depth];
+        unsigned char ramp[256*3];
+        for (unsigned int i = 0; i < 256u; ++i) {
+            ramp[i*3+0] = static_cast<unsigned char>(i);
+            ramp[i*3+1] = static_cast<unsigned char>(i);
+            ramp[i*3+2] = static_cast<unsigned char>(i);
+        }
+        rgbycc_row(ramp, 3, 256, state.table[0], state.table[1],
+            state.table[2]);
+        state.table_ready = true;
+        unsigned char const cb = state.table[1][0];
+        unsigned char const cr = state.table[2][0];
+        state.flat = true;
+        for (unsigned int i = 1; i < 256u; ++i) {
+            if (state.table[1][i] != cb || state.table[2][i] != cr)
+                state.flat = false;
+        }
+        /* fill the chroma once here, so that rows need only luma */
+        if (state.whole) {
+            if (state.flat)
+                state.box->fill_chroma(cb, cr);
+            else
+                state.box->forget_chroma();
+        } else if (!state.flat || !state.sink->begin_flat(width, height,
+            cb, cr))
+        {
+            state.flat = false;
+            state.sink->begin(width, height);
+        }
+        return;
     }
 
-    inline
-    pngycc_ypbpr pngycc_to_ypbpr(pngycc_kappa const& kappa,
-        pngycc_prime const& prime)
+    unsigned int pngycc_sample(pngycc_state const& state,
+        unsigned char const* row, std::size_t i) noexcept
     {
-        double const y = (prime.green + prime.red*kappa.frac_kr
-            + prime.blue*kappa.frac_kb)/(1.0 + kappa.frac_kr + kappa.frac_kb);
-        return pngycc_ypbpr{y, (prime.blue-y)/kappa.two_m_2kb,
-            (prime.red-y)/kappa.two_m_2kr};
+        unsigned int const depth = state.sample_depth;
+        std::size_t const at = i*state.sample_stride;
+        if (depth == 8)
+            return row[at];
+        else if (depth == 16)
+            return rgbycc_narrow16((row[at*2] << 8) | row[at*2+1]);
+        std::size_t const bit = at*depth;
+        return ((row[bit >> 3] >> (8u - depth - (bit & 7u)))
+            & ((1u << depth) - 1u)) * state.sample_scale;
     }
 
-    inline
-    unsigned char pngycc_runout(pngycc_defrac_channel const& defrac,
-        double channel)
+    void pngycc_put_plte
+        ( void* img, int index, unsigned int red, unsigned int green,
+          unsigned int blue, unsigned int /*alpha*/)
     {
-        double const pre = defrac.excursion*channel + defrac.offset;
-        return pre < 0.0 ? 0u : (pre > 255.0
-            ? 255u : static_cast<unsigned char>(pre)); 
+        pngycc_state& state = *static_cast<pngycc_state*>(img);
+        unsigned char* const out = state.palette_rgb + index*3;
+        out[0] = static_cast<unsigned char>(red);
+        out[1] = static_cast<unsigned char>(green);
+        out[2] = static_cast<unsigned char>(blue);
+        state.table_ready = false;
+        return;
     }
-    //END   pngycc / static
 
-    //BEGIN pngycc / namespace-local
-    bool pngycc_read(char const* path, ycbcr_box& output) {
+    void pngycc_put_row
+        ( void* img, int /*pass*/, long int y, long int x, long int x_stride,
+          unsigned long int width, unsigned char const* row)
+    {
+        pngycc_state& state = *static_cast<pngycc_state*>(img);
+        unsigned int const planes = state.flat ? 1u : 3u;
+        if (!state.table_ready) {
+            /* at most 256 colors, so convert those instead of pixels */
+            rgbycc_row(state.palette_rgb, 3, 256, state.table[0],
+                state.table[1], state.table[2]);
+            state.table_ready = true;
+        }
+        if (state.whole) {
+            ycbcr_row_view const out = state.box->row(y >> state.shift_y);
+            unsigned char* const dst[3] = { out.y, out.cb, out.cr };
+            for (unsigned long int i = 0; i < width; ++i, x += x_stride) {
+                unsigned int const index = pngycc_sample(state, row, i);
+                long int const at = x >> state.shift_x;
+                for (unsigned int p = 0; p < planes; ++p)
+                    dst[p][at] = state.table[p][index];
+            }
+            state.converted = true;
+            return;
+        }
+        if (static_cast<unsigned long int>(y) != state.sent)
+            pngycc_send(state, static_cast<unsigned int>(y));
+        /* gather the wanted indices, unless the row already is that */
+        unsigned char const* indices = row;
+        if (state.sample_depth != 8 || state.sample_stride != 1
+        ||  state.columns != nullptr)
+        {
+            unsigned char* const out = state.indices.data();
+            for (unsigned int i = 0; i < state.width; ++i) {
+                std::size_t const from =
+                    state.columns != nullptr ? state.columns[i] : i;
+                out[i] = static_cast<unsigned char>(
+                    pngycc_sample(state, row, from));
+            }
+            indices = out;
+        }
+        ycbcr_row_view const out = state.sink->row_buffer(state.sent);
+        unsigned char* const dst[3] = { out.y, out.cb, out.cr };
+        for (unsigned int p = 0; p < planes; ++p) {
+            unsigned char const* const table = state.table[p];
+            for (unsigned int i = 0; i < state.width; ++i)
+                dst[p][i] = table[indices[i]];
+        }
+        state.sink->put_row(state.sent);
+        state.sent += 1;
+        return;
+    }
+
+    int pngycc_want
+        ( void* img, int pass, long int y, long int /*x*/,
+          long int /*x_stride*/, unsigned long int /*width*/,
+          unsigned char const** mask)
+    {
+        pngycc_state& state = *static_cast<pngycc_state*>(img);
+        if (pass > state.last_pass)
+            return PNGPARTS_API_IMAGE_WANT_DONE;
+        else if (state.whole)
+            return PNGPARTS_API_IMAGE_WANT_ALL;
+        else if (state.rows != nullptr && !state.rows[y])
+            return PNGPARTS_API_IMAGE_WANT_NONE;
+        else if (state.mask.empty())
+            return PNGPARTS_API_IMAGE_WANT_ALL;
+        *mask = state.mask.data();
+        return PNGPARTS_API_IMAGE_WANT_SOME;
+    }
+
+    void pngycc_interlace(pngycc_state& state,
+        unsigned int width, unsigned int height) noexcept
+    {
+        /* log2 of the pixel spacing left after each Adam7 pass */
+        static unsigned char const pass_shift[7][2] = {
+            {3, 3}, {2, 3}, {2, 2}, {1, 2}, {1, 1}, {0, 1}, {0, 0}
+        };
+        unsigned int step_x, step_y;
+        state.sink->sample_step(width, height, step_x, step_y);
+        for (int pass = 0; pass < 7; ++pass) {
+            if ((1u << pass_shift[pass][0]) <= step_x
+            &&  (1u << pass_shift[pass][1]) <= step_y)
+            {
+                state.last_pass = pass+1;
+                state.shift_x = pass_shift[pass][0];
+                state.shift_y = pass_shift[pass][1];
+                break;
+            }
+        }
+        return;
+    }
+
+    void pngycc_select(pngycc_state& state, unsigned int width) {
+        unsigned int count;
+        std::uint32_t const* const columns =
+            state.sink->wanted_columns(count);
+        state.rows = state.sink->wanted_rows();
+        state.columns = columns;
+        if (columns == nullptr) {
+            state.width = width;
+            state.mask.clear();
+            state.slots.clear();
+            return;
+        }
+        state.width = count;
+        state.mask.assign(width, 0);
+        state.slots.assign(width, 0);
+        for (unsigned int i = 0; i < count; ++i) {
+            state.mask[columns[i]] = 1;
+            state.slots[columns[i]] = i;
+        }
+        return;
+    }
+
+    void pngycc_send(pngycc_state& state, unsigned int end) noexcept {
+        /* rows with no pixels at all repeat the last row */
+        for (; state.sent < end; ++state.sent) {
+            if (state.rows != nullptr && !state.rows[state.sent])
+                continue;
+            ycbcr_row_view const out = state.sink->row_buffer(state.sent);
+            rgbycc_row(state.rgb.data(), 3, state.width,
+                out.y, out.cb, out.cr);
+            state.sink->put_row(state.sent);
+        }
+        return;
+    }
+
+    void pngycc_convert(pngycc_state& state) noexcept {
+        unsigned char* const rgb = state.rgb.data();
+        for (unsigned int y = 0; y < state.height; ++y) {
+            ycbcr_row_view const row = state.box->row(y);
+            for (unsigned int x = 0; x < state.width; ++x) {
+                rgb[x*3+0] = row.y[x];
+                rgb[x*3+1] = row.cb[x];
+                rgb[x*3+2] = row.cr[x];
+            }
+            rgbycc_row(rgb, 3, state.width, row.y, row.cb, row.cr);
+        }
+        return;
+    }
+
+    bool pngycc_decode(pngycc_source const& source, pngycc_state& state) {
         pngparts_api_image img;
-        img.cb_data = &output;
+        img.cb_data = &state;
         img.start_cb = pngycc_start;
         img.put_cb = pngycc_put;
-        int const result = pngparts_aux_read_png_8(&img, path);
-        return result == PNGPARTS_API_OK;
+        img.put_row_cb = pngycc_put_row;
+        img.want_cb = pngycc_want;
+        img.put_plte_cb = pngycc_put_plte;
+        img.flags = PNGPARTS_API_IMAGE_ROW_PALETTE
+            | PNGPARTS_API_IMAGE_ROW_GREY;
+        int result;
+        if (source.session != nullptr) {
+            result = (source.path != nullptr)
+                ? pngparts_aux_reader_read_png_8(source.session, &img,
+                    source.path)
+                : pngparts_aux_reader_read_png_mem_8(source.session, &img,
+                    source.data, source.size);
+        } else {
+            result = (source.path != nullptr)
+                ? pngparts_aux_read_png_8(&img, source.path)
+                : pngparts_aux_read_png_mem_8(&img, source.data, source.size);
+        }
+        if (result != PNGPARTS_API_OK)
+            return false;
+        else if (!state.whole)
+            pngycc_send(state, state.height);
+        else if (!state.converted)
+            pngycc_convert(state);
+        return true;
+    }
+
+    bool pngycc_read_box(pngycc_source const& source, ycbcr_box& output) {
+        pngycc_state state = {};
+        state.box = &output;
+        state.sink = nullptr;
+        try {
+            return pngycc_decode(source, state);
+        } catch (const std::bad_alloc&) {
+            return false;
+        }
+    }
+
+    bool pngycc_read_sink(pngycc_source const& source,
+        ycbcr_row_sink& sink, ycbcr_box& spare)
+    {
+        pngycc_state state = {};
+        state.box = &spare;
+        state.sink = &sink;
+        try {
+            if (!pngycc_decode(source, state))
+                return false;
+            else if (state.whole)
+                sink.put_frame(spare);
+            return true;
+        } catch (const std::bad_alloc&) {
+            return false;
+        }
+    }
+    //END   pngycc / static
+
+    //BEGIN pngycc / namespace-local
+    bool pngycc_read(char const* path, ycbcr_box& output) {
+        pngycc_source const source = { path, nullptr, 0, nullptr };
+        return pngycc_read_box(source, output);
+    }
+    bool pngycc_read(char const* path, ycbcr_row_sink& sink,
+        ycbcr_box& spare)
+    {
+        pngycc_source const source = { path, nullptr, 0, nullptr };
+        return pngycc_read_sink(source, sink, spare);
+    }
+    bool pngycc_read(void const* data, std::size_t size,
+        ycbcr_box& output)
+    {
+        pngycc_source const source = { nullptr, data, size, nullptr };
+        return pngycc_read_box(source, output);
+    }
+    bool pngycc_read(void const* data, std::size_t size,
+        ycbcr_row_sink& sink, ycbcr_box& spare)
+    {
+        pngycc_source const source = { nullptr, data, size, nullptr };
+        return pngycc_read_sink(source, sink, spare);
     }
     //END   pngycc / namespace-local
-}
\ No newline at end of file
+
+    //BEGIN pngycc_reader / rule-of-six
+    pngycc_reader::pngycc_reader() noexcept
+        : session(pngparts_aux_reader_new())
+    {
+    }
+    pngycc_reader::~pngycc_reader() {
+        pngparts_aux_reader_free(session);
+    }
+    //END   pngycc_reader / rule-of-six
+
+    //BEGIN pngycc_reader / public
+    bool pngycc_reader::read(char const* path, ycbcr_box& output) {
+        pngycc_source const source = { path, nullptr, 0, session };
+        return pngycc_read_box(source, output);
+    }
+    bool pngycc_reader::read(char const* path, ycbcr_row_sink& sink,
+        ycbcr_box& spare)
+    {
+        pngycc_source const source = { path, nullptr, 0, session };
+        return pngycc_read_sink(source, sink, spare);
+    }
+    bool pngycc_reader::read(void const* data, std::size_t size,
+        ycbcr_box& output)
+    {
+        pngycc_source const source = { nullptr, data, size, session };
+        return pngycc_read_box(source, output);
+    }
+    bool pngycc_reader::read(void const* data, std::size_t size,
+        ycbcr_row_sink& sink, ycbcr_box& spare)
+    {
+        pngycc_source const source = { nullptr, data, size, session };
+        return pngycc_read_sink(source, sink, spare);
+    }
+    //END   pngycc_reader / public
+}
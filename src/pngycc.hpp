@@ -4,14 +4,84 @@
 #if !(defined hg_Theorize_PngYCbCr_h_)
 #define hg_Theorize_PngYCbCr_h_
 
+#include <cstddef>
+
+struct pngparts_aux_reader;
+
 namespace theorize
 {
     class ycbcr_box;
+    class ycbcr_row_sink;
 
     /**
-     * \
+     * Read a PNG image into a 4:4:4 box.
+     * - path file to read
+     * - output destination box
+     * @return whether the image was read
      */
     bool pngycc_read(char const* path, ycbcr_box& output);
+    /**
+     * Read a PNG image, handing each row to a sink as soon as it is
+     * decoded, so the whole image never sits in memory at once.
+     * Rows and columns the sink does not want are neither converted
+     * nor stored. Interlaced images arrive out of row order; those get
+     * read into `spare` and go to the sink through `put_frame`
+     * instead, stopping after the first Adam7 pass that is dense
+     * enough for the sink's `sample_step`.
+     * - path file to read
+     * - sink destination for the rows
+     * - spare box for interlaced images
+     * @return whether the image was read
+     */
+    bool pngycc_read(char const* path, ycbcr_row_sink& sink,
+        ycbcr_box& spare);
+    /**
+     * Read a PNG image already in memory into a 4:4:4 box. The bytes
+     * are parsed where they are, without a copy.
+     * - data the PNG stream
+     * - size length of the stream in bytes
+     * - output destination box
+     * @return whether the image was read
+     */
+    bool pngycc_read(void const* data, std::size_t size,
+        ycbcr_box& output);
+    /**
+     * Read a PNG image already in memory, handing each row to a sink
+     * as soon as it is decoded; see the file version above.
+     * - data the PNG stream
+     * - size length of the stream in bytes
+     * - sink destination for the rows
+     * - spare box for interlaced images
+     * @return whether the image was read
+     */
+    bool pngycc_read(void const* data, std::size_t size,
+        ycbcr_row_sink& sink, ycbcr_box& spare);
+
+    /**
+     * PNG reader that keeps its parser, inflater and buffers from one
+     * image to the next. Reads work like the `pngycc_read` functions
+     * of the same form.
+     */
+    class pngycc_reader {
+    private:
+        /* the session, or null to read without one */
+        pngparts_aux_reader* session;
+    public:
+        /**
+         * Falls back to a fresh session per image if the reader
+         * cannot be allocated.
+         */
+        pngycc_reader() noexcept;
+        ~pngycc_reader();
+        pngycc_reader(pngycc_reader const&) = delete;
+        pngycc_reader& operator=(pngycc_reader const&) = delete;
+        bool read(char const* path, ycbcr_box& output);
+        bool read(char const* path, ycbcr_row_sink& sink,
+            ycbcr_box& spare);
+        bool read(void const* data, std::size_t size, ycbcr_box& output);
+        bool read(void const* data, std::size_t size,
+            ycbcr_row_sink& sink, ycbcr_box& spare);
+    };
 }
 
-#endif //hg_Theorize_PngYCbCr_h_
\ No newline at end of file
+#endif //hg_Theorize_PngYCbCr_h_
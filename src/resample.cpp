@@ -0,0 +1,613 @@
+#include "resample.hpp"
+#include "yccbox.hpp"
+#include "rgbycc.hpp"
+#include "subsample.hpp"
+#include <cmath>
+#include <cstring>
+
+#if (defined THEORIZE_NO_SIMD)
+#  define THEORIZE_RESAMPLE_X86 0
+#elif (defined __GNUC__) && ((defined __x86_64__) || (defined __i386__))
+#  define THEORIZE_RESAMPLE_X86 1
+#  include <immintrin.h>
+#  define THEORIZE_RESAMPLE_SSE2 __attribute__((target("sse2")))
+#else
+#  define THEORIZE_RESAMPLE_X86 0
+#endif //THEORIZE_NO_SIMD
+
+namespace theorize
+{
+    /**
+     * How one plane gets from source to destination.
+     */
+    enum class resample_mode {
+        /* straight copy */
+        copy,
+        /* integer-ratio area average, straight from the source */
+        area,
+        /* horizontal pass straight into the destination */
+        columns,
+        /* vertical pass straight from the source */
+        rows,
+        /* horizontal pass, then vertical pass */
+        both
+    };
+    struct resample_plane {
+        resample_mode mode;
+        rgbycc_kernel kernel;
+        unsigned int ratio;
+        const_plane_view src;
+        plane_view dst;
+        /* horizontal pass output */
+        plane_view between;
+        std::uint32_t const* column_start;
+        std::int16_t const* column_weights;
+        unsigned int column_taps;
+        std::uint32_t const* row_start;
+        std::int16_t const* row_weights;
+        unsigned int row_taps;
+        /* vertical pass input rows, the last repeated */
+        unsigned char const* const* source_rows;
+    };
+    struct resample_band {
+        unsigned int plane;
+        unsigned int begin;
+        unsigned int end;
+    };
+    /* rows to a band */
+    constexpr unsigned int resample_band_rows = 16u;
+    /* fraction bits in the filter weights */
+    constexpr int resample_shift = 14;
+
+    static
+    double resample_support(scale_filter f) noexcept;
+    static
+    double resample_weight(scale_filter f, double x) noexcept;
+    static
+    double resample_coverage(double j, double center, double half) noexcept;
+    static
+    unsigned char resample_clamp(std::int32_t acc) noexcept;
+    static
+    void resample_columns(resample_plane const& plane,
+        unsigned char const* in, unsigned char* out) noexcept;
+    static
+    void resample_rows(resample_plane const& plane,
+        unsigned char const* const* in, unsigned int y,
+        unsigned char* out) noexcept;
+    static
+    void resample_area(resample_plane const& plane,
+        unsigned char const* const* in, unsigned char* out) noexcept;
+    static
+    void resample_pass(std::vector<resample_band> const& bands,
+        std::function<void(resample_band const&)> const& fn,
+        band_runner const& run);
+#if THEORIZE_RESAMPLE_X86
+    static
+    void resample_sse2_columns(resample_plane const& plane,
+        unsigned char const* in, unsigned char* out) noexcept
+        THEORIZE_RESAMPLE_SSE2;
+    static
+    unsigned int resample_sse2_rows(resample_plane const& plane,
+        unsigned char const* const* in, unsigned int y,
+        unsigned char* out) noexcept THEORIZE_RESAMPLE_SSE2;
+#endif //THEORIZE_RESAMPLE_X86
+
+    //BEGIN resample / static
+    double resample_support(scale_filter f) noexcept {
+        switch (f) {
+        case scale_filter::bicubic:
+            return 2.0;
+        case scale_filter::lanczos:
+            return 3.0;
+        case scale_filter::area:
+            return 0.5;
+        default:
+            return 1.0;
+        }
+    }
+    double resample_weight(scale_filter f, double x) noexcept {
+        constexpr double pi = 3.14159265358979323846;
+        x = std::fabs(x);
+        switch (f) {
+        case scale_filter::bicubic:
+            {
+                constexpr double a = -0.5;
+                if (x < 1.0)
+                    return ((a+2.0)*x - (a+3.0))*x*x + 1.0;
+                else if (x < 2.0)
+                    return ((a*x - 5.0*a)*x + 8.0*a)*x - 4.0*a;
+                else
+                    return 0.0;
+            }
+        case scale_filter::lanczos:
+            if (x < 1e-9)
+                return 1.0;
+            else if (x < 3.0) {
+                return (std::sin(pi*x)/(pi*x))
+                    * (std::sin(pi*x/3.0)/(pi*x/3.0));
+            } else return 0.0;
+        default:
+            return x < 1.0 ? 1.0 - x : 0.0;
+        }
+    }
+    double resample_coverage(double j, double center, double half) noexcept {
+        double const left = (j > center-half) ? j : center-half;
+        double const right = (j+1.0 < center+half) ? j+1.0 : center+half;
+        return right > left ? right - left : 0.0;
+    }
+    inline
+    unsigned char resample_clamp(std::int32_t acc) noexcept {
+        std::int32_t const v =
+            (acc + (1 << (resample_shift-1))) >> resample_shift;
+        return static_cast<unsigned char>(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+    void resample_columns(resample_plane const& plane,
+        unsigned char const* in, unsigned char* out) noexcept
+    {
+        unsigned int const src_width = plane.src.width();
+        unsigned int const taps = plane.column_taps;
+#if THEORIZE_RESAMPLE_X86
+        if (src_width >= taps && plane.kernel >= rgbycc_kernel::sse2) {
+            resample_sse2_columns(plane, in, out);
+            return;
+        }
+#endif //THEORIZE_RESAMPLE_X86
+        for (unsigned int x = 0; x < plane.dst.width(); ++x) {
+            std::int16_t const* const w = plane.column_weights
+                + static_cast<std::size_t>(x)*taps;
+            std::int32_t acc = 0;
+            for (unsigned int k = 0; k < taps; ++k) {
+                unsigned int i = plane.column_start[x] + k;
+                if (i >= src_width)
+                    i = src_width-1;
+                acc += in[i]*w[k];
+            }
+            out[x] = resample_clamp(acc);
+        }
+        return;
+    }
+    void resample_rows(resample_plane const& plane,
+        unsigned char const* const* in, unsigned int y,
+        unsigned char* out) noexcept
+    {
+        unsigned int const taps = plane.row_taps;
+        std::int16_t const* const w = plane.row_weights
+            + static_cast<std::size_t>(y)*taps;
+        unsigned int x = 0;
+#if THEORIZE_RESAMPLE_X86
+        if (plane.kernel >= rgbycc_kernel::sse2)
+            x = resample_sse2_rows(plane, in, y, out);
+#endif //THEORIZE_RESAMPLE_X86
+        for (; x < plane.dst.width(); ++x) {
+            std::int32_t acc = 0;
+            for (unsigned int k = 0; k < taps; ++k)
+                acc += in[k][x]*w[k];
+            out[x] = resample_clamp(acc);
+        }
+        return;
+    }
+    void resample_area(resample_plane const& plane,
+        unsigned char const* const* in, unsigned char* out) noexcept
+    {
+        unsigned int const ratio = plane.ratio;
+        if (ratio == 2u) {
+            subsample_rows(in[0], in[1], plane.src.width(), out,
+                plane.kernel);
+            return;
+        }
+        unsigned int const half = ratio*ratio/2u;
+        for (unsigned int x = 0; x < plane.dst.width(); ++x) {
+            unsigned int sum = 0;
+            for (unsigned int j = 0; j < ratio; ++j) {
+                unsigned char const* const row = in[j] + x*ratio;
+                for (unsigned int i = 0; i < ratio; ++i)
+                    sum += row[i];
+            }
+            out[x] = static_cast<unsigned char>((sum + half)/(ratio*ratio));
+        }
+        return;
+    }
+    void resample_pass(std::vector<resample_band> const& bands,
+        std::function<void(resample_band const&)> const& fn,
+        band_runner const& run)
+    {
+        if (bands.empty())
+            return;
+        else if (run && bands.size() > 1) {
+            run(bands.size(), [&bands,&fn](std::size_t i) { fn(bands[i]); });
+        } else {
+            for (resample_band const& band : bands)
+                fn(band);
+        }
+        return;
+    }
+
+#if THEORIZE_RESAMPLE_X86
+    void resample_sse2_columns(resample_plane const& plane,
+        unsigned char const* in, unsigned char* out) noexcept
+    {
+        __m128i const zero = _mm_setzero_si128();
+        unsigned int const taps = plane.column_taps;
+        for (unsigned int x = 0; x < plane.dst.width(); ++x) {
+            std::int16_t const* const w = plane.column_weights
+                + static_cast<std::size_t>(x)*taps;
+            unsigned char const* const p = in + plane.column_start[x];
+            __m128i acc = zero;
+            for (unsigned int k = 0; k < taps; k += 8) {
+                __m128i const v = _mm_unpacklo_epi8(_mm_loadl_epi64(
+                    reinterpret_cast<__m128i const*>(p+k)), zero);
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(v, _mm_loadu_si128(
+                    reinterpret_cast<__m128i const*>(w+k))));
+            }
+            acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4e));
+            acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xb1));
+            out[x] = resample_clamp(_mm_cvtsi128_si32(acc));
+        }
+        return;
+    }
+    unsigned int resample_sse2_rows(resample_plane const& plane,
+        unsigned char const* const* in, unsigned int y,
+        unsigned char* out) noexcept
+    {
+        __m128i const zero = _mm_setzero_si128();
+        __m128i const round = _mm_set1_epi32(1 << (resample_shift-1));
+        unsigned int const taps = plane.row_taps;
+        std::int16_t const* const w = plane.row_weights
+            + static_cast<std::size_t>(y)*taps;
+        unsigned int x;
+        for (x = 0; x+16 <= plane.dst.width(); x += 16) {
+            __m128i acc[4] = { zero, zero, zero, zero };
+            for (unsigned int k = 0; k < taps; k += 2) {
+                __m128i const a = _mm_loadu_si128(
+                    reinterpret_cast<__m128i const*>(in[k]+x));
+                __m128i const b = _mm_loadu_si128(
+                    reinterpret_cast<__m128i const*>(in[k+1]+x));
+                __m128i const pair = _mm_set1_epi32(
+                    static_cast<std::int32_t>(
+                        (static_cast<std::uint32_t>(w[k+1]) << 16)
+                        | static_cast<std::uint16_t>(w[k])));
+                __m128i const lo = _mm_unpacklo_epi8(a, b);
+                __m128i const hi = _mm_unpackhi_epi8(a, b);
+                acc[0] = _mm_add_epi32(acc[0], _mm_madd_epi16(
+                    _mm_unpacklo_epi8(lo, zero), pair));
+                acc[1] = _mm_add_epi32(acc[1], _mm_madd_epi16(
+                    _mm_unpackhi_epi8(lo, zero), pair));
+                acc[2] = _mm_add_epi32(acc[2], _mm_madd_epi16(
+                    _mm_unpacklo_epi8(hi, zero), pair));
+                acc[3] = _mm_add_epi32(acc[3], _mm_madd_epi16(
+                    _mm_unpackhi_epi8(hi, zero), pair));
+            }
+            for (int n = 0; n < 4; ++n) {
+                acc[n] = _mm_srai_epi32(_mm_add_epi32(acc[n], round),
+                    resample_shift);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out+x),
+                _mm_packus_epi16(_mm_packs_epi32(acc[0], acc[1]),
+                    _mm_packs_epi32(acc[2], acc[3])));
+        }
+        return x;
+    }
+#endif //THEORIZE_RESAMPLE_X86
+    //END   resample / static
+
+    //BEGIN resampler / axis
+    resampler::axis::axis() noexcept
+        : src_size(0), dst_size(0), taps(0), pad(0),
+          filter(scale_filter::nearest)
+    {
+    }
+    void resampler::axis::prepare(scale_filter f, unsigned int src,
+        unsigned int dst, unsigned int multiple)
+    {
+        if (f == filter && src == src_size && dst == dst_size
+        &&  multiple == pad)
+            return;
+        double const ratio = static_cast<double>(src)/dst;
+        double const scale = ratio > 1.0 ? ratio : 1.0;
+        double const support = resample_support(f)*scale;
+        unsigned int const reach =
+            static_cast<unsigned int>(std::ceil(support))*2u + 1u;
+        std::vector<double> w(reach);
+        taps = (reach + multiple-1u)/multiple*multiple;
+        start.assign(dst, 0);
+        weights.assign(static_cast<std::size_t>(dst)*taps, 0);
+        for (unsigned int i = 0; i < dst; ++i) {
+            double const center = (i+0.5)*ratio;
+            long int lo = static_cast<long int>(std::floor(center-support));
+            long int hi = static_cast<long int>(std::ceil(center+support));
+            if (lo < 0)
+                lo = 0;
+            if (hi > static_cast<long int>(src))
+                hi = src;
+            if (hi - lo > static_cast<long int>(reach))
+                hi = lo + reach;
+            double total = 0.0;
+            for (long int j = lo; j < hi; ++j) {
+                double const v = (f == scale_filter::area)
+                    ? resample_coverage(j, center, support)
+                    : resample_weight(f, (j+0.5-center)/scale);
+                w[j-lo] = v;
+                total += v;
+            }
+            if (total == 0.0) {
+                /* no overlap at all; take the nearest sample */
+                lo = static_cast<long int>(center);
+                if (lo >= static_cast<long int>(src))
+                    lo = src-1;
+                hi = lo+1;
+                w[0] = total = 1.0;
+            }
+            /* round to fixed point, keeping the sum exact */
+            long int fit = lo;
+            if (fit + static_cast<long int>(taps) > static_cast<long int>(src))
+                fit = (src > taps) ? src - taps : 0;
+            std::int16_t* const q = weights.data()
+                + static_cast<std::size_t>(i)*taps + (lo-fit);
+            long int sum = 0;
+            long int best = 0;
+            for (long int j = 0; j < hi-lo; ++j) {
+                q[j] = static_cast<std::int16_t>(
+                    std::lround(w[j]/total*(1 << resample_shift)));
+                sum += q[j];
+                if (w[j] > w[best])
+                    best = j;
+            }
+            q[best] = static_cast<std::int16_t>(
+                q[best] + ((1 << resample_shift) - sum));
+            start[i] = static_cast<std::uint32_t>(fit);
+        }
+        filter = f;
+        src_size = src;
+        dst_size = dst;
+        pad = multiple;
+        return;
+    }
+    //END   resampler / axis
+
+    //BEGIN resampler / rule-of-six
+    resampler::resampler(scale_filter f) noexcept
+        : filter(f == scale_filter::nearest ? scale_filter::bilinear : f),
+          kernel(rgbycc_support()), src_width(0), src_height(0),
+          pushed(0), emitted{0, 0, 0}, planes(3)
+    {
+    }
+    resampler::resampler(scale_filter f, rgbycc_kernel k) noexcept
+        : filter(f == scale_filter::nearest ? scale_filter::bilinear : f),
+          kernel(k), src_width(0), src_height(0), pushed(0),
+          emitted{0, 0, 0}, planes(3)
+    {
+    }
+    //END   resampler / rule-of-six
+
+    //BEGIN resampler / private
+    void resampler::setup(resample_plane& plane, unsigned int p,
+        const_plane_view const& in, plane_view const& out)
+    {
+        unsigned int const sw = in.width();
+        unsigned int const sh = in.height();
+        unsigned int const dw = out.width();
+        unsigned int const dh = out.height();
+        axis& across = horizontal[p ? 1 : 0];
+        axis& down = vertical[p ? 1 : 0];
+        plane.src = in;
+        plane.dst = out;
+        plane.kernel = kernel;
+        plane.ratio = 0;
+        plane.source_rows = nullptr;
+        if (filter == scale_filter::area
+        &&  sw == dw*2u && sh == dh*2u)
+            plane.ratio = 2u;
+        else if (filter == scale_filter::area
+        &&  sw == dw*4u && sh == dh*4u)
+            plane.ratio = 4u;
+        if (plane.ratio)
+            plane.mode = resample_mode::area;
+        else if (sw == dw && sh == dh)
+            plane.mode = resample_mode::copy;
+        else if (sh == dh)
+            plane.mode = resample_mode::columns;
+        else if (sw == dw)
+            plane.mode = resample_mode::rows;
+        else
+            plane.mode = resample_mode::both;
+        if (plane.mode == resample_mode::columns
+        ||  plane.mode == resample_mode::both)
+        {
+            across.prepare(filter, sw, dw, 8u);
+            plane.column_start = across.start.data();
+            plane.column_weights = across.weights.data();
+            plane.column_taps = across.taps;
+        }
+        if (plane.mode == resample_mode::rows
+        ||  plane.mode == resample_mode::both)
+        {
+            down.prepare(filter, sh, dh, 2u);
+            plane.row_start = down.start.data();
+            plane.row_weights = down.weights.data();
+            plane.row_taps = down.taps;
+        }
+        return;
+    }
+    //END   resampler / private
+
+    //BEGIN resampler / public
+    void resampler::scale(ycbcr_box& dst, ycbcr_box& src,
+        band_runner const& run)
+    {
+        if (dst.width() == src.width() && dst.height() == src.height()
+        &&  dst.format() == src.format())
+        {
+            dst.swap(src);
+            dst.forget_border();
+            return;
+        }
+        dst.forget_border();
+        dst.forget_chroma();
+        scale(dst.view(), src.view(), run);
+        return;
+    }
+    void resampler::scale(ycbcr_view const& dst, const_ycbcr_view const& src,
+        band_runner const& run)
+    {
+        const_plane_view const in[3] = { src.y, src.cb, src.cr };
+        plane_view const out[3] = { dst.y, dst.cb, dst.cr };
+        resample_plane planes[3];
+        std::vector<resample_band> column_bands;
+        std::vector<resample_band> row_bands;
+        for (unsigned int p = 0; p < 3; ++p) {
+            resample_plane& plane = planes[p];
+            unsigned int const sh = in[p].height();
+            unsigned int const dw = out[p].width();
+            unsigned int const dh = out[p].height();
+            setup(plane, p, in[p], out[p]);
+            if (plane.mode == resample_mode::both) {
+                between[p].resize(static_cast<std::size_t>(dw)*sh);
+                plane.between = plane_view(between[p].data(), dw, sh, dw);
+            } else if (plane.mode == resample_mode::columns) {
+                plane.between = plane.dst;
+            }
+            if (plane.mode == resample_mode::area
+            ||  plane.mode == resample_mode::rows
+            ||  plane.mode == resample_mode::both)
+            {
+                /* every window stays in the table; past the bottom,
+                 * the last row repeats */
+                const_plane_view const source =
+                    (plane.mode == resample_mode::both)
+                    ? const_plane_view(plane.between) : plane.src;
+                unsigned int const extra =
+                    (plane.mode == resample_mode::area) ? 0 : plane.row_taps;
+                rows[p].resize(sh + extra);
+                for (unsigned int y = 0; y < sh + extra; ++y)
+                    rows[p][y] = source.row(y < sh ? y : sh-1);
+                plane.source_rows = rows[p].data();
+            }
+            if (plane.mode == resample_mode::columns
+            ||  plane.mode == resample_mode::both)
+            {
+                for (unsigned int y = 0; y < sh; y += resample_band_rows) {
+                    column_bands.push_back(resample_band{p, y,
+                        (sh-y > resample_band_rows) ? y+resample_band_rows : sh});
+                }
+            }
+            if (plane.mode != resample_mode::columns) {
+                for (unsigned int y = 0; y < dh; y += resample_band_rows) {
+                    row_bands.push_back(resample_band{p, y,
+                        (dh-y > resample_band_rows) ? y+resample_band_rows : dh});
+                }
+            }
+        }
+        resample_pass(column_bands, [&planes](resample_band const& band) {
+            resample_plane const& plane = planes[band.plane];
+            for (unsigned int y = band.begin; y < band.end; ++y)
+                resample_columns(plane, plane.src.row(y), plane.between.row(y));
+        }, run);
+        resample_pass(row_bands, [&planes](resample_band const& band) {
+            resample_plane const& plane = planes[band.plane];
+            for (unsigned int y = band.begin; y < band.end; ++y) {
+                switch (plane.mode) {
+                case resample_mode::copy:
+                    std::memcpy(plane.dst.row(y), plane.src.row(y),
+                        plane.dst.width());
+                    break;
+                case resample_mode::area:
+                    resample_area(plane, plane.source_rows + y*plane.ratio,
+                        plane.dst.row(y));
+                    break;
+                case resample_mode::rows:
+                case resample_mode::both:
+                    resample_rows(plane,
+                        plane.source_rows + plane.row_start[y], y,
+                        plane.dst.row(y));
+                    break;
+                default:
+                    break;
+                }
+            }
+        }, run);
+        return;
+    }
+    void resampler::start(ycbcr_view const& dst, unsigned int src_width,
+        unsigned int src_height, bool luma_only)
+    {
+        plane_view const out[3] = { dst.y, dst.cb, dst.cr };
+        const_plane_view const in(nullptr, src_width, src_height, 0);
+        std::size_t window_size = 0;
+        for (unsigned int p = 0; p < 3; ++p) {
+            resample_plane plane;
+            setup(plane, p, in, out[p]);
+            std::size_t rows_kept = 0;
+            if (plane.mode == resample_mode::area)
+                rows_kept = plane.ratio;
+            else if (plane.mode == resample_mode::rows
+                 ||  plane.mode == resample_mode::both)
+                rows_kept = plane.row_taps;
+            ring[p].resize(rows_kept*(plane.mode == resample_mode::area
+                ? src_width : out[p].width()));
+            if (rows_kept > window_size)
+                window_size = rows_kept;
+            emitted[p] = 0;
+        }
+        window.resize(window_size);
+        target = dst;
+        this->src_width = src_width;
+        this->src_height = src_height;
+        pushed = 0;
+        planes = luma_only ? 1u : 3u;
+        return;
+    }
+    void resampler::push(const_ycbcr_row_view const& row) noexcept {
+        unsigned int const r = pushed++;
+        unsigned int const last = src_height-1;
+        unsigned char const* const in[3] = { row.y, row.cb, row.cr };
+        plane_view const out[3] = { target.y, target.cb, target.cr };
+        const_plane_view const source(nullptr, src_width, src_height, 0);
+        for (unsigned int p = 0; p < planes; ++p) {
+            resample_plane plane;
+            setup(plane, p, source, out[p]);
+            unsigned int const width = out[p].width();
+            unsigned char* const kept = ring[p].data();
+            switch (plane.mode) {
+            case resample_mode::copy:
+                std::memcpy(out[p].row(r), in[p], width);
+                continue;
+            case resample_mode::columns:
+                resample_columns(plane, in[p], out[p].row(r));
+                continue;
+            case resample_mode::area:
+                {
+                    unsigned int const ratio = plane.ratio;
+                    std::memcpy(kept + (r%ratio)*src_width, in[p], src_width);
+                    if ((r+1u)%ratio != 0)
+                        continue;
+                    for (unsigned int k = 0; k < ratio; ++k)
+                        window[k] = kept + k*src_width;
+                    resample_area(plane, window.data(), out[p].row(r/ratio));
+                }
+                continue;
+            case resample_mode::rows:
+                std::memcpy(kept + (r%plane.row_taps)*width, in[p], width);
+                break;
+            default:
+                resample_columns(plane, in[p],
+                    kept + (r%plane.row_taps)*width);
+                break;
+            }
+            /* write each row whose window is complete */
+            unsigned int const taps = plane.row_taps;
+            for (; emitted[p] < out[p].height(); ++emitted[p]) {
+                unsigned int const y = emitted[p];
+                std::uint32_t const start = plane.row_start[y];
+                if ((start+taps-1u < last ? start+taps-1u : last) > r)
+                    break;
+                for (unsigned int k = 0; k < taps; ++k) {
+                    unsigned int const i = start+k < last ? start+k : last;
+                    window[k] = kept + (i%taps)*width;
+                }
+                resample_rows(plane, window.data(), y, out[p].row(y));
+            }
+        }
+        return;
+    }
+    //END   resampler / public
+}
@@ -0,0 +1,146 @@
+/**
+ * Separable frame resampling
+*/
+#if !(defined hg_Theorize_Resample_h_)
+#define hg_Theorize_Resample_h_
+
+#include "yccbox.hpp"
+#include "rgbycc.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace theorize
+{
+    struct resample_plane;
+
+    /**
+     * Resampling filters.
+     */
+    enum class scale_filter {
+        /** nearest neighbour; see `nn_scaler` */
+        nearest = 0,
+        /** triangle filter */
+        bilinear = 1,
+        /** Keys cubic filter, a = -0.5 */
+        bicubic = 2,
+        /** three-lobe Lanczos filter */
+        lanczos = 3,
+        /** pixel area average */
+        area = 4
+    };
+
+    /**
+     * Runs a number of independent bands of work, perhaps in
+     * parallel, and returns once all of them are done.
+     * - count number of bands
+     * - fn band function, called once with each index below `count`;
+     *   must not throw
+     */
+    typedef std::function<void(std::size_t count,
+        std::function<void(std::size_t)> const& fn)> band_runner;
+
+    /**
+     * Separable two-pass frame resampler with 2.14 fixed-point filter
+     * weights, recomputed only when the source or destination size
+     * changes.
+     */
+    class resampler {
+    private:
+        /* filter weights along one axis */
+        struct axis {
+            unsigned int src_size;
+            unsigned int dst_size;
+            unsigned int taps;
+            unsigned int pad;
+            scale_filter filter;
+            /* first source sample of each window */
+            std::vector<std::uint32_t> start;
+            /* `taps` weights for each destination sample */
+            std::vector<std::int16_t> weights;
+
+            axis() noexcept;
+            void prepare(scale_filter f, unsigned int src,
+                unsigned int dst, unsigned int multiple);
+        };
+        scale_filter filter;
+        rgbycc_kernel kernel;
+        /* horizontal and vertical weights, luma then chroma */
+        axis horizontal[2];
+        axis vertical[2];
+        /* horizontal pass output for each plane */
+        std::vector<unsigned char> between[3];
+        /* vertical pass input rows for each plane, the last repeated */
+        std::vector<unsigned char const*> rows[3];
+        /* the most recent rows of each plane taken by `push` */
+        std::vector<unsigned char> ring[3];
+        /* input rows of one vertical filter window */
+        std::vector<unsigned char const*> window;
+        /* destination of the rows taken by `push` */
+        ycbcr_view target;
+        unsigned int src_width;
+        unsigned int src_height;
+        /* source rows taken so far */
+        unsigned int pushed;
+        /* destination rows written so far, for each plane */
+        unsigned int emitted[3];
+        /* number of planes that `push` writes */
+        unsigned int planes;
+
+        void setup(resample_plane& plane, unsigned int p,
+            const_plane_view const& in, plane_view const& out);
+    public:
+        /**
+         * - f filter to use; `scale_filter::nearest` is treated as
+         *   `scale_filter::bilinear`
+         */
+        explicit resampler(scale_filter f = scale_filter::bilinear) noexcept;
+        /**
+         * - f filter to use, as above
+         * - k kernel family to use, as for `rgbycc_row`, instead of
+         *   the best one for this processor
+         */
+        resampler(scale_filter f, rgbycc_kernel k) noexcept;
+        scale_filter get_filter() const noexcept { return filter; }
+        /**
+         * Resample a frame.
+         * - dst destination; keeps its dimensions and chroma layout
+         * - src 4:4:4 source frame; when the dimensions and layout
+         *   match those of `dst`, the two boxes are swapped instead
+         * - run band runner for spreading rows over threads; empty
+         *   to run every band on the calling thread
+         */
+        void scale(ycbcr_box& dst, ycbcr_box& src,
+            band_runner const& run = band_runner());
+        /**
+         * Resample a frame region.
+         * - dst destination region
+         * - src 4:4:4 source region
+         * - run band runner for spreading rows over threads
+         */
+        void scale(ycbcr_view const& dst, const_ycbcr_view const& src,
+            band_runner const& run = band_runner());
+        /**
+         * Start resampling a frame that arrives a row at a time. Only
+         * the rows that the vertical filter still needs are kept.
+         * - dst destination region
+         * - src_width source width
+         * - src_height source height
+         * - luma_only whether to resample the luma plane alone,
+         *   leaving the chroma of `dst` as it is; `push` then ignores
+         *   the chroma of its rows
+         * @throw std::bad_alloc on allocation failure
+         */
+        void start(ycbcr_view const& dst, unsigned int src_width,
+            unsigned int src_height, bool luma_only = false);
+        /**
+         * Take the next 4:4:4 source row. Destination rows get written
+         * as soon as the last source row they need comes in.
+         * - row source row
+         */
+        void push(const_ycbcr_row_view const& row) noexcept;
+    };
+}
+
+#endif //hg_Theorize_Resample_h_
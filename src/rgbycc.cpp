@@ -0,0 +1,427 @@
+
+#include "rgbycc.hpp"
+#include <cmath>
+#include <cstdint>
+
+#if (defined THEORIZE_NO_SIMD)
+#  define THEORIZE_RGBYCC_X86 0
+#elif (defined __GNUC__) && ((defined __x86_64__) || (defined __i386__))
+#  define THEORIZE_RGBYCC_X86 1
+#  include <immintrin.h>
+#  define THEORIZE_RGBYCC_SSE2 __attribute__((target("sse2")))
+#else
+#  define THEORIZE_RGBYCC_X86 0
+#endif //THEORIZE_NO_SIMD
+
+namespace theorize {
+    struct rgbycc_gamma
+    {
+        double alpha;
+        double beta;
+        double delta;
+        double epsilon;
+    };
+    struct rgbycc_ypbpr
+    {
+        double y;
+        double pb;
+        double pr;
+    };
+    struct rgbycc_defrac_channel
+    {
+        double offset;
+        double excursion;
+    };
+    struct rgbycc_defrac
+    {
+        rgbycc_defrac_channel y;
+        rgbycc_defrac_channel cb;
+        rgbycc_defrac_channel cr;
+    };
+    struct rgbycc_kappa
+    {
+        constexpr rgbycc_kappa(double r, double b)
+            : kr(r), kb(b),
+            two_m_2kr(2.0*(1.0-r)), two_m_2kb(2.0*(1.0-b)),
+            frac_kr(r/(1.0-(b+r))), frac_kb(b/(1.0-(r+b)))
+        {
+        }
+        double kr;
+        double kb;
+        double two_m_2kr;
+        double two_m_2kb;
+        double frac_kr;
+        double frac_kb;
+    };
+    /**
+     * What one input channel value adds to each output channel, in units
+     * of 2^-`rgbycc_exact_shift`. Entries for the three input channels
+     * sum to the output before runout; the offsets sit in the green
+     * entries.
+     */
+    struct alignas(16) rgbycc_exact_entry
+    {
+        std::int32_t y;
+        std::int32_t cb;
+        std::int32_t cr;
+        std::int32_t unused;
+    };
+    /**
+     * Gamma-corrected channel values for every 8-bit input, with the
+     * luma coefficient products folded in where the conversion uses
+     * them. Each entry is computed exactly as the per-pixel formula
+     * would, so conversions through the table are bit-exact.
+     */
+    struct rgbycc_lut
+    {
+        double prime[256];
+        double red_kr[256];
+        double blue_kb[256];
+        rgbycc_exact_entry exact_red[256];
+        rgbycc_exact_entry exact_green[256];
+        rgbycc_exact_entry exact_blue[256];
+        /* reference results for red = green = blue, which land
+         * exactly on a step in the chroma channels */
+        ycbcr grey[256];
+    };
+    /* the integer tables keep 22 fraction bits; each entry is within
+     * half a unit, so a sum more than `rgbycc_exact_guard` units away
+     * from a step truncates just as the reference does */
+    constexpr int rgbycc_exact_shift = 22;
+    constexpr std::int32_t rgbycc_exact_guard = 4;
+    constexpr rgbycc_gamma rgbycc_rec709_gamma = {4.5,0.45,0.018,0.099};
+    constexpr rgbycc_kappa rgbycc_rec601_kappa = {0.299,0.114};
+    constexpr rgbycc_defrac rgbycc_studio_defrac = {
+        {16.0,219.0}, {128.0,224.0}, {128.0,224.0}
+    };
+    static
+    double rgbycc_apply_gamma(rgbycc_gamma const& gamma, long int channel);
+    static
+    void rgbycc_make_exact(rgbycc_exact_entry* out, double const* prime,
+        rgbycc_defrac const& defrac, double y, double cb, double cr);
+    static
+    rgbycc_lut rgbycc_make_lut();
+    static
+    rgbycc_lut const& rgbycc_get_lut();
+    static
+    unsigned char rgbycc_runout(rgbycc_defrac_channel const& defrac,
+        double channel);
+    static
+    ycbcr rgbycc_lut_reference(rgbycc_lut const& lut,
+        unsigned int red, unsigned int green, unsigned int blue) noexcept;
+    static
+    bool rgbycc_exact_near(std::int32_t sum) noexcept;
+    static
+    unsigned char rgbycc_exact_runout(std::int32_t sum) noexcept;
+    static
+    void rgbycc_exact_fallback(rgbycc_lut const& lut,
+        unsigned char const* src, unsigned char* y, unsigned char* cb,
+        unsigned char* cr) noexcept;
+    static
+    void rgbycc_scalar_row(rgbycc_lut const& lut,
+        unsigned char const* src, unsigned int channels, std::size_t count,
+        unsigned char* y, unsigned char* cb, unsigned char* cr) noexcept;
+#if THEORIZE_RGBYCC_X86
+    static
+    std::size_t rgbycc_sse2_row(rgbycc_lut const& lut,
+        unsigned char const* src, unsigned int channels, std::size_t count,
+        unsigned char* y, unsigned char* cb, unsigned char* cr) noexcept
+        THEORIZE_RGBYCC_SSE2;
+#endif //THEORIZE_RGBYCC_X86
+
+    //BEGIN rgbycc / static
+    inline
+    double rgbycc_apply_gamma(rgbycc_gamma const& gamma, long int channel) {
+        return (channel < gamma.delta*255)
+            ? channel*gamma.alpha/255.0
+            : (1+gamma.epsilon)*std::pow(channel/255.0, gamma.beta) - gamma.epsilon;
+    }
+
+    void rgbycc_make_exact(rgbycc_exact_entry* out, double const* prime,
+        rgbycc_defrac const& defrac, double y, double cb, double cr)
+    {
+        double const scale = static_cast<double>(1l << rgbycc_exact_shift);
+        for (int i = 0; i < 256; ++i) {
+            double const unit = prime[i]*scale;
+            out[i].y = static_cast<std::int32_t>(
+                std::lround(unit*defrac.y.excursion*y));
+            out[i].cb = static_cast<std::int32_t>(
+                std::lround(unit*defrac.cb.excursion*cb));
+            out[i].cr = static_cast<std::int32_t>(
+                std::lround(unit*defrac.cr.excursion*cr));
+            out[i].unused = 0;
+        }
+        return;
+    }
+
+    rgbycc_lut rgbycc_make_lut() {
+        constexpr rgbycc_kappa const& kappa = rgbycc_rec601_kappa;
+        constexpr rgbycc_defrac const& defrac = rgbycc_studio_defrac;
+        rgbycc_lut out;
+        for (long int i = 0; i < 256; ++i) {
+            double const prime =
+                rgbycc_apply_gamma(rgbycc_rec709_gamma, i);
+            out.prime[i] = prime;
+            out.red_kr[i] = prime*kappa.frac_kr;
+            out.blue_kb[i] = prime*kappa.frac_kb;
+        }
+        /* luma weights */{
+            double const sum = 1.0 + kappa.frac_kr + kappa.frac_kb;
+            double const luma_r = kappa.frac_kr/sum;
+            double const luma_g = 1.0/sum;
+            double const luma_b = kappa.frac_kb/sum;
+            rgbycc_make_exact(out.exact_red, out.prime, defrac, luma_r,
+                -luma_r/kappa.two_m_2kb, (1.0-luma_r)/kappa.two_m_2kr);
+            rgbycc_make_exact(out.exact_green, out.prime, defrac, luma_g,
+                -luma_g/kappa.two_m_2kb, -luma_g/kappa.two_m_2kr);
+            rgbycc_make_exact(out.exact_blue, out.prime, defrac, luma_b,
+                (1.0-luma_b)/kappa.two_m_2kb, -luma_b/kappa.two_m_2kr);
+        }
+        for (rgbycc_exact_entry& entry : out.exact_green) {
+            entry.y += static_cast<std::int32_t>(defrac.y.offset)
+                << rgbycc_exact_shift;
+            entry.cb += static_cast<std::int32_t>(defrac.cb.offset)
+                << rgbycc_exact_shift;
+            entry.cr += static_cast<std::int32_t>(defrac.cr.offset)
+                << rgbycc_exact_shift;
+        }
+        for (unsigned int i = 0; i < 256; ++i)
+            out.grey[i] = rgbycc_lut_reference(out, i, i, i);
+        return out;
+    }
+
+    rgbycc_lut const& rgbycc_get_lut() {
+        static rgbycc_lut const lut = rgbycc_make_lut();
+        return lut;
+    }
+
+    inline
+    unsigned char rgbycc_runout(rgbycc_defrac_channel const& defrac,
+        double channel)
+    {
+        double const pre = defrac.excursion*channel + defrac.offset;
+        return pre < 0.0 ? 0u : (pre > 255.0
+            ? 255u : static_cast<unsigned char>(pre));
+    }
+
+    ycbcr rgbycc_lut_reference(rgbycc_lut const& lut,
+        unsigned int red, unsigned int green, unsigned int blue) noexcept
+    {
+        constexpr rgbycc_kappa const& kappa = rgbycc_rec601_kappa;
+        constexpr rgbycc_defrac const& defrac = rgbycc_studio_defrac;
+        // keep the sum in green, red, blue order; rounding depends on it
+        double const luma = (lut.prime[green] + lut.red_kr[red]
+            + lut.blue_kb[blue])/(1.0 + kappa.frac_kr + kappa.frac_kb);
+        rgbycc_ypbpr const ypbpr = {
+            luma, (lut.prime[blue]-luma)/kappa.two_m_2kb,
+            (lut.prime[red]-luma)/kappa.two_m_2kr
+        };
+        return ycbcr{
+            rgbycc_runout(defrac.y, ypbpr.y),
+            rgbycc_runout(defrac.cb, ypbpr.pb),
+            rgbycc_runout(defrac.cr, ypbpr.pr)
+        };
+    }
+
+    inline
+    bool rgbycc_exact_near(std::int32_t sum) noexcept {
+        std::int32_t const mask = (1l << rgbycc_exact_shift) - 1;
+        return ((sum + rgbycc_exact_guard) & mask) < 2*rgbycc_exact_guard;
+    }
+
+    inline
+    unsigned char rgbycc_exact_runout(std::int32_t sum) noexcept {
+        if (sum < 0)
+            return 0u;
+        std::int32_t const out = sum >> rgbycc_exact_shift;
+        return out > 255 ? 255u : static_cast<unsigned char>(out);
+    }
+
+    void rgbycc_exact_fallback(rgbycc_lut const& lut,
+        unsigned char const* src, unsigned char* y, unsigned char* cb,
+        unsigned char* cr) noexcept
+    {
+        ycbcr const out = (src[0] == src[1] && src[1] == src[2])
+            ? lut.grey[src[0]]
+            : rgbycc_lut_reference(lut, src[0], src[1], src[2]);
+        *y = out.y;
+        *cb = out.cb;
+        *cr = out.cr;
+        return;
+    }
+
+    void rgbycc_scalar_row(rgbycc_lut const& lut,
+        unsigned char const* src, unsigned int channels, std::size_t count,
+        unsigned char* y, unsigned char* cb, unsigned char* cr) noexcept
+    {
+        for (std::size_t i = 0; i < count; ++i, src += channels) {
+            rgbycc_exact_entry const& red = lut.exact_red[src[0]];
+            rgbycc_exact_entry const& green = lut.exact_green[src[1]];
+            rgbycc_exact_entry const& blue = lut.exact_blue[src[2]];
+            std::int32_t const sum_y = red.y + green.y + blue.y;
+            std::int32_t const sum_cb = red.cb + green.cb + blue.cb;
+            std::int32_t const sum_cr = red.cr + green.cr + blue.cr;
+            if (rgbycc_exact_near(sum_y) || rgbycc_exact_near(sum_cb)
+            ||  rgbycc_exact_near(sum_cr))
+            {
+                rgbycc_exact_fallback(lut, src, y+i, cb+i, cr+i);
+            } else {
+                y[i] = rgbycc_exact_runout(sum_y);
+                cb[i] = rgbycc_exact_runout(sum_cb);
+                cr[i] = rgbycc_exact_runout(sum_cr);
+            }
+        }
+        return;
+    }
+
+#if THEORIZE_RGBYCC_X86
+    static
+    __m128i rgbycc_sse2_sum(rgbycc_lut const& lut,
+        unsigned char const* src) noexcept THEORIZE_RGBYCC_SSE2;
+    static
+    __m128i rgbycc_sse2_near(__m128i sum) noexcept THEORIZE_RGBYCC_SSE2;
+    static
+    __m128i rgbycc_sse2_quad(rgbycc_lut const& lut,
+        unsigned char const* src, unsigned int channels,
+        __m128i& near) noexcept THEORIZE_RGBYCC_SSE2;
+
+    inline
+    __m128i rgbycc_sse2_sum(rgbycc_lut const& lut,
+        unsigned char const* src) noexcept
+    {
+        __m128i const red = _mm_load_si128(
+            reinterpret_cast<__m128i const*>(lut.exact_red + src[0]));
+        __m128i const green = _mm_load_si128(
+            reinterpret_cast<__m128i const*>(lut.exact_green + src[1]));
+        __m128i const blue = _mm_load_si128(
+            reinterpret_cast<__m128i const*>(lut.exact_blue + src[2]));
+        return _mm_add_epi32(_mm_add_epi32(red, green), blue);
+    }
+
+    inline
+    __m128i rgbycc_sse2_near(__m128i sum) noexcept {
+        __m128i const guard = _mm_set1_epi32(rgbycc_exact_guard);
+        __m128i const mask = _mm_set1_epi32((1l << rgbycc_exact_shift) - 1);
+        return _mm_cmplt_epi32(
+            _mm_and_si128(_mm_add_epi32(sum, guard), mask),
+            _mm_add_epi32(guard, guard));
+    }
+
+    inline
+    __m128i rgbycc_sse2_quad(rgbycc_lut const& lut,
+        unsigned char const* src, unsigned int channels,
+        __m128i& near) noexcept
+    {
+        __m128i sum[4];
+        for (unsigned int j = 0; j < 4; ++j) {
+            sum[j] = rgbycc_sse2_sum(lut, src + j*channels);
+            near = _mm_or_si128(near, rgbycc_sse2_near(sum[j]));
+        }
+        return _mm_packus_epi16(
+            _mm_packs_epi32(_mm_srai_epi32(sum[0], rgbycc_exact_shift),
+                _mm_srai_epi32(sum[1], rgbycc_exact_shift)),
+            _mm_packs_epi32(_mm_srai_epi32(sum[2], rgbycc_exact_shift),
+                _mm_srai_epi32(sum[3], rgbycc_exact_shift)));
+    }
+
+    std::size_t rgbycc_sse2_row(rgbycc_lut const& lut,
+        unsigned char const* src, unsigned int channels, std::size_t count,
+        unsigned char* y, unsigned char* cb, unsigned char* cr) noexcept
+    {
+        std::size_t i;
+        for (i = 0; i + 16 <= count; i += 16, src += 16*channels) {
+            __m128i near = _mm_setzero_si128();
+            // each quad holds Y, Cb, Cr and padding for four pixels
+            __m128i quad[4];
+            for (unsigned int j = 0; j < 4; ++j)
+                quad[j] = rgbycc_sse2_quad(lut, src + 4*j*channels,
+                    channels, near);
+            if (_mm_movemask_ps(_mm_castsi128_ps(near)) & 7) {
+                rgbycc_scalar_row(lut, src, channels, 16,
+                    y+i, cb+i, cr+i);
+                continue;
+            }
+            // four rounds of interleaving leave one channel per vector
+            for (int round = 0; round < 4; ++round) {
+                __m128i const a = quad[0], b = quad[1];
+                quad[0] = _mm_unpacklo_epi8(a, quad[2]);
+                quad[1] = _mm_unpackhi_epi8(a, quad[2]);
+                quad[2] = _mm_unpacklo_epi8(b, quad[3]);
+                quad[3] = _mm_unpackhi_epi8(b, quad[3]);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(y+i), quad[0]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(cb+i), quad[1]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(cr+i), quad[2]);
+        }
+        return i;
+    }
+#endif //THEORIZE_RGBYCC_X86
+    //END   rgbycc / static
+
+    //BEGIN rgbycc / namespace-local
+    ycbcr rgbycc_reference
+        (unsigned int red, unsigned int green, unsigned int blue) noexcept
+    {
+        return rgbycc_lut_reference(rgbycc_get_lut(),
+            red & 255u, green & 255u, blue & 255u);
+    }
+
+    unsigned int rgbycc_narrow16(unsigned int sample) noexcept {
+        /* sample/257, rounded to nearest */
+        unsigned long int const v = sample & 65535u;
+        return static_cast<unsigned int>((v*255u + 32895u) >> 16);
+    }
+
+    rgbycc_kernel rgbycc_support() noexcept {
+#if THEORIZE_RGBYCC_X86
+        static rgbycc_kernel const support = []() {
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+                return rgbycc_kernel::avx2;
+            else if (__builtin_cpu_supports("sse2"))
+                return rgbycc_kernel::sse2;
+            else
+                return rgbycc_kernel::scalar;
+        }();
+        return support;
+#else
+        return rgbycc_kernel::scalar;
+#endif //THEORIZE_RGBYCC_X86
+    }
+
+    void rgbycc_row(unsigned char const* src, unsigned int channels,
+        std::size_t count, unsigned char* y, unsigned char* cb,
+        unsigned char* cr, rgbycc_kernel kernel) noexcept
+    {
+        rgbycc_lut const& lut = rgbycc_get_lut();
+        std::size_t done = 0;
+        if (kernel > rgbycc_support())
+            kernel = rgbycc_support();
+#if THEORIZE_RGBYCC_X86
+        // the table loads dominate, so wider vectors gain nothing here
+        if (kernel >= rgbycc_kernel::sse2)
+            done = rgbycc_sse2_row(lut, src, channels, count, y, cb, cr);
+#endif //THEORIZE_RGBYCC_X86
+        rgbycc_scalar_row(lut, src + done*channels, channels, count - done,
+            y + done, cb + done, cr + done);
+        return;
+    }
+
+    void rgbycc_row(unsigned char const* src, unsigned int channels,
+        std::size_t count, unsigned char* y, unsigned char* cb,
+        unsigned char* cr) noexcept
+    {
+        rgbycc_row(src, channels, count, y, cb, cr, rgbycc_support());
+        return;
+    }
+
+    void rgbycc_row(ycbcr_box& box, unsigned int x, unsigned int y,
+        unsigned char const* src, unsigned int channels,
+        std::size_t count) noexcept
+    {
+        ycbcr_row_view const row = box.row(y);
+        rgbycc_row(src, channels, count, row.y + x, row.cb + x, row.cr + x);
+        return;
+    }
+    //END   rgbycc / namespace-local
+}
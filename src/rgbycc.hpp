@@ -0,0 +1,82 @@
+/**
+ * RGB to YCbCr conversion
+*/
+#if !(defined hg_Theorize_RgbYCbCr_h_)
+#define hg_Theorize_RgbYCbCr_h_
+
+#include "yccbox.hpp"
+#include <cstddef>
+
+namespace theorize
+{
+    /**
+     * Row converter kernel families.
+     */
+    enum class rgbycc_kernel {
+        scalar = 0,
+        sse2 = 1,
+        avx2 = 2
+    };
+
+    /**
+     * Convert one 8-bit color in double precision. This is the
+     * reference conversion (Rec. 709 transfer, Rec. 601 matrix,
+     * studio range).
+     * - red red sample
+     * - green green sample
+     * - blue blue sample
+     * @return the converted color
+     */
+    ycbcr rgbycc_reference
+        (unsigned int red, unsigned int green, unsigned int blue) noexcept;
+
+    /**
+     * Reduce a 16-bit sample to 8 bits, rounded to nearest, the same
+     * way the PNG reader does for 16-bit images.
+     * - sample 16-bit sample
+     * @return the 8-bit sample
+     */
+    unsigned int rgbycc_narrow16(unsigned int sample) noexcept;
+
+    /**
+     * @return the best row converter kernels for this processor
+     */
+    rgbycc_kernel rgbycc_support() noexcept;
+
+    /**
+     * Convert a run of packed 8-bit pixels through integer tables.
+     * Results match `rgbycc_reference` exactly for every kernel family.
+     * - src source pixels as red, green, blue, and alpha when
+     *   `channels` is four; alpha is ignored
+     * - channels three or four
+     * - count number of pixels
+     * - y destination run of luma samples
+     * - cb destination run of blue-difference samples
+     * - cr destination run of red-difference samples
+     * - kernel kernel family to use; families the processor does not
+     *   support fall back to the best available
+     */
+    void rgbycc_row(unsigned char const* src, unsigned int channels,
+        std::size_t count, unsigned char* y, unsigned char* cb,
+        unsigned char* cr, rgbycc_kernel kernel) noexcept;
+    /**
+     * Convert a run of packed 8-bit pixels with the best kernels.
+     */
+    void rgbycc_row(unsigned char const* src, unsigned int channels,
+        std::size_t count, unsigned char* y, unsigned char* cb,
+        unsigned char* cr) noexcept;
+    /**
+     * Convert a run of packed 8-bit pixels into the planes of a box.
+     * - box destination
+     * - x first destination column
+     * - y destination row
+     * - src source pixels
+     * - channels three or four
+     * - count number of pixels; the run must fit in the box
+     */
+    void rgbycc_row(ycbcr_box& box, unsigned int x, unsigned int y,
+        unsigned char const* src, unsigned int channels,
+        std::size_t count) noexcept;
+}
+
+#endif //hg_Theorize_RgbYCbCr_h_
@@ -0,0 +1,476 @@
+#include "scale.hpp"
+#include "yccbox.hpp"
+#include "subsample.hpp"
+#include <cstring>
+
+#if (defined THEORIZE_NO_SIMD)
+#  define THEORIZE_SCALE_X86 0
+#elif (defined __GNUC__) && ((defined __x86_64__) || (defined __i386__))
+#  define THEORIZE_SCALE_X86 1
+#  include <immintrin.h>
+#  define THEORIZE_SCALE_SSSE3 __attribute__((target("ssse3")))
+#else
+#  define THEORIZE_SCALE_X86 0
+#endif //THEORIZE_NO_SIMD
+
+namespace theorize
+{
+    /* studio-range black, for bars and frame padding */
+    constexpr ycbcr scale_black = {16, 128, 128};
+
+    static
+    void scale_build_map(std::vector<std::uint32_t>& map,
+        unsigned int src_size, unsigned int dst_size);
+    /*
+     * List the source samples along one axis that a scaler reads.
+     * - picks receives the samples in increasing order
+     * - first first sample in use
+     * - size number of samples in use
+     * - dst_size destination size
+     * - nearest whether the scaler picks single samples
+     */
+    static
+    void scale_pick(std::vector<std::uint32_t>& picks, unsigned int first,
+        unsigned int size, unsigned int dst_size, bool nearest);
+#if THEORIZE_SCALE_X86
+    static
+    bool scale_shuffle_support() noexcept;
+    static
+    void scale_ssse3_block(unsigned char* out, unsigned char const* in,
+        unsigned char const* shuffle) noexcept THEORIZE_SCALE_SSSE3;
+#endif //THEORIZE_SCALE_X86
+
+    //BEGIN scale / static
+    void scale_build_map(std::vector<std::uint32_t>& map,
+        unsigned int src_size, unsigned int dst_size)
+    {
+        map.resize(dst_size);
+        for (unsigned int i = 0; i < dst_size; ++i) {
+            map[i] = static_cast<std::uint32_t>(
+                static_cast<unsigned long long>(i)*src_size/dst_size);
+        }
+        return;
+    }
+    void scale_pick(std::vector<std::uint32_t>& picks, unsigned int first,
+        unsigned int size, unsigned int dst_size, bool nearest)
+    {
+        if (nearest && dst_size < size) {
+            /* a shrinking map never picks the same sample twice */
+            scale_build_map(picks, size, dst_size);
+            for (std::uint32_t& i : picks)
+                i += first;
+        } else {
+            picks.resize(size);
+            for (unsigned int i = 0; i < size; ++i)
+                picks[i] = first + i;
+        }
+        return;
+    }
+#if THEORIZE_SCALE_X86
+    bool scale_shuffle_support() noexcept {
+        static bool const support = []() {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("ssse3") != 0;
+        }();
+        return support;
+    }
+    void scale_ssse3_block(unsigned char* out, unsigned char const* in,
+        unsigned char const* shuffle) noexcept
+    {
+        __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in));
+        __m128i const s =
+            _mm_loadu_si128(reinterpret_cast<__m128i const*>(shuffle));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+            _mm_shuffle_epi8(v, s));
+        return;
+    }
+#endif //THEORIZE_SCALE_X86
+    //END   scale / static
+
+    //BEGIN scale / namespace-local
+    void fit_region(fit_mode mode, unsigned int src_width,
+        unsigned int src_height, unsigned int pic_width,
+        unsigned int pic_height, frame_region& from, frame_region& to)
+        noexcept
+    {
+        typedef unsigned long long int wide;
+        /* the source is wider than the picture, aspect-wise */
+        bool const wider = static_cast<wide>(src_width)*pic_height
+            > static_cast<wide>(pic_width)*src_height;
+        from = frame_region{0, 0, src_width, src_height};
+        to = frame_region{0, 0, pic_width, pic_height};
+        switch (mode) {
+        case fit_mode::letterbox:
+            if (wider) {
+                to.height = static_cast<unsigned int>(
+                    (static_cast<wide>(src_height)*pic_width + src_width/2)
+                    / src_width);
+            } else {
+                to.width = static_cast<unsigned int>(
+                    (static_cast<wide>(src_width)*pic_height + src_height/2)
+                    / src_height);
+            }
+            break;
+        case fit_mode::crop:
+            if (wider) {
+                from.width = static_cast<unsigned int>(
+                    (static_cast<wide>(src_height)*pic_width + pic_height/2)
+                    / pic_height);
+            } else {
+                from.height = static_cast<unsigned int>(
+                    (static_cast<wide>(src_width)*pic_height + pic_width/2)
+                    / pic_width);
+            }
+            break;
+        case fit_mode::none:
+            if (src_width < pic_width)
+                to.width = src_width;
+            else
+                from.width = pic_width;
+            if (src_height < pic_height)
+                to.height = src_height;
+            else
+                from.height = pic_height;
+            break;
+        default:
+            break;
+        }
+        if (to.width == 0)
+            to.width = 1;
+        if (to.height == 0)
+            to.height = 1;
+        if (from.width == 0)
+            from.width = 1;
+        if (from.height == 0)
+            from.height = 1;
+        from.x = (src_width - from.width)/2u;
+        from.y = (src_height - from.height)/2u;
+        to.x = ((pic_width - to.width)/2u) & ~1u;
+        to.y = ((pic_height - to.height)/2u) & ~1u;
+        return;
+    }
+    //END   scale / namespace-local
+
+    //BEGIN nn_scaler / rule-of-six
+    constexpr std::uint32_t nn_scaler::no_shuffle;
+
+    nn_scaler::nn_scaler() noexcept
+        : src_width(0), src_height(0), dst_width(0), dst_height(0),
+          pushed(0), emitted(0), last_top(no_shuffle),
+          last_bottom(no_shuffle), luma_only(false)
+    {
+    }
+    //END   nn_scaler / rule-of-six
+
+    //BEGIN nn_scaler / private
+    void nn_scaler::prepare(unsigned int sw, unsigned int sh,
+        unsigned int dw, unsigned int dh)
+    {
+        if (sw != src_width || dw != dst_width) {
+            scale_build_map(columns, sw, dw);
+            /* find the runs that one byte shuffle can produce */
+            std::size_t const blocks = dw/16u;
+            block_base.assign(blocks, no_shuffle);
+            block_shuffle.assign(blocks*16u, 0);
+            for (std::size_t b = 0; b < blocks && sw >= 16u; ++b) {
+                std::uint32_t const* const run = columns.data() + b*16u;
+                std::uint32_t base = run[0];
+                if (base > sw - 16u)
+                    base = sw - 16u;
+                if (run[15] - base >= 16u)
+                    continue;
+                block_base[b] = base;
+                for (unsigned int i = 0; i < 16u; ++i) {
+                    block_shuffle[b*16u+i] =
+                        static_cast<unsigned char>(run[i] - base);
+                }
+            }
+            src_width = sw;
+            dst_width = dw;
+        }
+        if (sh != src_height || dh != dst_height) {
+            scale_build_map(rows, sh, dh);
+            src_height = sh;
+            dst_height = dh;
+        }
+        return;
+    }
+    void nn_scaler::gather(unsigned char* out, unsigned char const* in)
+        const noexcept
+    {
+        if (src_width == dst_width) {
+            std::memcpy(out, in, dst_width);
+            return;
+        }
+#if THEORIZE_SCALE_X86
+        bool const shuffle = scale_shuffle_support();
+#endif //THEORIZE_SCALE_X86
+        std::size_t x = 0;
+        for (std::size_t b = 0; b < block_base.size(); ++b) {
+#if THEORIZE_SCALE_X86
+            if (shuffle && block_base[b] != no_shuffle) {
+                scale_ssse3_block(out + x, in + block_base[b],
+                    block_shuffle.data() + x);
+                x += 16u;
+                continue;
+            }
+#endif //THEORIZE_SCALE_X86
+            for (std::size_t const end = x + 16u; x < end; ++x)
+                out[x] = in[columns[x]];
+        }
+        for (; x < dst_width; ++x)
+            out[x] = in[columns[x]];
+        return;
+    }
+    //END   nn_scaler / private
+
+    //BEGIN nn_scaler / public
+    void nn_scaler::scale(ycbcr_box& dst, ycbcr_box& src) {
+        if (dst.width() == src.width() && dst.height() == src.height()
+        &&  dst.format() == src.format())
+        {
+            dst.swap(src);
+            dst.forget_border();
+            return;
+        }
+        dst.forget_border();
+        dst.forget_chroma();
+        scale(dst.view(), src.view());
+        return;
+    }
+    void nn_scaler::scale(ycbcr_view const& dst, const_ycbcr_view const& src) {
+        start(dst, src.width(), src.height());
+        for (unsigned int y = 0; y < src.height(); ++y) {
+            push(const_ycbcr_row_view{src.y.row(y), src.cb.row(y),
+                src.cr.row(y), src.width()});
+        }
+        return;
+    }
+    void nn_scaler::start(ycbcr_view const& dst, unsigned int src_width,
+        unsigned int src_height, bool luma_only)
+    {
+        prepare(src_width, src_height, dst.width(), dst.height());
+        chroma_rows.resize(dst.width()*3u);
+        target = dst;
+        pushed = 0;
+        emitted = 0;
+        last_top = no_shuffle;
+        last_bottom = no_shuffle;
+        this->luma_only = luma_only;
+        return;
+    }
+    void nn_scaler::push(const_ycbcr_row_view const& row) noexcept {
+        std::uint32_t const r = pushed++;
+        unsigned int const width = target.width();
+        unsigned int const height = target.height();
+        unsigned int const chroma_width = target.cb.width();
+        unsigned char const* const in[3] = { row.y, row.cb, row.cr };
+        plane_view const out[3] = { target.y, target.cb, target.cr };
+        unsigned int const full_planes =
+            (target.format == pixel_format::yuv444 && !luma_only) ? 3 : 1;
+        /* full-width chroma: top Cb, top Cr, and a bottom row */
+        unsigned char* const top[3] = { nullptr,
+            chroma_rows.data(), chroma_rows.data() + width };
+        unsigned char* const bottom = chroma_rows.data() + width*2u;
+        for (; emitted < height && rows[emitted] == r; ++emitted) {
+            unsigned int const y = emitted;
+            bool const repeat = (y > 0 && rows[y-1] == r);
+            for (unsigned int i = 0; i < full_planes; ++i) {
+                if (repeat)
+                    std::memcpy(out[i].row(y), out[i].row(y-1), width);
+                else
+                    gather(out[i].row(y), in[i]);
+            }
+            if (full_planes == 3 || luma_only)
+                continue;
+            else if (target.format == pixel_format::yuv422) {
+                for (unsigned int i = 1; i < 3; ++i) {
+                    if (repeat) {
+                        std::memcpy(out[i].row(y), out[i].row(y-1),
+                            chroma_width);
+                    } else {
+                        gather(top[i], in[i]);
+                        subsample_row(top[i], width, out[i].row(y));
+                    }
+                }
+                continue;
+            }
+            /* scale each chroma row pair to full width, then filter down */
+            if ((y & 1u) == 0) {
+                /* keep the top rows; the last pair may still use them */
+                if (r != last_top) {
+                    gather(top[1], in[1]);
+                    gather(top[2], in[2]);
+                }
+                if (y+1u < height)
+                    continue;
+            }
+            std::uint32_t const src_top = rows[y & ~1u];
+            std::uint32_t const src_bottom = r;
+            unsigned int const chroma_y = y>>1;
+            for (unsigned int i = 1; i < 3; ++i) {
+                if (src_top == last_top && src_bottom == last_bottom) {
+                    std::memcpy(out[i].row(chroma_y), out[i].row(chroma_y-1),
+                        chroma_width);
+                } else if (src_bottom != src_top) {
+                    gather(bottom, in[i]);
+                    subsample_rows(top[i], bottom, width,
+                        out[i].row(chroma_y));
+                } else {
+                    subsample_row(top[i], width, out[i].row(chroma_y));
+                }
+            }
+            last_top = src_top;
+            last_bottom = src_bottom;
+        }
+        return;
+    }
+    //END   nn_scaler / public
+
+    //BEGIN frame_placer / rule-of-six
+    frame_placer::frame_placer(frame_region const& picture, fit_mode fit,
+        scale_filter filter, band_runner const& run)
+        : picture(picture), fit(fit), filter(filter), run(run),
+          smooth(filter), frame(nullptr), from{0, 0, 0, 0}, direct(false),
+          all_columns(true)
+    {
+    }
+    //END   frame_placer / rule-of-six
+
+    //BEGIN frame_placer / private
+    void frame_placer::place(unsigned int width, unsigned int height,
+        frame_region& inside)
+    {
+        fit_region(fit, width, height, picture.width, picture.height,
+            from, inside);
+        inside.x += picture.x;
+        inside.y += picture.y;
+        return;
+    }
+    void frame_placer::start(unsigned int width, unsigned int height,
+        bool flat)
+    {
+        frame_region inside;
+        place(width, height, inside);
+        frame->fill_border(inside, scale_black);
+        if (flat)
+            frame->fill_chroma(scale_black.cb, scale_black.cr);
+        else
+            frame->forget_chroma();
+        to = frame->view().region(inside);
+        /* same size and full chroma: the rows need no scaling at all */
+        direct = (frame->format() == pixel_format::yuv444
+            && from.width == width && inside.width == width
+            && inside.height == from.height);
+        /* leave out what the scaler would skip anyway */
+        bool const sparse = (!direct && filter == scale_filter::nearest);
+        std::vector<std::uint32_t> rows;
+        scale_pick(rows, from.y, from.height, inside.height, sparse);
+        row_flags.assign(height, 0);
+        for (std::uint32_t const r : rows)
+            row_flags[r] = 1;
+        scale_pick(columns, from.x, from.width, inside.width, sparse);
+        unsigned int const row_width =
+            static_cast<unsigned int>(columns.size());
+        unsigned int const row_count = static_cast<unsigned int>(rows.size());
+        all_columns = (row_width == width);
+        scratch.resize(static_cast<std::size_t>(row_width)*3u);
+        if (direct)
+            return;
+        else if (filter == scale_filter::nearest)
+            nearest.start(to, row_width, row_count, flat);
+        else
+            smooth.start(to, row_width, row_count, flat);
+        return;
+    }
+    //END   frame_placer / private
+
+    //BEGIN frame_placer / public
+    void frame_placer::set_frame(ycbcr_box& f) noexcept {
+        frame = &f;
+    }
+    void frame_placer::begin(unsigned int width, unsigned int height) {
+        start(width, height, false);
+        return;
+    }
+    bool frame_placer::begin_flat(unsigned int width, unsigned int height,
+        unsigned char cb, unsigned char cr)
+    {
+        /* the bars share the chroma, so one fill covers the frame */
+        if (cb != scale_black.cb || cr != scale_black.cr)
+            return false;
+        start(width, height, true);
+        return true;
+    }
+    unsigned char const* frame_placer::wanted_rows() const noexcept {
+        return row_flags.data();
+    }
+    std::uint32_t const* frame_placer::wanted_columns(unsigned int& count)
+        const noexcept
+    {
+        count = static_cast<unsigned int>(columns.size());
+        return all_columns ? nullptr : columns.data();
+    }
+    void frame_placer::sample_step(unsigned int width, unsigned int height,
+        unsigned int& step_x, unsigned int& step_y) noexcept
+    {
+        frame_region inside;
+        place(width, height, inside);
+        step_x = from.width / inside.width;
+        step_y = from.height / inside.height;
+        if (step_x == 0)
+            step_x = 1;
+        if (step_y == 0)
+            step_y = 1;
+        return;
+    }
+    ycbcr_row_view frame_placer::row_buffer(unsigned int y) noexcept {
+        unsigned int const row_width =
+            static_cast<unsigned int>(columns.size());
+        if (direct && y >= from.y && y-from.y < from.height) {
+            unsigned int const row = y-from.y;
+            return ycbcr_row_view{to.y.row(row), to.cb.row(row),
+                to.cr.row(row), row_width};
+        }
+        unsigned char* const data = scratch.data();
+        return ycbcr_row_view{data, data + row_width,
+            data + row_width*2u, row_width};
+    }
+    void frame_placer::put_row(unsigned int y) noexcept {
+        if (direct || !row_flags[y])
+            return;
+        unsigned int const row_width =
+            static_cast<unsigned int>(columns.size());
+        unsigned char const* const data = scratch.data();
+        const_ycbcr_row_view const row = {data, data + row_width,
+            data + row_width*2u, row_width};
+        if (filter == scale_filter::nearest)
+            nearest.push(row);
+        else
+            smooth.push(row);
+        return;
+    }
+    void frame_placer::put_frame(ycbcr_box& box) {
+        frame_region inside;
+        place(box.width(), box.height(), inside);
+        if (inside.width == frame->width() && inside.height == frame->height()
+        &&  from.width == box.width() && from.height == box.height())
+        {
+            if (filter == scale_filter::nearest)
+                nearest.scale(*frame, box);
+            else
+                smooth.scale(*frame, box, run);
+            return;
+        }
+        frame->fill_border(inside, scale_black);
+        frame->forget_chroma();
+        ycbcr_view const out = frame->view().region(inside);
+        const_ycbcr_view const in = box.view().region(from);
+        if (filter == scale_filter::nearest)
+            nearest.scale(out, in);
+        else
+            smooth.scale(out, in, run);
+        return;
+    }
+    //END   frame_placer / public
+}
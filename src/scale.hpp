@@ -0,0 +1,186 @@
+/**
+ * Frame scaling
+*/
+#if !(defined hg_Theorize_Scale_h_)
+#define hg_Theorize_Scale_h_
+
+#include "yccbox.hpp"
+#include "resample.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace theorize
+{
+    /**
+     * Ways to fit a source image into the picture region.
+     */
+    enum class fit_mode {
+        /** scale to fill the picture, ignoring the aspect ratio */
+        stretch = 0,
+        /** scale to fit inside the picture, with bars on two sides */
+        letterbox = 1,
+        /** scale to cover the picture, cutting off two sides */
+        crop = 2,
+        /** keep the source size, centered; cut off or bar as needed */
+        none = 3
+    };
+
+    /**
+     * Work out where a source image lands in the picture region.
+     * Destination offsets are even, so regions of subsampled frames
+     * line up with their chroma samples.
+     * - mode fit mode
+     * - src_width source width
+     * - src_height source height
+     * - pic_width picture width
+     * - pic_height picture height
+     * - from receives the part of the source to use
+     * - to receives where that part goes, relative to the picture
+     */
+    void fit_region(fit_mode mode, unsigned int src_width,
+        unsigned int src_height, unsigned int pic_width,
+        unsigned int pic_height, frame_region& from, frame_region& to)
+        noexcept;
+
+    /**
+     * Nearest-neighbour frame scaler. Its row and column maps get
+     * rebuilt only when the source or destination size changes.
+     */
+    class nn_scaler {
+    private:
+        unsigned int src_width;
+        unsigned int src_height;
+        unsigned int dst_width;
+        unsigned int dst_height;
+        /* source column of each destination column */
+        std::vector<std::uint32_t> columns;
+        /* source row of each destination row */
+        std::vector<std::uint32_t> rows;
+        /*
+         * for each run of 16 destination columns, the first of 16
+         * source columns that hold all of the run, or `no_shuffle`
+         */
+        std::vector<std::uint32_t> block_base;
+        /* byte shuffles from `block_base`, 16 to a run */
+        std::vector<unsigned char> block_shuffle;
+        /* full-width chroma rows ahead of subsampling */
+        std::vector<unsigned char> chroma_rows;
+        /* destination of the rows taken by `push` */
+        ycbcr_view target;
+        /* source rows taken so far */
+        std::uint32_t pushed;
+        /* destination rows written so far */
+        unsigned int emitted;
+        /* source rows behind the last subsampled chroma row */
+        std::uint32_t last_top;
+        std::uint32_t last_bottom;
+        /* whether `push` leaves the chroma of `target` alone */
+        bool luma_only;
+
+        void prepare(unsigned int sw, unsigned int sh,
+            unsigned int dw, unsigned int dh);
+        void gather(unsigned char* out, unsigned char const* in)
+            const noexcept;
+    public:
+        static constexpr std::uint32_t no_shuffle = 0xffffffffu;
+
+        nn_scaler() noexcept;
+        /**
+         * Scale a frame.
+         * - dst destination; keeps its dimensions and chroma layout
+         * - src 4:4:4 source frame; when the dimensions and layout
+         *   match those of `dst`, the two boxes are swapped instead
+         */
+        void scale(ycbcr_box& dst, ycbcr_box& src);
+        /**
+         * Scale a frame region.
+         * - dst destination region
+         * - src 4:4:4 source region
+         */
+        void scale(ycbcr_view const& dst, const_ycbcr_view const& src);
+        /**
+         * Start scaling a frame that arrives a row at a time.
+         * - dst destination region
+         * - src_width source width
+         * - src_height source height
+         * - luma_only whether to scale the luma plane alone, leaving
+         *   the chroma of `dst` as it is; `push` then ignores the
+         *   chroma of its rows
+         * @throw std::bad_alloc on allocation failure
+         */
+        void start(ycbcr_view const& dst, unsigned int src_width,
+            unsigned int src_height, bool luma_only = false);
+        /**
+         * Take the next 4:4:4 source row. Destination rows get written
+         * as soon as their source row comes in.
+         * - row source row
+         */
+        void push(const_ycbcr_row_view const& row) noexcept;
+    };
+
+    /**
+     * Fits source images into the picture region of frames, with bars
+     * around the picture. Source rows go straight into the frame when
+     * no scaling is needed, and through a scaler a row at a time
+     * otherwise.
+     */
+    class frame_placer : public ycbcr_row_sink {
+    private:
+        frame_region picture;
+        fit_mode fit;
+        scale_filter filter;
+        band_runner run;
+        nn_scaler nearest;
+        resampler smooth;
+        ycbcr_box* frame;
+        /* part of the source in use */
+        frame_region from;
+        /* where that part goes in the frame */
+        ycbcr_view to;
+        /* whether source rows get written straight into `to` */
+        bool direct;
+        /* source columns the scaler reads, and whether that is all */
+        std::vector<std::uint32_t> columns;
+        bool all_columns;
+        /* flags for the source rows the scaler reads */
+        std::vector<unsigned char> row_flags;
+        /* source row for the scaler, holding only `columns` */
+        std::vector<unsigned char> scratch;
+
+        void place(unsigned int width, unsigned int height,
+            frame_region& inside);
+        void start(unsigned int width, unsigned int height, bool flat);
+    public:
+        /**
+         * - picture picture region within each frame
+         * - fit how to fit sources into the picture
+         * - filter scaling filter
+         * - run band runner for whole frames from `put_frame`
+         */
+        frame_placer(frame_region const& picture, fit_mode fit,
+            scale_filter filter, band_runner const& run = band_runner());
+        /**
+         * Set the frame to write the next image into.
+         * - f frame; keeps its dimensions and chroma layout
+         */
+        void set_frame(ycbcr_box& f) noexcept;
+        void begin(unsigned int width, unsigned int height) override;
+        /**
+         * Takes images whose chroma matches that of the bars around
+         * the picture, and fills the frame's chroma planes once for
+         * the lot of them.
+         */
+        bool begin_flat(unsigned int width, unsigned int height,
+            unsigned char cb, unsigned char cr) override;
+        unsigned char const* wanted_rows() const noexcept override;
+        std::uint32_t const* wanted_columns(unsigned int& count)
+            const noexcept override;
+        void sample_step(unsigned int width, unsigned int height,
+            unsigned int& step_x, unsigned int& step_y) noexcept override;
+        ycbcr_row_view row_buffer(unsigned int y) noexcept override;
+        void put_row(unsigned int y) noexcept override;
+        void put_frame(ycbcr_box& box) override;
+    };
+}
+
+#endif //hg_Theorize_Scale_h_
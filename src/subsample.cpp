@@ -0,0 +1,167 @@
+#include "subsample.hpp"
+
+#if (defined THEORIZE_NO_SIMD)
+#  define THEORIZE_SUBSAMPLE_X86 0
+#elif (defined __GNUC__) && ((defined __x86_64__) || (defined __i386__))
+#  define THEORIZE_SUBSAMPLE_X86 1
+#  include <immintrin.h>
+#  define THEORIZE_SUBSAMPLE_SSE2 __attribute__((target("sse2")))
+#  define THEORIZE_SUBSAMPLE_AVX2 __attribute__((target("avx2")))
+#else
+#  define THEORIZE_SUBSAMPLE_X86 0
+#endif //THEORIZE_NO_SIMD
+
+namespace theorize {
+    static
+    void subsample_scalar_rows(unsigned char const* top,
+        unsigned char const* bottom, std::size_t count,
+        unsigned char* dst) noexcept;
+#if THEORIZE_SUBSAMPLE_X86
+    static
+    std::size_t subsample_sse2_rows(unsigned char const* top,
+        unsigned char const* bottom, std::size_t count,
+        unsigned char* dst) noexcept THEORIZE_SUBSAMPLE_SSE2;
+    static
+    std::size_t subsample_avx2_rows(unsigned char const* top,
+        unsigned char const* bottom, std::size_t count,
+        unsigned char* dst) noexcept THEORIZE_SUBSAMPLE_AVX2;
+#endif //THEORIZE_SUBSAMPLE_X86
+
+    //BEGIN subsample / static
+    /*
+     * The single-row filter runs through the two-row kernels with
+     * both rows the same: (2a+2b+2)>>2 equals (a+b+1)>>1.
+     */
+    void subsample_scalar_rows(unsigned char const* top,
+        unsigned char const* bottom, std::size_t count,
+        unsigned char* dst) noexcept
+    {
+        std::size_t i;
+        for (i = 0; i+1 < count; i += 2) {
+            unsigned int const sum = top[i] + top[i+1]
+                + bottom[i] + bottom[i+1];
+            dst[i>>1] = static_cast<unsigned char>((sum + 2) >> 2);
+        }
+        if (i < count) {
+            unsigned int const sum = 2u*top[i] + 2u*bottom[i];
+            dst[i>>1] = static_cast<unsigned char>((sum + 2) >> 2);
+        }
+        return;
+    }
+
+#if THEORIZE_SUBSAMPLE_X86
+    inline
+    __m128i subsample_sse2_pairs(__m128i v, __m128i mask) noexcept
+        THEORIZE_SUBSAMPLE_SSE2;
+    inline
+    __m128i subsample_sse2_pairs(__m128i v, __m128i mask) noexcept {
+        return _mm_add_epi16(_mm_and_si128(v, mask), _mm_srli_epi16(v, 8));
+    }
+
+    std::size_t subsample_sse2_rows(unsigned char const* top,
+        unsigned char const* bottom, std::size_t count,
+        unsigned char* dst) noexcept
+    {
+        __m128i const mask = _mm_set1_epi16(0x00ff);
+        __m128i const two = _mm_set1_epi16(2);
+        std::size_t i;
+        for (i = 0; i+32 <= count; i += 32) {
+            __m128i const lo = _mm_add_epi16(
+                subsample_sse2_pairs(_mm_loadu_si128(
+                    reinterpret_cast<__m128i const*>(top+i)), mask),
+                subsample_sse2_pairs(_mm_loadu_si128(
+                    reinterpret_cast<__m128i const*>(bottom+i)), mask));
+            __m128i const hi = _mm_add_epi16(
+                subsample_sse2_pairs(_mm_loadu_si128(
+                    reinterpret_cast<__m128i const*>(top+i+16)), mask),
+                subsample_sse2_pairs(_mm_loadu_si128(
+                    reinterpret_cast<__m128i const*>(bottom+i+16)), mask));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst+(i>>1)),
+                _mm_packus_epi16(
+                    _mm_srli_epi16(_mm_add_epi16(lo, two), 2),
+                    _mm_srli_epi16(_mm_add_epi16(hi, two), 2)));
+        }
+        return i;
+    }
+
+    inline
+    __m256i subsample_avx2_pairs(__m256i v, __m256i mask) noexcept
+        THEORIZE_SUBSAMPLE_AVX2;
+    inline
+    __m256i subsample_avx2_pairs(__m256i v, __m256i mask) noexcept {
+        return _mm256_add_epi16(_mm256_and_si256(v, mask),
+            _mm256_srli_epi16(v, 8));
+    }
+
+    std::size_t subsample_avx2_rows(unsigned char const* top,
+        unsigned char const* bottom, std::size_t count,
+        unsigned char* dst) noexcept
+    {
+        __m256i const mask = _mm256_set1_epi16(0x00ff);
+        __m256i const two = _mm256_set1_epi16(2);
+        std::size_t i;
+        for (i = 0; i+64 <= count; i += 64) {
+            __m256i const lo = _mm256_add_epi16(
+                subsample_avx2_pairs(_mm256_loadu_si256(
+                    reinterpret_cast<__m256i const*>(top+i)), mask),
+                subsample_avx2_pairs(_mm256_loadu_si256(
+                    reinterpret_cast<__m256i const*>(bottom+i)), mask));
+            __m256i const hi = _mm256_add_epi16(
+                subsample_avx2_pairs(_mm256_loadu_si256(
+                    reinterpret_cast<__m256i const*>(top+i+32)), mask),
+                subsample_avx2_pairs(_mm256_loadu_si256(
+                    reinterpret_cast<__m256i const*>(bottom+i+32)), mask));
+            /* packus works within 128-bit lanes; put the quarters back */
+            __m256i const packed = _mm256_packus_epi16(
+                _mm256_srli_epi16(_mm256_add_epi16(lo, two), 2),
+                _mm256_srli_epi16(_mm256_add_epi16(hi, two), 2));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst+(i>>1)),
+                _mm256_permute4x64_epi64(packed, 0xd8));
+        }
+        return i;
+    }
+#endif //THEORIZE_SUBSAMPLE_X86
+    //END   subsample / static
+
+    //BEGIN subsample / namespace-local
+    void subsample_row(unsigned char const* src, std::size_t count,
+        unsigned char* dst, rgbycc_kernel kernel) noexcept
+    {
+        subsample_rows(src, src, count, dst, kernel);
+        return;
+    }
+
+    void subsample_row(unsigned char const* src, std::size_t count,
+        unsigned char* dst) noexcept
+    {
+        subsample_rows(src, src, count, dst, rgbycc_support());
+        return;
+    }
+
+    void subsample_rows(unsigned char const* top,
+        unsigned char const* bottom, std::size_t count,
+        unsigned char* dst, rgbycc_kernel kernel) noexcept
+    {
+        std::size_t done = 0;
+        if (kernel > rgbycc_support())
+            kernel = rgbycc_support();
+#if THEORIZE_SUBSAMPLE_X86
+        if (kernel >= rgbycc_kernel::avx2)
+            done = subsample_avx2_rows(top, bottom, count, dst);
+        else if (kernel >= rgbycc_kernel::sse2)
+            done = subsample_sse2_rows(top, bottom, count, dst);
+#endif //THEORIZE_SUBSAMPLE_X86
+        subsample_scalar_rows(top + done, bottom + done, count - done,
+            dst + (done>>1));
+        return;
+    }
+
+    void subsample_rows(unsigned char const* top,
+        unsigned char const* bottom, std::size_t count,
+        unsigned char* dst) noexcept
+    {
+        subsample_rows(top, bottom, count, dst, rgbycc_support());
+        return;
+    }
+    //END   subsample / namespace-local
+}
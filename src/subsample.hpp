@@ -0,0 +1,50 @@
+/**
+ * Chroma subsampling
+*/
+#if !(defined hg_Theorize_Subsample_h_)
+#define hg_Theorize_Subsample_h_
+
+#include "rgbycc.hpp"
+#include <cstddef>
+
+namespace theorize
+{
+    /**
+     * Halve a row of samples horizontally with a box filter. Each
+     * output sample is the rounded mean of two neighboring input
+     * samples; an odd last input sample is repeated.
+     * - src source samples
+     * - count number of source samples
+     * - dst destination for (count+1)/2 samples
+     * - kernel kernel family to use, as for `rgbycc_row`
+     */
+    void subsample_row(unsigned char const* src, std::size_t count,
+        unsigned char* dst, rgbycc_kernel kernel) noexcept;
+    /**
+     * Halve a row of samples horizontally with the best kernels.
+     */
+    void subsample_row(unsigned char const* src, std::size_t count,
+        unsigned char* dst) noexcept;
+    /**
+     * Halve a pair of rows both ways with a box filter. Each output
+     * sample is the rounded mean of a 2x2 block of input samples,
+     * matching Theora's centered chroma siting.
+     * - top upper source row
+     * - bottom lower source row; may equal `top` on the last row
+     *   of an odd-height plane
+     * - count number of samples in each source row
+     * - dst destination for (count+1)/2 samples
+     * - kernel kernel family to use, as for `rgbycc_row`
+     */
+    void subsample_rows(unsigned char const* top,
+        unsigned char const* bottom, std::size_t count,
+        unsigned char* dst, rgbycc_kernel kernel) noexcept;
+    /**
+     * Halve a pair of rows both ways with the best kernels.
+     */
+    void subsample_rows(unsigned char const* top,
+        unsigned char const* bottom, std::size_t count,
+        unsigned char* dst) noexcept;
+}
+
+#endif //hg_Theorize_Subsample_h_
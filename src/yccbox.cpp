@@ -3,88 +3,279 @@
 #include <new>
 #include <limits>
 #include <cstring>
+#include <utility>
+#include <cstdint>
 
 namespace theorize
 {
     static
-    unsigned char* yccbox_alloc(unsigned width, unsigned height);
+    std::size_t yccbox_size(unsigned width, unsigned height,
+        pixel_format format);
+    static
+    unsigned char* yccbox_alloc(std::size_t total);
+    static
+    unsigned char* yccbox_align(unsigned char* ptr) noexcept;
 
     //BEGIN yccbox / static
     static
-    constexpr std::size_t yccbox_total(unsigned width, unsigned height) {
-        return width * static_cast<std::size_t>(height) * 3;
+    constexpr unsigned int yccbox_stride(unsigned width) {
+        return (width + (ycbcr_box::alignment-1u))
+            & ~(ycbcr_box::alignment-1u);
+    }
+    static
+    constexpr std::size_t yccbox_plane(unsigned width, unsigned height) {
+        return yccbox_stride(width) * static_cast<std::size_t>(height);
     }
     static
-    constexpr std::size_t yccbox_addr(std::size_t width,
-            unsigned x, unsigned y)
+    constexpr std::size_t yccbox_chroma_plane(unsigned width,
+            unsigned height, pixel_format format)
     {
-        return (width * y + x);
+        return yccbox_plane(subsampled_width(width, format),
+            subsampled_height(height, format));
     }
-    unsigned char* yccbox_alloc(unsigned width, unsigned height) {
+    static
+    constexpr std::size_t yccbox_total(unsigned width, unsigned height,
+            pixel_format format)
+    {
+        return yccbox_plane(width, height)
+            + 2*yccbox_chroma_plane(width, height, format);
+    }
+    std::size_t yccbox_size(unsigned width, unsigned height,
+        pixel_format format)
+    {
         constexpr unsigned int max_size = 32767u;
         constexpr std::size_t max_total =
             std::numeric_limits<std::size_t>::max()/3;
         if (width == 0 || height == 0)
-            return nullptr;
+            return 0;
         else if (width > max_size || height > max_size)
             throw std::bad_alloc{};
-        else if (width >= max_total/height)
+        else if (yccbox_stride(width) >= max_total/height)
             throw std::bad_alloc{};
-        return new unsigned char[yccbox_total(width,height)];
+        return yccbox_total(width,height,format);
+    }
+    unsigned char* yccbox_alloc(std::size_t total) {
+        if (total == 0)
+            return nullptr;
+        return new unsigned char[total + (ycbcr_box::alignment-1u)];
+    }
+    unsigned char* yccbox_align(unsigned char* ptr) noexcept {
+        std::uintptr_t const misalign =
+            reinterpret_cast<std::uintptr_t>(ptr) & (ycbcr_box::alignment-1u);
+        if (misalign == 0 || ptr == nullptr)
+            return ptr;
+        return ptr + (ycbcr_box::alignment - misalign);
     }
     //END   yccbox / static
 
     //BEGIN ycbcr_box / rule-of-six
+    constexpr unsigned int ycbcr_box::alignment;
+
     ycbcr_box::ycbcr_box(ycbcr_box const& other)
-        : d(nullptr), w(0), h(0)
+        : p(nullptr), d(nullptr), w(0), h(0), s(0), cs(0),
+          f(pixel_format::yuv444), cap(0), border_inside(other.border_inside),
+          border_color(other.border_color), bordered(other.bordered),
+          flat_cb(other.flat_cb), flat_cr(other.flat_cr), flat(other.flat)
+    {
+        std::size_t const total = yccbox_total(other.w, other.h, other.f);
+        p = yccbox_alloc(total);
+        d = yccbox_align(p);
+        if (total)
+            std::memcpy(d, other.d, total);
+        w = other.w;
+        h = other.h;
+        s = other.s;
+        cs = other.cs;
+        f = other.f;
+        cap = total;
+    }
+    ycbcr_box::ycbcr_box(ycbcr_box&& other) noexcept
+        : p(other.p), d(other.d), w(other.w), h(other.h), s(other.s),
+          cs(other.cs), f(other.f), cap(other.cap),
+          border_inside(other.border_inside),
+          border_color(other.border_color), bordered(other.bordered),
+          flat_cb(other.flat_cb), flat_cr(other.flat_cr), flat(other.flat)
     {
-        d = yccbox_alloc(other.w, other.h);
-        std::memcpy(d, other.d, yccbox_total(other.w, other.h));
+        other.p = nullptr;
+        other.d = nullptr;
+        other.w = 0;
+        other.h = 0;
+        other.s = 0;
+        other.cs = 0;
+        other.cap = 0;
+        other.bordered = false;
+        other.flat = false;
     }
     ycbcr_box& ycbcr_box::operator=(ycbcr_box const& other) {
-        unsigned char* const new_ptr = yccbox_alloc(other.w, other.h);
-        std::memcpy(new_ptr, other.d, yccbox_total(other.w, other.h));
-        if (d)
-            delete[] d;
-        d = new_ptr;
+        if (this == &other)
+            return *this;
+        std::size_t const total = yccbox_total(other.w, other.h, other.f);
+        if (total > cap) {
+            unsigned char* const new_ptr = yccbox_alloc(total);
+            if (p)
+                delete[] p;
+            p = new_ptr;
+            d = yccbox_align(p);
+            cap = total;
+        }
+        if (total)
+            std::memcpy(d, other.d, total);
         w = other.w;
         h = other.h;
+        s = other.s;
+        cs = other.cs;
+        f = other.f;
+        border_inside = other.border_inside;
+        border_color = other.border_color;
+        bordered = other.bordered;
+        flat_cb = other.flat_cb;
+        flat_cr = other.flat_cr;
+        flat = other.flat;
+        return *this;
+    }
+    ycbcr_box& ycbcr_box::operator=(ycbcr_box&& other) noexcept {
+        ycbcr_box tmp(std::move(other));
+        swap(tmp);
         return *this;
     }
     ycbcr_box::~ycbcr_box() {
-        if (d)
-            delete[] d;
+        if (p)
+            delete[] p;
+        p = nullptr;
         d = nullptr;
     }
+    void ycbcr_box::swap(ycbcr_box& other) noexcept {
+        using std::swap;
+        swap(p, other.p);
+        swap(d, other.d);
+        swap(w, other.w);
+        swap(h, other.h);
+        swap(s, other.s);
+        swap(cs, other.cs);
+        swap(f, other.f);
+        swap(cap, other.cap);
+        swap(border_inside, other.border_inside);
+        swap(border_color, other.border_color);
+        swap(bordered, other.bordered);
+        swap(flat_cb, other.flat_cb);
+        swap(flat_cr, other.flat_cr);
+        swap(flat, other.flat);
+    }
     //END   ycbcr_box / rule-of-six
 
     //BEGIN ycbcr_box / methods
     void ycbcr_box::resize(unsigned width, unsigned height) {
-        if (w == width && h == height)
+        resize(width, height, f);
+        return;
+    }
+    void ycbcr_box::resize(unsigned width, unsigned height,
+        pixel_format format)
+    {
+        if (w == width && h == height && f == format)
             return;
-        unsigned char* const new_ptr = yccbox_alloc(width, height);
-        if (d)
-            delete[] d;
-        d = new_ptr;
+        std::size_t const total = yccbox_size(width, height, format);
+        if (total > cap) {
+            unsigned char* const new_ptr = yccbox_alloc(total);
+            if (p)
+                delete[] p;
+            p = new_ptr;
+            d = yccbox_align(p);
+            cap = total;
+        }
         w = width;
         h = height;
+        s = yccbox_stride(width);
+        cs = yccbox_stride(subsampled_width(width, format));
+        f = format;
+        bordered = false;
+        flat = false;
         return;
     }
-    ycbcr ycbcr_box::get(unsigned int x, unsigned int y) const noexcept {
-        unsigned char const* const ptr = d+yccbox_addr(w,x,y);
-        unsigned int const total = w * h;
-        return ycbcr{ptr[0],ptr[total],ptr[2*total]};
-    }
-    void ycbcr_box::set(unsigned int x, unsigned int y, ycbcr value) noexcept {
-        unsigned char* const ptr = d+yccbox_addr(w,x,y);
-        unsigned int const total = w * h;
-        ptr[0] = value.y;
-        ptr[total] = value.cb;
-        ptr[2*total] = value.cr;
+    void ycbcr_box::reserve(unsigned width, unsigned height) {
+        reserve(width, height, f);
+        return;
+    }
+    void ycbcr_box::reserve(unsigned width, unsigned height,
+        pixel_format format)
+    {
+        std::size_t const total = yccbox_size(width, height, format);
+        if (total <= cap)
+            return;
+        unsigned char* const new_ptr = yccbox_alloc(total);
+        unsigned char* const new_d = yccbox_align(new_ptr);
+        if (p) {
+            std::memcpy(new_d, d, yccbox_total(w, h, f));
+            delete[] p;
+        }
+        p = new_ptr;
+        d = new_d;
+        cap = total;
         return;
     }
     void ycbcr_box::grey() noexcept {
-        std::memset(d, 128, yccbox_total(w,h));
+        std::memset(d, 128, yccbox_total(w,h,f));
+        bordered = false;
+        flat_cb = 128;
+        flat_cr = 128;
+        flat = true;
+    }
+    void ycbcr_box::fill_border(frame_region const& inside, ycbcr color)
+        noexcept
+    {
+        if (bordered
+        &&  inside.x == border_inside.x && inside.y == border_inside.y
+        &&  inside.width == border_inside.width
+        &&  inside.height == border_inside.height
+        &&  color.y == border_color.y && color.cb == border_color.cb
+        &&  color.cr == border_color.cr)
+            return;
+        plane_view const planes[3] = { y_view(), cb_view(), cr_view() };
+        unsigned char const values[3] = { color.y, color.cb, color.cr };
+        for (int i = 0; i < 3; ++i) {
+            plane_view const& plane = planes[i];
+            pixel_format const format = i ? f : pixel_format::yuv444;
+            unsigned int const left = subsampled_width(inside.x, format);
+            unsigned int const top = subsampled_height(inside.y, format);
+            unsigned int const right = left
+                + subsampled_width(inside.width, format);
+            unsigned int const bottom = top
+                + subsampled_height(inside.height, format);
+            for (unsigned int y = 0; y < plane.height(); ++y) {
+                unsigned char* const row = plane.row(y);
+                if (y < top || y >= bottom) {
+                    std::memset(row, values[i], plane.width());
+                    continue;
+                }
+                std::memset(row, values[i], left);
+                if (right < plane.width())
+                    std::memset(row+right, values[i], plane.width()-right);
+            }
+        }
+        border_inside = inside;
+        border_color = color;
+        bordered = true;
+        if (color.cb != flat_cb || color.cr != flat_cr)
+            flat = false;
+        return;
+    }
+    void ycbcr_box::forget_border() noexcept {
+        bordered = false;
+    }
+    void ycbcr_box::fill_chroma(unsigned char cb, unsigned char cr) noexcept {
+        if (flat && cb == flat_cb && cr == flat_cr)
+            return;
+        unsigned char* const cb_data = cb_plane();
+        unsigned char* const cr_data = cr_plane();
+        std::size_t const size = static_cast<std::size_t>(cs)*chroma_height();
+        std::memset(cb_data, cb, size);
+        std::memset(cr_data, cr, size);
+        flat_cb = cb;
+        flat_cr = cr;
+        flat = true;
+        return;
+    }
+    void ycbcr_box::forget_chroma() noexcept {
+        flat = false;
     }
     unsigned char* ycbcr_box::y_plane() noexcept {
         return d;
@@ -92,17 +283,108 @@ namespace theorize
     unsigned char const* ycbcr_box::y_plane() const noexcept {
         return d;
     }
+    unsigned int ycbcr_box::chroma_width() const noexcept {
+        return subsampled_width(w, f);
+    }
+    unsigned int ycbcr_box::chroma_height() const noexcept {
+        return subsampled_height(h, f);
+    }
     unsigned char* ycbcr_box::cb_plane() noexcept {
-        return d + w*h;
+        return d + yccbox_plane(w, h);
     }
     unsigned char const* ycbcr_box::cb_plane() const noexcept {
-        return d + w*h;
+        return d + yccbox_plane(w, h);
     }
     unsigned char* ycbcr_box::cr_plane() noexcept {
-        return d + 2*w*h;
+        return d + yccbox_plane(w, h) + yccbox_chroma_plane(w, h, f);
     }
     unsigned char const* ycbcr_box::cr_plane() const noexcept {
-        return d + 2*w*h;
+        return d + yccbox_plane(w, h) + yccbox_chroma_plane(w, h, f);
+    }
+    plane_view ycbcr_box::y_view() noexcept {
+        return plane_view(y_plane(), w, h, s);
+    }
+    const_plane_view ycbcr_box::y_view() const noexcept {
+        return const_plane_view(y_plane(), w, h, s);
+    }
+    plane_view ycbcr_box::cb_view() noexcept {
+        return plane_view(cb_plane(), chroma_width(), chroma_height(), cs);
+    }
+    const_plane_view ycbcr_box::cb_view() const noexcept {
+        return const_plane_view(cb_plane(),
+            chroma_width(), chroma_height(), cs);
+    }
+    plane_view ycbcr_box::cr_view() noexcept {
+        return plane_view(cr_plane(), chroma_width(), chroma_height(), cs);
+    }
+    const_plane_view ycbcr_box::cr_view() const noexcept {
+        return const_plane_view(cr_plane(),
+            chroma_width(), chroma_height(), cs);
+    }
+    ycbcr_row_view ycbcr_box::row(unsigned int y) noexcept {
+        std::size_t const offset = static_cast<std::size_t>(s)*y;
+        return ycbcr_row_view{y_plane() + offset, cb_plane() + offset,
+            cr_plane() + offset, w};
+    }
+    const_ycbcr_row_view ycbcr_box::row(unsigned int y) const noexcept {
+        std::size_t const offset = static_cast<std::size_t>(s)*y;
+        return const_ycbcr_row_view{y_plane() + offset, cb_plane() + offset,
+            cr_plane() + offset, w};
+    }
+    ycbcr_view ycbcr_box::view() noexcept {
+        return ycbcr_view{y_view(), cb_view(), cr_view(), f};
+    }
+    const_ycbcr_view ycbcr_box::view() const noexcept {
+        return const_ycbcr_view{y_view(), cb_view(), cr_view(), f};
     }
     //END   ycbcr_box / methods
-}
\ No newline at end of file
+
+    //BEGIN ycbcr_row_sink / methods
+    bool ycbcr_row_sink::begin_flat(unsigned int /*width*/,
+        unsigned int /*height*/, unsigned char /*cb*/, unsigned char /*cr*/)
+    {
+        return false;
+    }
+    unsigned char const* ycbcr_row_sink::wanted_rows() const noexcept {
+        return nullptr;
+    }
+    std::uint32_t const* ycbcr_row_sink::wanted_columns(unsigned int& count)
+        const noexcept
+    {
+        count = 0;
+        return nullptr;
+    }
+    void ycbcr_row_sink::sample_step(unsigned int /*width*/,
+        unsigned int /*height*/, unsigned int& step_x, unsigned int& step_y)
+        noexcept
+    {
+        step_x = 1;
+        step_y = 1;
+        return;
+    }
+    void ycbcr_row_sink::put_frame(ycbcr_box& box) {
+        ycbcr_box const& source = box;
+        begin(box.width(), box.height());
+        unsigned char const* const rows = wanted_rows();
+        unsigned int count;
+        std::uint32_t const* const columns = wanted_columns(count);
+        for (unsigned int y = 0; y < box.height(); ++y) {
+            if (rows != nullptr && !rows[y])
+                continue;
+            const_ycbcr_row_view const in = source.row(y);
+            ycbcr_row_view const out = row_buffer(y);
+            if (columns == nullptr) {
+                std::memcpy(out.y, in.y, in.width);
+                std::memcpy(out.cb, in.cb, in.width);
+                std::memcpy(out.cr, in.cr, in.width);
+            } else for (unsigned int i = 0; i < count; ++i) {
+                out.y[i] = in.y[columns[i]];
+                out.cb[i] = in.cb[columns[i]];
+                out.cr[i] = in.cr[columns[i]];
+            }
+            put_row(y);
+        }
+        return;
+    }
+    //END   ycbcr_row_sink / methods
+}
@@ -4,41 +4,413 @@
 #if !(defined hg_Theorize_YCbCrBox_h_)
 #define hg_Theorize_YCbCrBox_h_
 
+#include <cstddef>
+#include <cstdint>
+
 namespace theorize
 {
+    /**
+     * Chroma plane layouts.
+     */
+    enum class pixel_format {
+        /** full resolution chroma */
+        yuv444 = 0,
+        /** chroma halved horizontally */
+        yuv422 = 1,
+        /** chroma halved both ways */
+        yuv420 = 2
+    };
+
+    /**
+     * - width luma width
+     * - format chroma layout
+     * @return chroma width
+     */
+    constexpr unsigned int subsampled_width
+        (unsigned int width, pixel_format format) noexcept
+    {
+        return format == pixel_format::yuv444 ? width : (width+1u)>>1;
+    }
+    /**
+     * - height luma height
+     * - format chroma layout
+     * @return chroma height
+     */
+    constexpr unsigned int subsampled_height
+        (unsigned int height, pixel_format format) noexcept
+    {
+        return format == pixel_format::yuv420 ? (height+1u)>>1 : height;
+    }
+
     struct ycbcr {
         unsigned char y;
         unsigned char cb;
         unsigned char cr;
     };
     /**
-     *
+     * Rectangle of pixels.
+     */
+    struct frame_region {
+        unsigned int x;
+        unsigned int y;
+        unsigned int width;
+        unsigned int height;
+    };
+    /**
+     * Rows of one sample plane.
+     */
+    template <typename T>
+    class basic_plane_view {
+    private:
+        T* d;
+        unsigned int w;
+        unsigned int h;
+        std::size_t s;
+    public:
+        constexpr basic_plane_view() noexcept
+            : d(nullptr), w(0), h(0), s(0)
+        {
+        }
+        constexpr basic_plane_view(T* data, unsigned int width,
+                unsigned int height, std::size_t stride) noexcept
+            : d(data), w(width), h(height), s(stride)
+        {
+        }
+        template <typename U>
+        constexpr basic_plane_view(basic_plane_view<U> const& other) noexcept
+            : d(other.data()), w(other.width()), h(other.height()),
+              s(other.stride())
+        {
+        }
+        T* data() const noexcept { return d; }
+        unsigned int width() const noexcept { return w; }
+        unsigned int height() const noexcept { return h; }
+        std::size_t stride() const noexcept { return s; }
+        /**
+         * - y row index
+         * @return the first sample of the row
+         */
+        T* row(unsigned int y) const noexcept { return d + s*y; }
+        /**
+         * @return a view of part of this plane
+         */
+        basic_plane_view sub(unsigned int x, unsigned int y,
+            unsigned int width, unsigned int height) const noexcept
+        {
+            return basic_plane_view(d + s*y + x, width, height, s);
+        }
+    };
+    typedef basic_plane_view<unsigned char> plane_view;
+    typedef basic_plane_view<unsigned char const> const_plane_view;
+
+    /**
+     * One row of each of the three planes of a box.
+     */
+    template <typename T>
+    struct basic_ycbcr_row_view {
+        T* y;
+        T* cb;
+        T* cr;
+        unsigned int width;
+
+        ycbcr get(unsigned int x) const noexcept {
+            return ycbcr{y[x], cb[x], cr[x]};
+        }
+        void set(unsigned int x, ycbcr value) const noexcept {
+            y[x] = value.y;
+            cb[x] = value.cb;
+            cr[x] = value.cr;
+        }
+    };
+    typedef basic_ycbcr_row_view<unsigned char> ycbcr_row_view;
+    typedef basic_ycbcr_row_view<unsigned char const> const_ycbcr_row_view;
+
+    /**
+     * All three planes of a box, or of a region of one.
+     */
+    template <typename T>
+    struct basic_ycbcr_view {
+        basic_plane_view<T> y;
+        basic_plane_view<T> cb;
+        basic_plane_view<T> cr;
+        pixel_format format;
+
+        unsigned int width() const noexcept { return y.width(); }
+        unsigned int height() const noexcept { return y.height(); }
+        /**
+         * - r region in luma samples; with subsampled chroma, the
+         *   region should start on an even column and row
+         * @return a view of the region
+         */
+        basic_ycbcr_view region(frame_region const& r) const noexcept {
+            frame_region const c = {
+                subsampled_width(r.x, format),
+                subsampled_height(r.y, format),
+                subsampled_width(r.width, format),
+                subsampled_height(r.height, format)
+            };
+            return basic_ycbcr_view{
+                y.sub(r.x, r.y, r.width, r.height),
+                cb.sub(c.x, c.y, c.width, c.height),
+                cr.sub(c.x, c.y, c.width, c.height),
+                format
+            };
+        }
+        template <typename U>
+        operator basic_ycbcr_view<U>() const noexcept {
+            return basic_ycbcr_view<U>{y, cb, cr, format};
+        }
+    };
+    typedef basic_ycbcr_view<unsigned char> ycbcr_view;
+    typedef basic_ycbcr_view<unsigned char const> const_ycbcr_view;
+
+    /**
+     * Planar YCbCr image.
      */
     class ycbcr_box {
     private:
+        unsigned char* p;
         unsigned char* d;
         unsigned int w;
         unsigned int h;
+        unsigned int s;
+        unsigned int cs;
+        pixel_format f;
+        std::size_t cap;
+        frame_region border_inside;
+        ycbcr border_color;
+        bool bordered;
+        /* the chroma value of every sample, when `flat` */
+        unsigned char flat_cb;
+        unsigned char flat_cr;
+        bool flat;
     public:
+        /**
+         * Alignment of each plane and of each row stride, in bytes.
+         */
+        static constexpr unsigned int alignment = 64u;
+
         constexpr ycbcr_box() noexcept
-            : d(nullptr), w(0), h(0)
+            : p(nullptr), d(nullptr), w(0), h(0), s(0), cs(0),
+              f(pixel_format::yuv444), cap(0), border_inside{0,0,0,0},
+              border_color{0,0,0}, bordered(false), flat_cb(0),
+              flat_cr(0), flat(false)
         {
         }
         ycbcr_box(ycbcr_box const& other);
+        ycbcr_box(ycbcr_box&& other) noexcept;
         ycbcr_box& operator=(ycbcr_box const& other);
+        ycbcr_box& operator=(ycbcr_box&& other) noexcept;
         ~ycbcr_box();
+        void swap(ycbcr_box& other) noexcept;
+        /**
+         * Change the dimensions of the box. Sample values are left
+         * unspecified. Storage is only reallocated when the new
+         * dimensions need more of it than the box already holds.
+         * - width new width in pixels
+         * - height new height in pixels
+         */
         void resize(unsigned width, unsigned height);
-        ycbcr get(unsigned int x, unsigned int y) const noexcept;
-        void set(unsigned int x, unsigned int y, ycbcr value) noexcept;
+        /**
+         * Change the dimensions and chroma layout of the box.
+         * - width new width in pixels
+         * - height new height in pixels
+         * - format new chroma layout
+         */
+        void resize(unsigned width, unsigned height, pixel_format format);
+        /**
+         * Make sure that later resizes up to the given dimensions,
+         * in the current chroma layout, do not allocate. Dimensions,
+         * chroma layout and samples are kept.
+         * - width width in pixels to reserve for
+         * - height height in pixels to reserve for
+         */
+        void reserve(unsigned width, unsigned height);
+        /**
+         * Make sure that later resizes up to the given dimensions in
+         * the given chroma layout do not allocate. Reserving for
+         * `pixel_format::yuv444` covers every layout. Dimensions,
+         * chroma layout and samples are kept.
+         * - width width in pixels to reserve for
+         * - height height in pixels to reserve for
+         * - format chroma layout to reserve for
+         */
+        void reserve(unsigned width, unsigned height, pixel_format format);
+        /**
+         * @return the number of bytes of sample storage held
+         */
+        std::size_t capacity() const noexcept { return cap; }
+        /**
+         * Read one pixel of a 4:4:4 box. Prefer `row` for loops over
+         * many pixels.
+         */
+        ycbcr get(unsigned int x, unsigned int y) const noexcept {
+            return row(y).get(x);
+        }
+        /**
+         * Write one pixel of a 4:4:4 box. Prefer `row` for loops over
+         * many pixels.
+         */
+        void set(unsigned int x, unsigned int y, ycbcr value) noexcept {
+            row(y).set(x, value);
+        }
         unsigned int width() const noexcept { return w; }
         unsigned int height() const noexcept { return h; }
+        pixel_format format() const noexcept { return f; }
+        /**
+         * @return width of the chroma planes
+         */
+        unsigned int chroma_width() const noexcept;
+        /**
+         * @return height of the chroma planes
+         */
+        unsigned int chroma_height() const noexcept;
+        /**
+         * @return distance in bytes from one row of the luma plane to
+         *   the next,
+         *   a multiple of `alignment` at least as large as the width
+         */
+        unsigned int stride() const noexcept { return s; }
+        unsigned int y_stride() const noexcept { return s; }
+        unsigned int cb_stride() const noexcept { return cs; }
+        unsigned int cr_stride() const noexcept { return cs; }
+        /**
+         * Fill the whole box with mid grey.
+         */
         void grey() noexcept;
+        /**
+         * Fill everything outside a region with one color. The box
+         * remembers the last border it drew, and drawing the same
+         * border again does nothing until the box is resized, greyed,
+         * or the border changes. Writes outside the region through
+         * other means are not tracked.
+         * - inside region to leave alone
+         * - color border color
+         */
+        void fill_border(frame_region const& inside, ycbcr color) noexcept;
+        /**
+         * Mark the border as overwritten, so that the next call to
+         * `fill_border` draws it again.
+         */
+        void forget_border() noexcept;
+        /**
+         * Fill both chroma planes, border and all, with one value
+         * each. As with `fill_border`, filling again with the same
+         * values does nothing until the box is resized or something
+         * else fills it.
+         * - cb blue difference value
+         * - cr red difference value
+         */
+        void fill_chroma(unsigned char cb, unsigned char cr) noexcept;
+        /**
+         * Mark the chroma planes as overwritten, so that the next call
+         * to `fill_chroma` fills them again. Call this after writing
+         * chroma through views or plane pointers.
+         */
+        void forget_chroma() noexcept;
         unsigned char* y_plane() noexcept;
         unsigned char const* y_plane() const noexcept;
         unsigned char* cb_plane() noexcept;
         unsigned char const* cb_plane() const noexcept;
         unsigned char* cr_plane() noexcept;
         unsigned char const* cr_plane() const noexcept;
+        plane_view y_view() noexcept;
+        const_plane_view y_view() const noexcept;
+        plane_view cb_view() noexcept;
+        const_plane_view cb_view() const noexcept;
+        plane_view cr_view() noexcept;
+        const_plane_view cr_view() const noexcept;
+        /**
+         * - y row index
+         * @return the row of each plane of a 4:4:4 box
+         */
+        ycbcr_row_view row(unsigned int y) noexcept;
+        const_ycbcr_row_view row(unsigned int y) const noexcept;
+        /**
+         * @return a view of all three planes
+         */
+        ycbcr_view view() noexcept;
+        const_ycbcr_view view() const noexcept;
+    };
+
+    inline void swap(ycbcr_box& a, ycbcr_box& b) noexcept {
+        a.swap(b);
+    }
+
+    /**
+     * Takes in a 4:4:4 image one row at a time, top to bottom.
+     */
+    class ycbcr_row_sink {
+    public:
+        virtual ~ycbcr_row_sink() = default;
+        /**
+         * Start an image.
+         * - width image width
+         * - height image height
+         * @throw std::bad_alloc on allocation failure
+         */
+        virtual void begin(unsigned int width, unsigned int height) = 0;
+        /**
+         * Start an image whose pixels all share one chroma value, such
+         * as a greyscale image. A sink that takes the offer fills in
+         * its own chroma and reads only the luma of each row. The
+         * default declines.
+         * - width image width
+         * - height image height
+         * - cb blue difference of every pixel
+         * - cr red difference of every pixel
+         * @return true if the image has started, false to have it
+         *   started with `begin` instead
+         * @throw std::bad_alloc on allocation failure
+         */
+        virtual bool begin_flat(unsigned int width, unsigned int height,
+            unsigned char cb, unsigned char cr);
+        /**
+         * Rows the sink will use from the image started last. The
+         * others never reach `row_buffer` or `put_row`. The default
+         * uses every row.
+         * @return a flag for each row, or null for every row
+         */
+        virtual unsigned char const* wanted_rows() const noexcept;
+        /**
+         * Columns the sink will use from the image started last.
+         * Rows from `row_buffer` then hold only these columns, packed
+         * in order. The default uses every column.
+         * - count receives the number of columns in use
+         * @return the columns in increasing order, or null for every
+         *   column
+         */
+        virtual std::uint32_t const* wanted_columns(unsigned int& count)
+            const noexcept;
+        /**
+         * How sparsely an image may be sampled, every `step_x` columns
+         * and `step_y` rows, before the sink loses detail. Readers of
+         * progressive images use this to stop early. The default needs
+         * every pixel.
+         * - width image width
+         * - height image height
+         * - step_x receives the column spacing
+         * - step_y receives the row spacing
+         */
+        virtual void sample_step(unsigned int width, unsigned int height,
+            unsigned int& step_x, unsigned int& step_y) noexcept;
+        /**
+         * - y row index
+         * @return where to write the row
+         */
+        virtual ycbcr_row_view row_buffer(unsigned int y) noexcept = 0;
+        /**
+         * Take the row written to the last `row_buffer`.
+         * - y row index
+         */
+        virtual void put_row(unsigned int y) noexcept = 0;
+        /**
+         * Take a whole image instead of a row at a time. The default
+         * copies each wanted row through `row_buffer` and `put_row`.
+         * - box the image; the sink may swap it out for another box
+         * @throw std::bad_alloc on allocation failure
+         */
+        virtual void put_frame(ycbcr_box& box);
     };
 }
 
@@ -0,0 +1,62 @@
+/*
+ * test-options.hpp
+ * command line options shared by the test programs
+ */
+#if !(defined hg_Theorize_TestOptions_h_)
+#define hg_Theorize_TestOptions_h_
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+    struct test_options {
+        /* random seed, from `-s` */
+        unsigned int seed;
+        /* largest deviation allowed, from `-d` */
+        int max_deviation;
+    };
+
+    /**
+     * Read the command line of a test program.
+     * - argc argument count
+     * - argv arguments
+     * - name program name for the usage message
+     * - deviation whether the program takes `-d`
+     * - out receives the options
+     * @return zero to run the test, or 2 after printing usage
+     */
+    int test_parse_options(int argc, char **argv, char const* name,
+        bool deviation, test_options& out)
+    {
+        int help_tf = 0;
+        out.seed = 1;
+        out.max_deviation = 0;
+        for (int argi = 1; argi < argc; ++argi) {
+            if (std::strcmp("-?", argv[argi]) == 0) {
+                help_tf = 1;
+            } else if (std::strcmp("-s", argv[argi]) == 0) {
+                if (++argi < argc)
+                    out.seed = static_cast<unsigned int>
+                        (std::strtoul(argv[argi], nullptr, 0));
+            } else if (deviation && std::strcmp("-d", argv[argi]) == 0) {
+                if (++argi < argc)
+                    out.max_deviation = std::atoi(argv[argi]);
+            }
+        }
+        if (help_tf) {
+            std::fprintf(stderr, "usage: %s [...options...]\n"
+                "  -?                 help message\n"
+                "  -s (number)        random seed\n", name);
+            if (deviation) {
+                std::fprintf(stderr,
+                    "  -d (number)        largest deviation allowed from the\n"
+                    "                     reference (default 0)\n");
+            }
+            return 2;
+        }
+        return 0;
+    }
+}
+
+#endif //hg_Theorize_TestOptions_h_
@@ -0,0 +1,156 @@
+/*
+ * test-pngycc.cpp
+ * PNG reader test program
+ */
+
+#include "../src/pngycc.hpp"
+#include "../src/rgbycc.hpp"
+#include "../deps/png-parts/src/png.h"
+#include "../deps/png-parts/src/z.h"
+#include "test-options.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+    /**
+     * Append a big-endian 32-bit value.
+     * - out stream to extend
+     * - value value to append
+     */
+    void test_put32(std::vector<unsigned char>& out, unsigned long int value)
+    {
+        out.push_back(static_cast<unsigned char>((value >> 24) & 255u));
+        out.push_back(static_cast<unsigned char>((value >> 16) & 255u));
+        out.push_back(static_cast<unsigned char>((value >> 8) & 255u));
+        out.push_back(static_cast<unsigned char>(value & 255u));
+    }
+
+    /**
+     * Append a chunk with its length and checksum.
+     * - out stream to extend
+     * - name four-letter chunk name
+     * - data chunk payload
+     */
+    void test_put_chunk(std::vector<unsigned char>& out, char const* name,
+        std::vector<unsigned char> const& data)
+    {
+        test_put32(out, data.size());
+        std::size_t const start = out.size();
+        out.insert(out.end(), name, name+4);
+        out.insert(out.end(), data.begin(), data.end());
+        pngparts_png_crc32 const chk = pngparts_png_crc32_update
+            (pngparts_png_crc32_new(), &out[start], out.size() - start);
+        test_put32(out, pngparts_png_crc32_tol(chk));
+    }
+
+    /**
+     * Build an 8-bit PNG stream with the rows stored uncompressed.
+     * - width image width
+     * - height image height
+     * - color_type PNG color type (0, 2 or 6)
+     * - pixels samples, row after row
+     * @return the stream
+     */
+    std::vector<unsigned char> test_make_png(unsigned int width,
+        unsigned int height, int color_type,
+        std::vector<unsigned char> const& pixels)
+    {
+        std::size_t const stride = pixels.size() / height;
+        std::vector<unsigned char> out(pngparts_png_signature(),
+            pngparts_png_signature() + 8);
+        std::vector<unsigned char> ihdr;
+        test_put32(ihdr, width);
+        test_put32(ihdr, height);
+        ihdr.push_back(8);
+        ihdr.push_back(static_cast<unsigned char>(color_type));
+        ihdr.push_back(0);
+        ihdr.push_back(0);
+        ihdr.push_back(0);
+        test_put_chunk(out, "IHDR", ihdr);
+        /* filter type 0 before each row, in one stored deflate block */
+        std::vector<unsigned char> raw;
+        for (unsigned int y = 0; y < height; ++y) {
+            raw.push_back(0);
+            raw.insert(raw.end(), pixels.begin() + y*stride,
+                pixels.begin() + (y+1)*stride);
+        }
+        std::vector<unsigned char> idat = {0x78, 0x01, 0x01};
+        idat.push_back(static_cast<unsigned char>(raw.size() & 255u));
+        idat.push_back(static_cast<unsigned char>(raw.size() >> 8));
+        idat.push_back(static_cast<unsigned char>(~raw.size() & 255u));
+        idat.push_back(static_cast<unsigned char>((~raw.size() >> 8) & 255u));
+        idat.insert(idat.end(), raw.begin(), raw.end());
+        pngparts_z_adler32 const chk = pngparts_z_adler32_update
+            (pngparts_z_adler32_new(), raw.data(), raw.size());
+        test_put32(idat, pngparts_z_adler32_tol(chk));
+        test_put_chunk(out, "IDAT", idat);
+        test_put_chunk(out, "IEND", std::vector<unsigned char>());
+        return out;
+    }
+}
+
+int main(int argc, char **argv) {
+    static int const color_types[] = {0, 2, 6};
+    static theorize::pixel_format const formats[] = {
+        theorize::pixel_format::yuv420,
+        theorize::pixel_format::yuv422,
+        theorize::pixel_format::yuv444
+    };
+    test_options options;
+    int result = test_parse_options(argc, argv, "test_pngycc",
+        false, options);
+    if (result != 0)
+        return result;
+    std::srand(options.seed);
+    unsigned int const width = 13, height = 7;
+    for (int color_type : color_types) {
+        unsigned int const channels = (color_type == 0) ? 1u
+            : (color_type == 2) ? 3u : 4u;
+        std::vector<unsigned char> pixels(width*height*channels);
+        for (unsigned char& c : pixels)
+            c = static_cast<unsigned char>(std::rand() & 255);
+        std::vector<unsigned char> const png =
+            test_make_png(width, height, color_type, pixels);
+        /* the reader must lay the box out as 4:4:4 whatever it was */
+        for (theorize::pixel_format format : formats) {
+            theorize::ycbcr_box box;
+            box.resize(2, 2, format);
+            if (!theorize::pngycc_read(png.data(), png.size(), box)) {
+                std::fprintf(stderr, "color type %i: read failed\n",
+                    color_type);
+                return 1;
+            } else if (box.format() != theorize::pixel_format::yuv444
+            ||  box.width() != width || box.height() != height)
+            {
+                std::fprintf(stderr, "color type %i: box is %ux%u, "
+                    "format %i\n", color_type, box.width(), box.height(),
+                    static_cast<int>(box.format()));
+                return 1;
+            }
+            for (unsigned int y = 0; y < height && result == 0; ++y) {
+                theorize::const_ycbcr_row_view const row =
+                    static_cast<theorize::ycbcr_box const&>(box).row(y);
+                for (unsigned int x = 0; x < width; ++x) {
+                    unsigned char const* const px =
+                        &pixels[(y*width + x)*channels];
+                    theorize::ycbcr const want = (channels == 1)
+                        ? theorize::rgbycc_reference(px[0], px[0], px[0])
+                        : theorize::rgbycc_reference(px[0], px[1], px[2]);
+                    theorize::ycbcr const got = row.get(x);
+                    if (got.y != want.y || got.cb != want.cb
+                    ||  got.cr != want.cr)
+                    {
+                        std::fprintf(stderr, "color type %i, format %i: "
+                            "pixel (%u, %u) mismatch\n", color_type,
+                            static_cast<int>(format), x, y);
+                        result = 1;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,236 @@
+/*
+ * test-resample.cpp
+ * separable resampler test program
+ */
+
+#include "../src/resample.hpp"
+#include "../src/rgbycc.hpp"
+#include "../src/yccbox.hpp"
+#include "test-options.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <array>
+#include <vector>
+
+namespace {
+    char const* filter_name(theorize::scale_filter f) {
+        switch (f) {
+        case theorize::scale_filter::bilinear: return "bilinear";
+        case theorize::scale_filter::bicubic: return "bicubic";
+        case theorize::scale_filter::lanczos: return "lanczos";
+        case theorize::scale_filter::area: return "area";
+        default: return "nearest";
+        }
+    }
+
+    /* fill a 4:4:4 box with noise, or with one color */
+    void fill(theorize::ycbcr_box& box, unsigned int width,
+        unsigned int height, int flat)
+    {
+        box.resize(width, height, theorize::pixel_format::yuv444);
+        for (unsigned int y = 0; y < height; ++y) {
+            theorize::ycbcr_row_view const row = box.row(y);
+            for (unsigned int x = 0; x < width; ++x) {
+                row.set(x, flat ? theorize::ycbcr{200, 17, 93}
+                    : theorize::ycbcr{
+                        static_cast<unsigned char>(std::rand()),
+                        static_cast<unsigned char>(std::rand()),
+                        static_cast<unsigned char>(std::rand())});
+            }
+        }
+    }
+
+    /* every sample of every plane must be `value` */
+    bool flat_planes(theorize::ycbcr_box const& box) {
+        theorize::const_plane_view const planes[3] =
+            { box.y_view(), box.cb_view(), box.cr_view() };
+        unsigned char const values[3] = {200, 17, 93};
+        for (int i = 0; i < 3; ++i) {
+            for (unsigned int y = 0; y < planes[i].height(); ++y) {
+                for (unsigned int x = 0; x < planes[i].width(); ++x) {
+                    if (planes[i].row(y)[x] != values[i])
+                        return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /* the two boxes hold the same samples */
+    bool same_planes(theorize::ycbcr_box const& a,
+        theorize::ycbcr_box const& b)
+    {
+        theorize::const_plane_view const pa[3] =
+            { a.y_view(), a.cb_view(), a.cr_view() };
+        theorize::const_plane_view const pb[3] =
+            { b.y_view(), b.cb_view(), b.cr_view() };
+        for (int i = 0; i < 3; ++i) {
+            for (unsigned int y = 0; y < pa[i].height(); ++y) {
+                if (std::memcmp(pa[i].row(y), pb[i].row(y), pa[i].width()))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    /* mean of each ratio-by-ratio block */
+    bool area_planes(theorize::ycbcr_box const& dst,
+        theorize::ycbcr_box const& src)
+    {
+        theorize::const_plane_view const in[3] =
+            { src.y_view(), src.cb_view(), src.cr_view() };
+        theorize::const_plane_view const out[3] =
+            { dst.y_view(), dst.cb_view(), dst.cr_view() };
+        for (int i = 0; i < 3; ++i) {
+            unsigned int const ratio = in[i].width()/out[i].width();
+            for (unsigned int y = 0; y < out[i].height(); ++y) {
+                for (unsigned int x = 0; x < out[i].width(); ++x) {
+                    unsigned int sum = 0;
+                    for (unsigned int j = 0; j < ratio*ratio; ++j)
+                        sum += in[i].row(y*ratio+j/ratio)[x*ratio+j%ratio];
+                    if (out[i].row(y)[x] != (sum + ratio*ratio/2)/(ratio*ratio))
+                        return false;
+                }
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv) {
+    test_options options;
+    int result = test_parse_options(argc, argv, "test_resample",
+        false, options);
+    if (result != 0)
+        return result;
+    static unsigned int const sizes[][2] = {
+        {1, 1}, {7, 5}, {16, 16}, {17, 9}, {33, 20},
+        {64, 48}, {100, 75}, {161, 83}, {320, 176}
+    };
+    static theorize::pixel_format const formats[] = {
+        theorize::pixel_format::yuv444,
+        theorize::pixel_format::yuv422,
+        theorize::pixel_format::yuv420
+    };
+    static theorize::scale_filter const filters[] = {
+        theorize::scale_filter::bilinear,
+        theorize::scale_filter::bicubic,
+        theorize::scale_filter::lanczos,
+        theorize::scale_filter::area
+    };
+    std::srand(options.seed);
+    /* weights sum to one, so flat frames stay flat */
+    for (theorize::scale_filter const filter : filters) {
+        theorize::resampler scaler(filter);
+        for (auto const& from : sizes) {
+            for (auto const& to : sizes) {
+                for (theorize::pixel_format const format : formats) {
+                    theorize::ycbcr_box src, dst;
+                    fill(src, from[0], from[1], 1);
+                    dst.resize(to[0], to[1], format);
+                    scaler.scale(dst, src);
+                    if (!flat_planes(dst)) {
+                        std::fprintf(stderr, "%s: %ux%u to %ux%u, "
+                            "format %i: flat frame changed\n",
+                            filter_name(filter), from[0], from[1],
+                            to[0], to[1], static_cast<int>(format));
+                        result = 1;
+                    }
+                }
+            }
+        }
+    }
+    /* exact 2x and 4x area reductions */{
+        theorize::resampler scaler(theorize::scale_filter::area);
+        static unsigned int const reductions[][3] = {
+            {128, 64, 2}, {96, 48, 4}, {40, 24, 2}
+        };
+        for (auto const& r : reductions) {
+            theorize::ycbcr_box src, dst;
+            fill(src, r[0]*r[2], r[1]*r[2], 0);
+            dst.resize(r[0], r[1], theorize::pixel_format::yuv444);
+            scaler.scale(dst, src);
+            if (!area_planes(dst, src)) {
+                std::fprintf(stderr, "area: %ux%u by %u: mismatch\n",
+                    r[0], r[1], r[2]);
+                result = 1;
+            }
+        }
+    }
+    /* rows taken one at a time give the same frame as a whole frame */
+    for (theorize::scale_filter const filter : filters) {
+        theorize::resampler whole(filter);
+        theorize::resampler rows(filter);
+        for (auto const& from : sizes) {
+            for (auto const& to : sizes) {
+                for (theorize::pixel_format const format : formats) {
+                    theorize::ycbcr_box src, ref, dst;
+                    fill(src, from[0], from[1], 0);
+                    ref.resize(to[0], to[1], format);
+                    dst.resize(to[0], to[1], format);
+                    whole.scale(ref.view(), src.view());
+                    rows.start(dst.view(), from[0], from[1]);
+                    for (unsigned int y = 0; y < from[1]; ++y) {
+                        theorize::ycbcr_box const& in = src;
+                        rows.push(in.row(y));
+                    }
+                    if (!same_planes(ref, dst)) {
+                        std::fprintf(stderr, "%s: %ux%u to %ux%u, "
+                            "format %i: rows differ from whole frame\n",
+                            filter_name(filter), from[0], from[1],
+                            to[0], to[1], static_cast<int>(format));
+                        result = 1;
+                    }
+                }
+            }
+        }
+    }
+    /* every kernel family gives the frame the scalar kernels give */
+    int const support = static_cast<int>(theorize::rgbycc_support());
+    for (int kernel = 1; kernel <= support; ++kernel) {
+        static unsigned int const halves[][4] = {
+            {64, 48, 32, 24}, {320, 176, 160, 88}, {320, 176, 80, 44}
+        };
+        std::vector<std::array<unsigned int, 4> > pairs;
+        for (auto const& from : sizes) {
+            for (auto const& to : sizes)
+                pairs.push_back({{from[0], from[1], to[0], to[1]}});
+        }
+        for (auto const& h : halves)
+            pairs.push_back({{h[0], h[1], h[2], h[3]}});
+        for (theorize::scale_filter const filter : filters) {
+            theorize::resampler scalar(filter,
+                theorize::rgbycc_kernel::scalar);
+            theorize::resampler whole(filter,
+                static_cast<theorize::rgbycc_kernel>(kernel));
+            theorize::resampler rows(filter,
+                static_cast<theorize::rgbycc_kernel>(kernel));
+            for (auto const& pair : pairs) {
+                for (theorize::pixel_format const format : formats) {
+                    theorize::ycbcr_box src, ref, dst, streamed;
+                    fill(src, pair[0], pair[1], 0);
+                    ref.resize(pair[2], pair[3], format);
+                    dst.resize(pair[2], pair[3], format);
+                    streamed.resize(pair[2], pair[3], format);
+                    scalar.scale(ref.view(), src.view());
+                    whole.scale(dst.view(), src.view());
+                    rows.start(streamed.view(), pair[0], pair[1]);
+                    for (unsigned int y = 0; y < pair[1]; ++y) {
+                        theorize::ycbcr_box const& in = src;
+                        rows.push(in.row(y));
+                    }
+                    if (!same_planes(ref, dst) || !same_planes(ref, streamed))
+                    {
+                        std::fprintf(stderr, "%s, kernels %i: %ux%u to "
+                            "%ux%u, format %i: differs from scalar kernels\n",
+                            filter_name(filter), kernel, pair[0], pair[1],
+                            pair[2], pair[3], static_cast<int>(format));
+                        result = 1;
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
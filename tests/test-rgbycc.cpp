@@ -0,0 +1,117 @@
+/*
+ * test-rgbycc.cpp
+ * RGB to YCbCr row converter test program
+ */
+
+#include "../src/rgbycc.hpp"
+#include "test-options.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+    int abs_diff(unsigned char a, unsigned char b) {
+        return a > b ? a - b : b - a;
+    }
+}
+
+int main(int argc, char **argv) {
+    test_options options;
+    int result = test_parse_options(argc, argv, "test_rgbycc",
+        true, options);
+    if (result != 0)
+        return result;
+    int const support = static_cast<int>(theorize::rgbycc_support());
+    /* 16-bit samples narrow to the nearest 8-bit step */{
+        unsigned long int off_count = 0;
+        for (unsigned int v = 0; v < 65536; ++v) {
+            // v/257 is never exactly halfway, so round half up
+            unsigned int const nearest = (2*v + 257) / 514;
+            unsigned int const out = theorize::rgbycc_narrow16(v);
+            if (out != nearest || out != ((v*255u + 32895u) >> 16)) {
+                if (off_count == 0) {
+                    std::fprintf(stderr, "narrow16(%u): %u, expected %u\n",
+                        v, out, nearest);
+                }
+                off_count += 1;
+            }
+        }
+        if (off_count) {
+            std::fprintf(stderr, "%lu of 65536 16-bit samples off\n",
+                off_count);
+            result = 1;
+        }
+    }
+    /* every color against the reference, one row per red/green pair */
+    for (int kernel = 0; kernel <= support && result == 0; ++kernel) {
+        std::vector<unsigned char> rgb(256*3);
+        std::vector<unsigned char> y(256), cb(256), cr(256);
+        int worst[3] = {0, 0, 0};
+        unsigned long int off_count = 0;
+        for (unsigned int red = 0; red < 256; ++red) {
+            for (unsigned int green = 0; green < 256; ++green) {
+                for (unsigned int blue = 0; blue < 256; ++blue) {
+                    rgb[blue*3+0] = static_cast<unsigned char>(red);
+                    rgb[blue*3+1] = static_cast<unsigned char>(green);
+                    rgb[blue*3+2] = static_cast<unsigned char>(blue);
+                }
+                theorize::rgbycc_row(rgb.data(), 3, 256,
+                    y.data(), cb.data(), cr.data(),
+                    static_cast<theorize::rgbycc_kernel>(kernel));
+                for (unsigned int blue = 0; blue < 256; ++blue) {
+                    theorize::ycbcr const ref =
+                        theorize::rgbycc_reference(red, green, blue);
+                    int const d[3] = {
+                        abs_diff(ref.y, y[blue]),
+                        abs_diff(ref.cb, cb[blue]),
+                        abs_diff(ref.cr, cr[blue])
+                    };
+                    for (int i = 0; i < 3; ++i) {
+                        if (d[i] > worst[i])
+                            worst[i] = d[i];
+                    }
+                    if (d[0] || d[1] || d[2])
+                        off_count += 1;
+                }
+            }
+        }
+        std::printf("kernels %i: max deviation: Y %i, Cb %i, Cr %i "
+            "(%lu of 16777216 colors off)\n", kernel,
+            worst[0], worst[1], worst[2], off_count);
+        int const max_deviation = options.max_deviation;
+        if (worst[0] > max_deviation || worst[1] > max_deviation
+        ||  worst[2] > max_deviation)
+        {
+            std::fprintf(stderr, "deviation exceeds %i\n", max_deviation);
+            result = 1;
+        }
+    }
+    /* vector kernels must match the scalar kernel exactly */{
+        std::srand(options.seed);
+        for (int kernel = 1; kernel <= support && result == 0; ++kernel) {
+            for (unsigned int channels = 3; channels <= 4; ++channels) {
+                for (std::size_t count = 0; count < 100; ++count) {
+                    std::vector<unsigned char> src(count*channels);
+                    std::vector<unsigned char> ref(count*3+3, 0xA5);
+                    std::vector<unsigned char> out(count*3+3, 0xA5);
+                    for (unsigned char& c : src)
+                        c = static_cast<unsigned char>(std::rand() & 255);
+                    theorize::rgbycc_row(src.data(), channels, count,
+                        ref.data(), ref.data()+count+1, ref.data()+2*count+2,
+                        theorize::rgbycc_kernel::scalar);
+                    theorize::rgbycc_row(src.data(), channels, count,
+                        out.data(), out.data()+count+1, out.data()+2*count+2,
+                        static_cast<theorize::rgbycc_kernel>(kernel));
+                    if (ref != out) {
+                        std::fprintf(stderr, "kernels %i: %u channels, "
+                            "%u pixels: mismatch\n", kernel, channels,
+                            static_cast<unsigned int>(count));
+                        result = 1;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,351 @@
+/*
+ * test-scale.cpp
+ * frame scaler test program
+ */
+
+#include "../src/scale.hpp"
+#include "../src/yccbox.hpp"
+#include "../src/subsample.hpp"
+#include "test-options.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+    /* fill a 4:4:4 box with noise */
+    void noise(theorize::ycbcr_box& box, unsigned int width,
+        unsigned int height)
+    {
+        box.resize(width, height, theorize::pixel_format::yuv444);
+        for (unsigned int y = 0; y < height; ++y) {
+            theorize::ycbcr_row_view const row = box.row(y);
+            for (unsigned int x = 0; x < width; ++x) {
+                row.y[x] = static_cast<unsigned char>(std::rand());
+                row.cb[x] = static_cast<unsigned char>(std::rand());
+                row.cr[x] = static_cast<unsigned char>(std::rand());
+            }
+        }
+    }
+
+    /* per-pixel nearest-neighbour scale, then subsample */
+    void reference(theorize::ycbcr_box& dst, theorize::ycbcr_box const& src)
+    {
+        theorize::ycbcr_box full;
+        full.resize(dst.width(), dst.height());
+        for (unsigned int y = 0; y < dst.height(); ++y) {
+            for (unsigned int x = 0; x < dst.width(); ++x) {
+                full.set(x, y, src.get(x*src.width()/dst.width(),
+                    y*src.height()/dst.height()));
+            }
+        }
+        theorize::const_plane_view const in[3] =
+            { full.y_view(), full.cb_view(), full.cr_view() };
+        theorize::plane_view const out[3] =
+            { dst.y_view(), dst.cb_view(), dst.cr_view() };
+        for (unsigned int y = 0; y < dst.height(); ++y)
+            std::memcpy(out[0].row(y), in[0].row(y), dst.width());
+        for (int i = 1; i < 3; ++i) {
+            for (unsigned int y = 0; y < out[i].height(); ++y) {
+                if (dst.format() == theorize::pixel_format::yuv444) {
+                    std::memcpy(out[i].row(y), in[i].row(y), dst.width());
+                } else if (dst.format() == theorize::pixel_format::yuv422) {
+                    theorize::subsample_row(in[i].row(y), dst.width(),
+                        out[i].row(y));
+                } else {
+                    unsigned int const bottom =
+                        (y*2+1 < dst.height()) ? y*2+1 : y*2;
+                    theorize::subsample_rows(in[i].row(y*2),
+                        in[i].row(bottom), dst.width(), out[i].row(y));
+                }
+            }
+        }
+    }
+
+    bool same(theorize::ycbcr_box const& a, theorize::ycbcr_box const& b) {
+        theorize::const_plane_view const pa[3] =
+            { a.y_view(), a.cb_view(), a.cr_view() };
+        theorize::const_plane_view const pb[3] =
+            { b.y_view(), b.cb_view(), b.cr_view() };
+        for (int i = 0; i < 3; ++i) {
+            if (pa[i].width() != pb[i].width()
+            ||  pa[i].height() != pb[i].height())
+                return false;
+            for (unsigned int y = 0; y < pa[i].height(); ++y) {
+                if (std::memcmp(pa[i].row(y), pb[i].row(y), pa[i].width()))
+                    return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv) {
+    test_options options;
+    int result = test_parse_options(argc, argv, "test_scale",
+        false, options);
+    if (result != 0)
+        return result;
+    static unsigned int const sizes[][2] = {
+        {1, 1}, {7, 5}, {16, 16}, {17, 9}, {33, 20},
+        {64, 48}, {100, 75}, {161, 83}, {320, 176}
+    };
+    static theorize::pixel_format const formats[] = {
+        theorize::pixel_format::yuv444,
+        theorize::pixel_format::yuv422,
+        theorize::pixel_format::yuv420
+    };
+    std::srand(options.seed);
+    theorize::nn_scaler scaler;
+    for (auto const& from : sizes) {
+        for (auto const& to : sizes) {
+            for (theorize::pixel_format const format : formats) {
+                theorize::ycbcr_box src, dst, ref;
+                noise(src, from[0], from[1]);
+                ref.resize(to[0], to[1], format);
+                reference(ref, src);
+                dst.resize(to[0], to[1], format);
+                scaler.scale(dst, src);
+                if (!same(dst, ref)) {
+                    std::fprintf(stderr, "%ux%u to %ux%u, format %i: "
+                        "mismatch\n", from[0], from[1], to[0], to[1],
+                        static_cast<int>(format));
+                    result = 1;
+                }
+            }
+        }
+    }
+    /* fitted regions stay inside both images */{
+        static theorize::fit_mode const modes[] = {
+            theorize::fit_mode::stretch,
+            theorize::fit_mode::letterbox,
+            theorize::fit_mode::crop,
+            theorize::fit_mode::none
+        };
+        for (auto const& from : sizes) {
+            for (auto const& to : sizes) {
+                for (theorize::fit_mode const mode : modes) {
+                    theorize::frame_region in, out;
+                    theorize::fit_region(mode, from[0], from[1],
+                        to[0], to[1], in, out);
+                    bool ok = in.x+in.width <= from[0]
+                        && in.y+in.height <= from[1]
+                        && out.x+out.width <= to[0]
+                        && out.y+out.height <= to[1]
+                        && (out.x & 1u) == 0 && (out.y & 1u) == 0;
+                    switch (mode) {
+                    case theorize::fit_mode::stretch:
+                        ok = ok && in.width == from[0]
+                            && in.height == from[1]
+                            && out.width == to[0] && out.height == to[1];
+                        break;
+                    case theorize::fit_mode::letterbox:
+                        ok = ok && in.width == from[0]
+                            && in.height == from[1]
+                            && (out.width == to[0] || out.height == to[1]);
+                        break;
+                    case theorize::fit_mode::crop:
+                        ok = ok && out.width == to[0] && out.height == to[1]
+                            && (in.width == from[0] || in.height == from[1]);
+                        break;
+                    case theorize::fit_mode::none:
+                        ok = ok && in.width == out.width
+                            && in.height == out.height;
+                        break;
+                    }
+                    if (!ok) {
+                        std::fprintf(stderr, "%ux%u in %ux%u, fit %i: "
+                            "bad region\n", from[0], from[1], to[0], to[1],
+                            static_cast<int>(mode));
+                        result = 1;
+                    }
+                }
+            }
+        }
+    }
+    /* scaling into a region leaves a border of the right color */{
+        static theorize::frame_region const places[] = {
+            {0, 0, 100, 75}, {6, 2, 100, 75}, {8, 0, 96, 80}, {0, 10, 112, 60}
+        };
+        theorize::ycbcr const black = {16, 128, 128};
+        for (theorize::pixel_format const format : formats) {
+            theorize::ycbcr_box frame;
+            frame.resize(112, 80, format);
+            for (theorize::frame_region const& place : places) {
+                theorize::ycbcr_box src, ref;
+                noise(src, 33, 20);
+                ref.resize(place.width, place.height, format);
+                reference(ref, src);
+                frame.fill_border(place, black);
+                scaler.scale(frame.view().region(place), src.view());
+                theorize::ycbcr_view const whole = frame.view();
+                theorize::const_ycbcr_view const expect = ref.view();
+                theorize::plane_view const planes[3] =
+                    { whole.y, whole.cb, whole.cr };
+                theorize::const_plane_view const wanted[3] =
+                    { expect.y, expect.cb, expect.cr };
+                unsigned char const colors[3] = {black.y, black.cb, black.cr};
+                bool ok = true;
+                for (int i = 0; i < 3; ++i) {
+                    theorize::pixel_format const sub =
+                        i ? format : theorize::pixel_format::yuv444;
+                    unsigned int const left =
+                        theorize::subsampled_width(place.x, sub);
+                    unsigned int const top =
+                        theorize::subsampled_height(place.y, sub);
+                    for (unsigned int y = 0; y < planes[i].height(); ++y) {
+                        for (unsigned int x = 0; x < planes[i].width(); ++x) {
+                            bool const in = x >= left && y >= top
+                                && x-left < wanted[i].width()
+                                && y-top < wanted[i].height();
+                            unsigned char const want = in
+                                ? wanted[i].row(y-top)[x-left] : colors[i];
+                            if (planes[i].row(y)[x] != want)
+                                ok = false;
+                        }
+                    }
+                }
+                if (!ok) {
+                    std::fprintf(stderr, "region %u,%u %ux%u, format %i: "
+                        "mismatch\n", place.x, place.y, place.width,
+                        place.height, static_cast<int>(format));
+                    result = 1;
+                }
+            }
+        }
+    }
+    /* a placer fed only the rows and columns it wants gets it right */{
+        static unsigned int const sources[][2] = {
+            {33, 20}, {100, 75}, {250, 60}, {401, 303}
+        };
+        static theorize::fit_mode const modes[] = {
+            theorize::fit_mode::stretch, theorize::fit_mode::letterbox,
+            theorize::fit_mode::crop, theorize::fit_mode::none
+        };
+        static theorize::scale_filter const filters[] = {
+            theorize::scale_filter::nearest, theorize::scale_filter::bilinear
+        };
+        theorize::frame_region const picture = {6, 2, 100, 75};
+        for (theorize::pixel_format const format : formats) {
+            for (theorize::fit_mode const mode : modes) {
+                for (theorize::scale_filter const filter : filters) {
+                    for (auto const& source : sources) {
+                        theorize::frame_placer placer(picture, mode, filter);
+                        theorize::ycbcr_box src, spare, expect, got;
+                        noise(src, source[0], source[1]);
+                        spare = src;
+                        expect.resize(112, 80, format);
+                        got.resize(112, 80, format);
+                        placer.set_frame(expect);
+                        placer.put_frame(spare);
+                        placer.set_frame(got);
+                        placer.begin(source[0], source[1]);
+                        unsigned char const* const rows =
+                            placer.wanted_rows();
+                        unsigned int count;
+                        std::uint32_t const* const columns =
+                            placer.wanted_columns(count);
+                        for (unsigned int y = 0; y < source[1]; ++y) {
+                            if (rows != nullptr && !rows[y])
+                                continue;
+                            theorize::ycbcr_row_view const out =
+                                placer.row_buffer(y);
+                            for (unsigned int i = 0; i < out.width; ++i) {
+                                theorize::ycbcr const color = src.get(
+                                    columns != nullptr ? columns[i] : i, y);
+                                out.y[i] = color.y;
+                                out.cb[i] = color.cb;
+                                out.cr[i] = color.cr;
+                            }
+                            placer.put_row(y);
+                        }
+                        if (!same(got, expect)) {
+                            std::fprintf(stderr, "placer %ux%u, fit %i, "
+                                "filter %i, format %i: mismatch\n",
+                                source[0], source[1], static_cast<int>(mode),
+                                static_cast<int>(filter),
+                                static_cast<int>(format));
+                            result = 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    /* a placer with flat chroma needs only the luma of each row */{
+        static theorize::fit_mode const modes[] = {
+            theorize::fit_mode::stretch, theorize::fit_mode::letterbox,
+            theorize::fit_mode::crop
+        };
+        static theorize::scale_filter const filters[] = {
+            theorize::scale_filter::nearest, theorize::scale_filter::bilinear
+        };
+        theorize::frame_region const picture = {6, 2, 100, 75};
+        for (theorize::pixel_format const format : formats) {
+            for (theorize::fit_mode const mode : modes) {
+                for (theorize::scale_filter const filter : filters) {
+                    theorize::frame_placer placer(picture, mode, filter);
+                    theorize::ycbcr_box src, spare, expect, got;
+                    got.resize(112, 80, format);
+                    /* color, then grey twice, to check the chroma cache */
+                    for (int frame = 0; frame < 3; ++frame) {
+                        unsigned int const width = 150u - frame*40u;
+                        unsigned int const height = 60u + frame*11u;
+                        noise(src, width, height);
+                        if (frame > 0) {
+                            for (unsigned int y = 0; y < height; ++y) {
+                                theorize::ycbcr_row_view const row =
+                                    src.row(y);
+                                std::memset(row.cb, 128, width);
+                                std::memset(row.cr, 128, width);
+                            }
+                        }
+                        spare = src;
+                        expect.resize(112, 80, format);
+                        placer.set_frame(expect);
+                        placer.put_frame(spare);
+                        placer.set_frame(got);
+                        bool const flat = (frame > 0)
+                            && placer.begin_flat(width, height, 128, 128);
+                        if (frame > 0 && !flat) {
+                            std::fprintf(stderr, "placer refused flat "
+                                "chroma\n");
+                            result = 1;
+                        }
+                        if (!flat)
+                            placer.begin(width, height);
+                        unsigned char const* const rows =
+                            placer.wanted_rows();
+                        unsigned int count;
+                        std::uint32_t const* const columns =
+                            placer.wanted_columns(count);
+                        for (unsigned int y = 0; y < height; ++y) {
+                            if (rows != nullptr && !rows[y])
+                                continue;
+                            theorize::ycbcr_row_view const out =
+                                placer.row_buffer(y);
+                            for (unsigned int i = 0; i < out.width; ++i) {
+                                theorize::ycbcr const color = src.get(
+                                    columns != nullptr ? columns[i] : i, y);
+                                out.y[i] = color.y;
+                                /* the placer should not look at these */
+                                out.cb[i] = flat ? 0 : color.cb;
+                                out.cr[i] = flat ? 255 : color.cr;
+                            }
+                            placer.put_row(y);
+                        }
+                        if (!same(got, expect)) {
+                            std::fprintf(stderr, "flat placer frame %i, "
+                                "fit %i, filter %i, format %i: mismatch\n",
+                                frame, static_cast<int>(mode),
+                                static_cast<int>(filter),
+                                static_cast<int>(format));
+                            result = 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
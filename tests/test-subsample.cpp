@@ -0,0 +1,52 @@
+/*
+ * test-subsample.cpp
+ * chroma subsampling test program
+ */
+
+#include "../src/subsample.hpp"
+#include "test-options.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+int main(int argc, char **argv) {
+    test_options options;
+    int result = test_parse_options(argc, argv, "test_subsample",
+        false, options);
+    if (result != 0)
+        return result;
+    int const support = static_cast<int>(theorize::rgbycc_support());
+    std::srand(options.seed);
+    for (int kernel = 0; kernel <= support && result == 0; ++kernel) {
+        for (std::size_t count = 0; count < 200; ++count) {
+            std::size_t const half = (count+1)/2;
+            std::vector<unsigned char> top(count), bottom(count);
+            std::vector<unsigned char> ref(half+1, 0xA5);
+            std::vector<unsigned char> out(half+1, 0xA5);
+            std::vector<unsigned char> ref_row(half+1, 0xA5);
+            std::vector<unsigned char> out_row(half+1, 0xA5);
+            for (unsigned char& c : top)
+                c = static_cast<unsigned char>(std::rand() & 255);
+            for (unsigned char& c : bottom)
+                c = static_cast<unsigned char>(std::rand() & 255);
+            for (std::size_t i = 0; i < half; ++i) {
+                std::size_t const j = (2*i+1 < count) ? 2*i+1 : 2*i;
+                ref[i] = static_cast<unsigned char>(
+                    (top[2*i] + top[j] + bottom[2*i] + bottom[j] + 2) >> 2);
+                ref_row[i] = static_cast<unsigned char>(
+                    (top[2*i] + top[j] + 1) >> 1);
+            }
+            theorize::subsample_rows(top.data(), bottom.data(), count,
+                out.data(), static_cast<theorize::rgbycc_kernel>(kernel));
+            theorize::subsample_row(top.data(), count, out_row.data(),
+                static_cast<theorize::rgbycc_kernel>(kernel));
+            if (ref != out || ref_row != out_row) {
+                std::fprintf(stderr, "kernels %i: %u samples: mismatch\n",
+                    kernel, static_cast<unsigned int>(count));
+                result = 1;
+                break;
+            }
+        }
+    }
+    return result;
+}